@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// The keep-alive check-in as one UDP round trip. No Arduino dependencies, so
+// it unit-tests natively.
+//
+// The MQTT check-in opens a TCP connection, runs CONNECT, subscribes to three
+// topics and waits for its own publish to come back as the marker that the
+// retained flags were delivered -- several round trips with the radio up, on
+// every timer wake. Here the cube instead asks a small responder next to the
+// broker (tools/checkin_responder.py), which mirrors the retained auto_sleep
+// flags, and gets both back in one datagram:
+//
+//   request:  [0xCD][version][nonce, 4 bytes][slot][device id, 12 bytes]
+//   response: [0xCD][version][nonce, 4 bytes][flags]
+//
+// The device id is the MAC without colons, as in cube/device/<id>/auto_sleep;
+// slot is the stored slot, 0 for none. The nonce is what makes a response an
+// answer to this request rather than a late one to an earlier try, so it is
+// the confirmation the MQTT marker gave: only a response carrying it counts,
+// and silence stays "unconfirmed", never "no flag". A responder that has not
+// yet seen the broker's retained flags stays silent rather than answer.
+static constexpr uint8_t CHECKIN_MAGIC = 0xCD;
+static constexpr uint8_t CHECKIN_VERSION = 1;
+static constexpr size_t CHECKIN_DEVICE_ID_BYTES = 12;
+static constexpr size_t CHECKIN_REQUEST_BYTES = 7 + CHECKIN_DEVICE_ID_BYTES;
+static constexpr size_t CHECKIN_RESPONSE_BYTES = 7;
+static constexpr uint8_t CHECKIN_FLAG_DEVICE_SLEEP = 0x01;
+static constexpr uint8_t CHECKIN_FLAG_SLOT_SLEEP = 0x02;
+
+inline void checkInPutNonce(uint8_t* out, uint32_t nonce) {
+  out[0] = (uint8_t)(nonce >> 24);
+  out[1] = (uint8_t)(nonce >> 16);
+  out[2] = (uint8_t)(nonce >> 8);
+  out[3] = (uint8_t)nonce;
+}
+
+// Returns the request's length, or 0 if device_id is not a full id.
+inline size_t buildCheckInRequest(uint8_t* out, uint32_t nonce, uint8_t slot,
+                                  const char* device_id) {
+  if (strlen(device_id) != CHECKIN_DEVICE_ID_BYTES) {
+    return 0;
+  }
+  out[0] = CHECKIN_MAGIC;
+  out[1] = CHECKIN_VERSION;
+  checkInPutNonce(out + 2, nonce);
+  out[6] = slot;
+  memcpy(out + 7, device_id, CHECKIN_DEVICE_ID_BYTES);
+  return CHECKIN_REQUEST_BYTES;
+}
+
+// True only for a well-formed response to the request that carried nonce.
+inline bool parseCheckInResponse(const uint8_t* data, size_t length, uint32_t nonce,
+                                 bool* device_requests_sleep, bool* slot_requests_sleep) {
+  uint8_t expected[4];
+  checkInPutNonce(expected, nonce);
+  if (length != CHECKIN_RESPONSE_BYTES || data[0] != CHECKIN_MAGIC ||
+      data[1] != CHECKIN_VERSION || memcmp(data + 2, expected, 4) != 0) {
+    return false;
+  }
+  *device_requests_sleep = (data[6] & CHECKIN_FLAG_DEVICE_SLEEP) != 0;
+  *slot_requests_sleep = (data[6] & CHECKIN_FLAG_SLOT_SLEEP) != 0;
+  return true;
+}
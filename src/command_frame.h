@@ -0,0 +1,66 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Batched display commands for cube/N/cmd. No Arduino dependencies, so it
+// unit-tests natively.
+//
+// One game event used to be several publishes to one cube -- /letter, /border,
+// /lock, /flash -- each its own broker hop and callback, and each free to land
+// in a different display frame. A frame here carries them all:
+//
+//   [type][length][length bytes of value] ...
+//
+// The value is exactly the payload the matching text topic takes ("A",
+// "NS:0xF800", "1"), so every record goes through the same handler its topic
+// does. Records are applied in order, and all of them in the same display
+// frame.
+//
+// A frame is taken whole or not at all: one unknown type, an over-long value
+// or a truncated record rejects every record in it, since half an event on
+// screen is what the batching is there to prevent.
+enum CommandFrameType : uint8_t {
+  CMD_FRAME_LETTER = 0x01,
+  CMD_FRAME_BORDER = 0x02,
+  CMD_FRAME_LOCK = 0x03,
+  CMD_FRAME_FLASH = 0x04,
+  CMD_FRAME_RISE_MS = 0x05,
+  CMD_FRAME_STRING = 0x06,
+  CMD_FRAME_FONT_SIZE = 0x07,
+  CMD_FRAME_BORDER_FRAME = 0x08,
+  CMD_FRAME_BORDER_HLINE_TOP = 0x09,
+  CMD_FRAME_BORDER_HLINE_BOTTOM = 0x0A,
+  CMD_FRAME_BORDER_VLINE_LEFT = 0x0B,
+  CMD_FRAME_BORDER_VLINE_RIGHT = 0x0C,
+  CMD_FRAME_BORDER_VLINE_HEIGHT = 0x0D,
+  CMD_FRAME_BRIGHTNESS = 0x0E,
+};
+static constexpr uint8_t CMD_FRAME_TYPE_LAST = CMD_FRAME_BRIGHTNESS;
+static constexpr int CMD_FRAME_MAX_RECORDS = 16;
+
+struct CommandRecord {
+  uint8_t type;
+  uint8_t length;
+  const uint8_t* value;  // Points into the frame; not terminated.
+};
+
+// Splits a frame into at most max_records records, each value no longer than
+// max_value_length. Returns how many, or -1 for a frame to be refused, in
+// which case out holds nothing meaningful.
+inline int parseCommandFrame(const uint8_t* data, size_t length,
+                             CommandRecord* out, int max_records,
+                             uint8_t max_value_length) {
+  int count = 0;
+  size_t i = 0;
+  while (i < length) {
+    if (length - i < 2 || count == max_records) return -1;
+    const uint8_t type = data[i];
+    const uint8_t value_length = data[i + 1];
+    if (type == 0 || type > CMD_FRAME_TYPE_LAST) return -1;
+    if (value_length > max_value_length || value_length > length - i - 2) return -1;
+    out[count++] = CommandRecord{type, value_length, &data[i + 2]};
+    i += 2 + value_length;
+  }
+  return count > 0 ? count : -1;
+}
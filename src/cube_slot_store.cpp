@@ -7,6 +7,7 @@ static const char* KEY_SLOT = "slot";
 static const char* KEY_GENERATION = "gen";
 static const char* KEY_AUTHORITY = "auth";
 static const char* KEY_PRESENCE_BASELINE = "presbase";
+static const char* KEY_FLEET_NONCE = "fleetnonce";
 
 int loadPresenceBaseline() {
   Preferences prefs;
@@ -26,6 +27,24 @@ bool savePresenceBaseline(int baseline) {
   return written;
 }
 
+uint64_t loadFleetNonce() {
+  Preferences prefs;
+  uint64_t nonce = 0;
+  if (prefs.begin(NVS_NAMESPACE, true)) {
+    nonce = prefs.getULong64(KEY_FLEET_NONCE, 0);
+    prefs.end();
+  }
+  return nonce;
+}
+
+bool saveFleetNonce(uint64_t nonce) {
+  Preferences prefs;
+  if (!prefs.begin(NVS_NAMESPACE, false)) return false;
+  const bool written = prefs.putULong64(KEY_FLEET_NONCE, nonce) != 0;
+  prefs.end();
+  return written;
+}
+
 StoredSlot loadStoredSlot() {
   Preferences prefs;
   StoredSlot stored = {-1, 0, false};
@@ -15,6 +15,10 @@ struct StoredSlot {
 int loadPresenceBaseline();
 bool savePresenceBaseline(int baseline);
 
+// The last fleet command nonce accepted; see FleetNonceFloor. 0 means none.
+uint64_t loadFleetNonce();
+bool saveFleetNonce(uint64_t nonce);
+
 StoredSlot loadStoredSlot();
 void saveStoredSlot(int slot, uint32_t generation);
 void latchAuthority();
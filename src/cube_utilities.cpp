@@ -173,7 +173,10 @@ WakeAction resolveWakeAction(bool wifi_connected, bool mqtt_connected,
 }
 
 void runWakeCheckIn(WakeReason wake_reason, WakeCheckInPorts& ports) {
-  if (wake_reason == WAKE_REASON_BUTTON) { ports.stayAwake(); return; }
+  if (wake_reason == WAKE_REASON_BUTTON || wake_reason == WAKE_REASON_DOCK) {
+    ports.stayAwake();
+    return;
+  }
 
   // A reset -- brownout, watchdog, crash, a jostled battery contact -- reads
   // the sleep flag just as a timer wake does. It is not someone deciding to
@@ -210,6 +213,29 @@ void runWakeCheckIn(WakeReason wake_reason, WakeCheckInPorts& ports) {
   ports.stayAwake();
 }
 
+uint32_t nextKeepAliveInterval(uint32_t current_s, KeepAliveOutcome outcome,
+                               const KeepAliveLimits& limits) {
+  uint32_t cap = limits.ceiling_s;
+  if (limits.power_bank_max_s != 0 && limits.power_bank_max_s < cap) {
+    cap = limits.power_bank_max_s;
+  }
+  // The base is set explicitly, per cube or per slot; a cap is only a limit
+  // on how far backing off may stretch it.
+  if (cap < limits.base_s) {
+    cap = limits.base_s;
+  }
+  uint32_t next = limits.base_s;
+  if (outcome == KEEPALIVE_CONFIRMED_ASLEEP) {
+    next = current_s > cap / 2 ? cap : current_s * 2;
+  } else if (outcome == KEEPALIVE_UNCONFIRMED) {
+    next = current_s;
+  }
+  if (next < limits.base_s) {
+    next = limits.base_s;
+  }
+  return next < cap ? next : cap;
+}
+
 void convertNfcIdToHexString(uint8_t* nfc_id, int id_length, char* hex_buffer) {
   for (int i = 0; i < id_length; i++) {
     snprintf(hex_buffer + (i * 2), 3, "%02X", nfc_id[i]);
@@ -100,7 +100,9 @@ WakeAction resolveWakeAction(bool wifi_connected,
                              bool device_requests_sleep,
                              bool slot_requests_sleep);
 
-enum WakeReason { WAKE_REASON_TIMER, WAKE_REASON_BUTTON, WAKE_REASON_OTHER };
+// WAKE_REASON_DOCK is the deep-sleep docking watch: a neighbour arrived or
+// left, which is someone using the cube just as a button press is.
+enum WakeReason { WAKE_REASON_TIMER, WAKE_REASON_BUTTON, WAKE_REASON_DOCK, WAKE_REASON_OTHER };
 
 struct SleepFlags { bool device_requests_sleep; bool slot_requests_sleep; };
 
@@ -123,6 +125,32 @@ struct WakeCheckInPorts {
 
 void runWakeCheckIn(WakeReason wake_reason, WakeCheckInPorts& ports);
 
+// How long the next keep-alive sleep lasts. A cube left on the shelf for days
+// used to check in every sleep_interval_s regardless, each check-in a full
+// WiFi + MQTT connect. Now each check-in that confirms the sleep flag doubles
+// the interval, up to a ceiling; one that could not confirm anything holds it,
+// as a failed check-in never backs off; a wake starts again from the base.
+//
+// A cube on a USB-C power bank cannot stretch far: past the bank's low-draw
+// cut-off the bank switches off between pulses and the cube goes dark for
+// good. power_bank_max_s caps the interval below the ceiling for those; 0
+// when the cube is not on a bank. Neither cap reaches below base_s: a
+// sleep_interval set above one is what the operator asked for, and is kept.
+enum KeepAliveOutcome {
+  KEEPALIVE_CONFIRMED_ASLEEP,
+  KEEPALIVE_UNCONFIRMED,
+  KEEPALIVE_WOKE,
+};
+
+struct KeepAliveLimits {
+  uint32_t base_s;            // cube/N/sleep_interval
+  uint32_t ceiling_s;         // cube/N/sleep_interval_max
+  uint32_t power_bank_max_s;
+};
+
+uint32_t nextKeepAliveInterval(uint32_t current_s, KeepAliveOutcome outcome,
+                               const KeepAliveLimits& limits);
+
 #ifdef NATIVE_TESTING
 // Native C versions for testing
 void removeColonsFromMacC(const char* mac_address, char* output, size_t output_size);
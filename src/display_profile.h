@@ -0,0 +1,41 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Colour-depth profiles for the HUB75 panel. No Arduino dependencies, so it
+// unit-tests natively.
+//
+// The DMA driver keeps one bit plane per bit of colour depth, and a frame
+// repeats each plane for its binary weight. So depth sets both how much DMA
+// memory the panel takes and how often it refreshes, and the library default
+// of 8 bits pays for 256 shades per channel on every screen. A letter screen
+// is a handful of RGB565 colours: 5 bits is all the red and blue they have and
+// all but the lowest bit of green, at a fraction of the planes. A picture
+// wants the full depth.
+//
+// Selected over cube/N/display_profile. The panel is rebuilt to switch, which
+// blanks it for a frame, so this is meant to change with the game's mode
+// rather than with each picture.
+struct DisplayProfile {
+  const char* name;
+  uint8_t color_depth_bits;
+};
+
+// The first entry is the default: what the panel ran at before profiles.
+static constexpr DisplayProfile DISPLAY_PROFILES[] = {
+  {"image", 8},
+  {"letter", 5},
+};
+static constexpr int DISPLAY_PROFILE_COUNT =
+    sizeof(DISPLAY_PROFILES) / sizeof(DISPLAY_PROFILES[0]);
+
+// Index into DISPLAY_PROFILES, or -1 for a name that is not one.
+inline int findDisplayProfile(const char* name) {
+  for (int i = 0; i < DISPLAY_PROFILE_COUNT; i++) {
+    if (strcmp(DISPLAY_PROFILES[i].name, name) == 0) {
+      return i;
+    }
+  }
+  return -1;
+}
@@ -0,0 +1,145 @@
+#pragma once
+
+#include <stdint.h>
+
+// Dirty-rectangle bookkeeping for DisplayManager::updateDisplay(). No Arduino
+// dependencies, so it unit-tests natively.
+//
+// The panel is double buffered and the back buffer is not cleared after a flip,
+// so it still holds the frame before last. A frame therefore has to repaint what
+// changed since that one: its own invalid region plus the previous frame's.
+struct DisplayRect {
+  int16_t x;
+  int16_t y;
+  int16_t w;
+  int16_t h;
+};
+
+inline bool rectEmpty(const DisplayRect& r) { return r.w <= 0 || r.h <= 0; }
+
+inline bool rectIntersects(const DisplayRect& a, const DisplayRect& b) {
+  if (rectEmpty(a) || rectEmpty(b)) return false;
+  return a.x < b.x + b.w && b.x < a.x + a.w &&
+         a.y < b.y + b.h && b.y < a.y + a.h;
+}
+
+inline bool rectContains(const DisplayRect& outer, const DisplayRect& inner) {
+  if (rectEmpty(inner)) return true;
+  return inner.x >= outer.x && inner.y >= outer.y &&
+         inner.x + inner.w <= outer.x + outer.w &&
+         inner.y + inner.h <= outer.y + outer.h;
+}
+
+inline DisplayRect rectUnion(const DisplayRect& a, const DisplayRect& b) {
+  if (rectEmpty(a)) return b;
+  if (rectEmpty(b)) return a;
+  const int16_t x0 = a.x < b.x ? a.x : b.x;
+  const int16_t y0 = a.y < b.y ? a.y : b.y;
+  const int16_t x1 = a.x + a.w > b.x + b.w ? a.x + a.w : b.x + b.w;
+  const int16_t y1 = a.y + a.h > b.y + b.h ? a.y + a.h : b.y + b.h;
+  return DisplayRect{x0, y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0)};
+}
+
+// Glyphs animate in from below the panel, so their bounds routinely start or end
+// off it. Clipped here so nothing downstream fills outside the buffer.
+inline DisplayRect rectClip(const DisplayRect& r, int16_t width, int16_t height) {
+  int16_t x0 = r.x < 0 ? 0 : r.x;
+  int16_t y0 = r.y < 0 ? 0 : r.y;
+  int16_t x1 = r.x + r.w > width ? width : r.x + r.w;
+  int16_t y1 = r.y + r.h > height ? height : r.y + r.h;
+  if (x1 <= x0 || y1 <= y0) return DisplayRect{0, 0, 0, 0};
+  return DisplayRect{x0, y0, (int16_t)(x1 - x0), (int16_t)(y1 - y0)};
+}
+
+inline int32_t rectArea(const DisplayRect& r) {
+  return rectEmpty(r) ? 0 : (int32_t)r.w * r.h;
+}
+
+// A handful of disjoint rectangles rather than one bounding box: a north and a
+// south border changing together would otherwise repaint the whole panel.
+// Overlapping rectangles are merged as they arrive, and when the list is full
+// the new one is folded into whichever existing rectangle grows the least.
+class DirtyRegion {
+ public:
+  static constexpr int MAX_RECTS = 6;
+
+  void clear() { count_ = 0; }
+  bool empty() const { return count_ == 0; }
+  int count() const { return count_; }
+  const DisplayRect& operator[](int i) const { return rects_[i]; }
+
+  void add(const DisplayRect& r) {
+    if (rectEmpty(r)) return;
+    DisplayRect pending = r;
+    // Absorbing one rectangle can make the union overlap another, so keep
+    // merging until the pending one is disjoint from everything held.
+    bool merged = true;
+    while (merged) {
+      merged = false;
+      for (int i = 0; i < count_; i++) {
+        if (rectIntersects(rects_[i], pending)) {
+          pending = rectUnion(rects_[i], pending);
+          rects_[i] = rects_[--count_];
+          merged = true;
+          break;
+        }
+      }
+    }
+    if (count_ < MAX_RECTS) {
+      rects_[count_++] = pending;
+      return;
+    }
+    int best = 0;
+    int32_t best_growth = 0;
+    for (int i = 0; i < count_; i++) {
+      const int32_t growth =
+          rectArea(rectUnion(rects_[i], pending)) - rectArea(rects_[i]);
+      if (i == 0 || growth < best_growth) {
+        best = i;
+        best_growth = growth;
+      }
+    }
+    const DisplayRect grown = rectUnion(rects_[best], pending);
+    rects_[best] = rects_[--count_];
+    add(grown);
+  }
+
+  void add(const DirtyRegion& other) {
+    for (int i = 0; i < other.count_; i++) add(other.rects_[i]);
+  }
+
+  bool intersects(const DisplayRect& r) const {
+    for (int i = 0; i < count_; i++) {
+      if (rectIntersects(rects_[i], r)) return true;
+    }
+    return false;
+  }
+
+  bool covers(const DisplayRect& r) const {
+    for (int i = 0; i < count_; i++) {
+      if (rectContains(rects_[i], r)) return true;
+    }
+    return false;
+  }
+
+  // A layer is drawn whole or not at all -- the GFX calls underneath do not
+  // clip -- so any layer the region touches must lie entirely inside it, or
+  // repainting it would overwrite whatever sits above it outside the region.
+  // Growing can pull in further layers, hence the loop.
+  void closeOver(const DisplayRect* layers, int layer_count) {
+    bool grew = true;
+    while (grew) {
+      grew = false;
+      for (int i = 0; i < layer_count; i++) {
+        if (intersects(layers[i]) && !covers(layers[i])) {
+          add(layers[i]);
+          grew = true;
+        }
+      }
+    }
+  }
+
+ private:
+  DisplayRect rects_[MAX_RECTS] = {};
+  int count_ = 0;
+};
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Fleet-wide commands over UDP multicast. No Arduino dependencies, so it
+// unit-tests natively.
+//
+// cube/brightness, cube/string, the banners and cube/sleep_now go to every
+// cube, and the broker fans each out as one TCP write per cube, one after
+// another -- so a fleet flash lands as a ripple, and sleeping the fleet takes
+// as long as the slowest link. Sent to the fleet's multicast group instead,
+// one datagram reaches every cube at once:
+//
+//   [0xCF][version][command][nonce, 8 bytes][payload ...][tag, 8 bytes]
+//
+// Anyone on the LAN can send to a multicast group, and a datagram can be
+// captured and sent again, so both are checked before anything is applied.
+// The tag is SipHash-2-4 of everything before it, under a key the cubes and
+// the server share (FLEET_COMMAND_KEY in secrets.h): a MAC built for short
+// messages, and small enough to carry here. The nonce must be larger than the
+// last one accepted; the server uses its clock in milliseconds, which also
+// survives its restarts. The nonce is big-endian; the tag is SipHash's eight
+// output bytes in the order the reference emits them, least significant
+// first.
+//
+// The command is one of a fixed subset rather than a topic name: the payload
+// is what the matching MQTT topic takes.
+enum FleetCommandType : uint8_t {
+  FLEET_CMD_BRIGHTNESS = 0x01,
+  FLEET_CMD_STRING = 0x02,
+  FLEET_CMD_BORDER_TOP_BANNER = 0x03,
+  FLEET_CMD_BORDER_BOTTOM_BANNER = 0x04,
+  FLEET_CMD_FLASH = 0x05,
+  FLEET_CMD_SLEEP_NOW = 0x06,
+  FLEET_CMD_REBOOT = 0x07,
+};
+static constexpr uint8_t FLEET_CMD_TYPE_LAST = FLEET_CMD_REBOOT;
+
+static constexpr uint8_t FLEET_COMMAND_MAGIC = 0xCF;
+static constexpr uint8_t FLEET_COMMAND_VERSION = 1;
+static constexpr size_t FLEET_COMMAND_HEADER_BYTES = 11;
+static constexpr size_t FLEET_COMMAND_TAG_BYTES = 8;
+static constexpr size_t FLEET_COMMAND_KEY_BYTES = 16;
+
+struct FleetCommand {
+  uint8_t type;
+  uint64_t nonce;
+  const uint8_t* payload;  // Points into the datagram; not terminated.
+  size_t payload_length;
+};
+
+inline uint64_t sipRotate(uint64_t x, int b) {
+  return (x << b) | (x >> (64 - b));
+}
+
+inline void sipRound(uint64_t& v0, uint64_t& v1, uint64_t& v2, uint64_t& v3) {
+  v0 += v1; v1 = sipRotate(v1, 13); v1 ^= v0; v0 = sipRotate(v0, 32);
+  v2 += v3; v3 = sipRotate(v3, 16); v3 ^= v2;
+  v0 += v3; v3 = sipRotate(v3, 21); v3 ^= v0;
+  v2 += v1; v1 = sipRotate(v1, 17); v1 ^= v2; v2 = sipRotate(v2, 32);
+}
+
+inline uint64_t sipLoad64(const uint8_t* p) {
+  uint64_t value = 0;
+  for (int i = 7; i >= 0; i--) value = (value << 8) | p[i];
+  return value;
+}
+
+// SipHash-2-4, as in Aumasson and Bernstein's reference.
+inline uint64_t sipHash24(const uint8_t key[FLEET_COMMAND_KEY_BYTES],
+                          const uint8_t* data, size_t length) {
+  const uint64_t k0 = sipLoad64(key);
+  const uint64_t k1 = sipLoad64(key + 8);
+  uint64_t v0 = 0x736f6d6570736575ULL ^ k0;
+  uint64_t v1 = 0x646f72616e646f6dULL ^ k1;
+  uint64_t v2 = 0x6c7967656e657261ULL ^ k0;
+  uint64_t v3 = 0x7465646279746573ULL ^ k1;
+
+  const size_t whole = length - length % 8;
+  for (size_t i = 0; i < whole; i += 8) {
+    const uint64_t m = sipLoad64(data + i);
+    v3 ^= m;
+    sipRound(v0, v1, v2, v3);
+    sipRound(v0, v1, v2, v3);
+    v0 ^= m;
+  }
+  uint64_t last = (uint64_t)(length & 0xFF) << 56;
+  for (size_t i = whole; i < length; i++) {
+    last |= (uint64_t)data[i] << (8 * (i - whole));
+  }
+  v3 ^= last;
+  sipRound(v0, v1, v2, v3);
+  sipRound(v0, v1, v2, v3);
+  v0 ^= last;
+
+  v2 ^= 0xFF;
+  for (int i = 0; i < 4; i++) sipRound(v0, v1, v2, v3);
+  return v0 ^ v1 ^ v2 ^ v3;
+}
+
+// False for anything not to be acted on: malformed, an unknown command, or a
+// tag that does not match. The nonce is left to the caller, which holds the
+// last one accepted.
+inline bool parseFleetCommand(const uint8_t* data, size_t length,
+                              const uint8_t key[FLEET_COMMAND_KEY_BYTES],
+                              FleetCommand* out) {
+  if (length < FLEET_COMMAND_HEADER_BYTES + FLEET_COMMAND_TAG_BYTES ||
+      data[0] != FLEET_COMMAND_MAGIC || data[1] != FLEET_COMMAND_VERSION ||
+      data[2] == 0 || data[2] > FLEET_CMD_TYPE_LAST) {
+    return false;
+  }
+  const size_t signed_length = length - FLEET_COMMAND_TAG_BYTES;
+  const uint64_t tag = sipHash24(key, data, signed_length);
+  // Compared whole rather than byte by byte, so a mismatch takes the same
+  // time wherever it is.
+  if ((tag ^ sipLoad64(data + signed_length)) != 0) {
+    return false;
+  }
+  uint64_t nonce = 0;
+  for (int i = 3; i < 11; i++) nonce = (nonce << 8) | data[i];
+  out->type = data[2];
+  out->nonce = nonce;
+  out->payload = data + FLEET_COMMAND_HEADER_BYTES;
+  out->payload_length = signed_length - FLEET_COMMAND_HEADER_BYTES;
+  return true;
+}
+
+// Where the floor is kept between restarts.
+struct FleetNonceStore {
+  virtual ~FleetNonceStore() {}
+  virtual uint64_t load() = 0;
+  virtual bool save(uint64_t nonce) = 0;
+};
+
+// The replay check. The floor has to outlive every restart, not just deep
+// sleep: one that reset to zero would take any captured datagram again, and a
+// recorded reboot command would then reboot the cube on every send, forever.
+// A nonce is stored before it is acted on, and one that cannot be stored is
+// refused, for the same reason: a reboot that ran first would come back up
+// without it.
+class FleetNonceFloor {
+ public:
+  explicit FleetNonceFloor(FleetNonceStore& store) : store_(store) {}
+
+  bool accept(uint64_t nonce) {
+    if (!loaded_) {
+      floor_ = store_.load();
+      loaded_ = true;
+    }
+    if (nonce <= floor_ || !store_.save(nonce)) {
+      return false;
+    }
+    floor_ = nonce;
+    return true;
+  }
+
+ private:
+  FleetNonceStore& store_;
+  bool loaded_ = false;
+  uint64_t floor_ = 0;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdint.h>
+
+// Pre-rasterized glyphs for drawLetter(). No Arduino dependencies, so it
+// unit-tests natively.
+//
+// Adafruit GFX draws a custom-font glyph by walking its 1bpp bitmap and issuing
+// a drawPixel per set bit, and drawLetter() does that for both glyphs on every
+// frame of a landing. Stored as horizontal runs, the same glyph is one
+// drawFastHLine per run -- one to three a row -- instead of one call per lit
+// pixel, of which a capital has well over a thousand.
+//
+// Runs are in the glyph's own box, so one rasterization serves every colour and
+// every rotation: the panel applies both when the run is drawn.
+struct GlyphSpan {
+  uint8_t x;
+  uint8_t y;
+  uint8_t len;
+};
+
+// The busiest glyph in Roboto_Mono_Bold_78 needs 147 runs; a native test holds
+// the whole font to this.
+static constexpr int GLYPH_SPAN_CAPACITY = 192;
+
+// bits is a GFX glyph bitmap: rows packed back to back, MSB first, with no
+// padding at the end of a row. Returns the number of runs written, or -1 when
+// the glyph needs more than max_spans -- the caller falls back to GFX rather
+// than draw a glyph with pieces missing.
+inline int rasterizeGlyphSpans(const uint8_t* bits, uint8_t width, uint8_t height,
+                               GlyphSpan* out, int max_spans) {
+  int count = 0;
+  uint32_t bit = 0;
+  for (uint8_t y = 0; y < height; y++) {
+    int run_start = -1;
+    for (uint8_t x = 0; x <= width; x++) {
+      bool set = false;
+      if (x < width) {
+        set = (bits[bit >> 3] >> (7 - (bit & 7))) & 1;
+        bit++;
+      }
+      if (set && run_start < 0) {
+        run_start = x;
+      } else if (!set && run_start >= 0) {
+        if (count >= max_spans) return -1;
+        out[count++] = GlyphSpan{(uint8_t)run_start, y, (uint8_t)(x - run_start)};
+        run_start = -1;
+      }
+    }
+  }
+  return count;
+}
+
+// Two entries: a landing draws the outgoing glyph and the incoming one, and
+// nothing else is ever on screen at once.
+class GlyphSpanCache {
+ public:
+  static constexpr int ENTRIES = 2;
+
+  struct Entry {
+    bool valid;
+    char letter;
+    int count;
+    GlyphSpan spans[GLYPH_SPAN_CAPACITY];
+  };
+
+  const Entry* find(char letter) const {
+    for (int i = 0; i < ENTRIES; i++) {
+      if (entries_[i].valid && entries_[i].letter == letter) return &entries_[i];
+    }
+    return nullptr;
+  }
+
+  // Rasterizes into whichever entry is not holding `keep`, the glyph still on
+  // screen. Returns nullptr when the glyph does not fit.
+  const Entry* insert(char letter, char keep, const uint8_t* bits,
+                      uint8_t width, uint8_t height) {
+    const Entry* hit = find(letter);
+    if (hit != nullptr) return hit;
+    Entry* slot = &entries_[0];
+    if (entries_[0].valid && entries_[0].letter == keep) slot = &entries_[1];
+    slot->valid = false;
+    const int count = rasterizeGlyphSpans(bits, width, height, slot->spans,
+                                          GLYPH_SPAN_CAPACITY);
+    if (count < 0) return nullptr;
+    slot->count = count;
+    slot->letter = letter;
+    slot->valid = true;
+    return slot;
+  }
+
+ private:
+  Entry entries_[ENTRIES] = {};
+};
@@ -80,6 +80,51 @@ inline int hallPresenceCloseness(int delta, int on_delta) {
   return 100 * (far - distance) / (far - near_by);
 }
 
+// The window a deep-sleeping cube watches the presence reading against, so a
+// neighbour docking -- or leaving, if one was docked when the cube went down --
+// wakes it at once instead of at the next keep-alive pulse. The ULP
+// coprocessor does the watching and cannot run the tracker, so the tracker's
+// decision is flattened into two raw-count bounds for the baseline saved at
+// sleep: a reading at or above wake_at_or_above, or below wake_below, is a
+// crossing. Asleep undocked, the bound is the tracker's assert (delta >=
+// on_delta); asleep docked, its release (delta < off_delta). One of the two is
+// always out of the ADC's 0..4095 range, so it never fires.
+//
+// The baseline is frozen for the whole sleep where the tracker's would adapt,
+// so rail drift over a long sleep eats into on_delta; a crossing it causes is a
+// spurious wake, after which the tracker re-learns the baseline as usual.
+static constexpr int HALL_DOCK_ADC_LIMIT = 4096;  // one past the 12-bit maximum
+
+struct HallDockWatch {
+  uint16_t wake_at_or_above;
+  uint16_t wake_below;
+};
+
+inline uint16_t hallDockClamp(int counts) {
+  if (counts < 0) return 0;
+  if (counts > HALL_DOCK_ADC_LIMIT) return HALL_DOCK_ADC_LIMIT;
+  return (uint16_t)counts;
+}
+
+inline HallDockWatch hallDockWatch(const HallPresenceConfig& cfg, int baseline, bool docked) {
+  HallDockWatch watch = {(uint16_t)HALL_DOCK_ADC_LIMIT, 0};
+  const int threshold = docked ? cfg.off_delta : cfg.on_delta;
+  // delta = direction * (raw - baseline); solved for raw at the threshold.
+  const int bound = cfg.direction > 0 ? baseline + threshold : baseline - threshold + 1;
+  // An assert moves the reading the magnet's way, a release back against it.
+  if ((cfg.direction > 0) != docked) {
+    watch.wake_at_or_above = hallDockClamp(bound);
+  } else {
+    watch.wake_below = hallDockClamp(bound);
+  }
+  return watch;
+}
+
+// The comparison the ULP program makes on each averaged reading.
+inline bool hallDockWatchCrossed(const HallDockWatch& watch, int raw) {
+  return raw >= watch.wake_at_or_above || raw < watch.wake_below;
+}
+
 class HallPresenceTracker {
  public:
   // saved_baseline carries a baseline across a wake. Priming from the first sample
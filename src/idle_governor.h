@@ -0,0 +1,98 @@
+#pragma once
+
+#include <stdint.h>
+
+// When an awake cube may rest between events. No Arduino dependencies, so it
+// unit-tests natively.
+//
+// loop() used to spin flat out whether or not anything was happening, and the
+// radio stayed in WIFI_PS_NONE throughout -- between turns of a game, which is
+// most of a session, that is a core and the radio at full power for nothing.
+// Two levels of rest instead, each entered after a quiet spell:
+//
+// - loop() blocks between passes, for at most the wait the caller allows: the
+//   hall poll period on a magnets cube, IDLE_MAX_WAIT_MS otherwise, which
+//   bounds how late a deadline in loop() can be. Anything handed to loop() --
+//   a message, a UDP request, an NFC result -- wakes it at once.
+// - The radio drops to modem sleep (WIFI_PS_MIN_MODEM): the AP buffers what
+//   arrives for the cube until the next DTIM beacon, so the first packet after
+//   a long quiet can be a beacon interval late, and the one that does arrive
+//   brings the radio back to full power. Only between games, though: a player
+//   thinking over a move is a quiet spell too, and the letter that ends it is
+//   the one packet a player is watching for. So once anything of a game has
+//   happened -- a letter, a picture or a border shown, a neighbour docked or
+//   gone -- the radio stays up until IDLE_GAME_OVER_MS has passed without
+//   another.
+//
+// Automatic light sleep is the deeper level, and is not one this firmware can
+// use: it stops the I2S DMA that refreshes the HUB75 panel, and the Arduino
+// framework is built without power management. The frames are the render
+// task's, on the other core, so none of this touches what the panel shows.
+//
+// Each wait is recorded: how long loop() rested, and for a wait cut short by
+// an event, how long from the event to loop() running again -- the latency
+// the rest costs.
+static constexpr unsigned long IDLE_ENTER_MS = 2000;
+static constexpr unsigned long IDLE_RADIO_ENTER_MS = 15000;
+// Longer than a turn is ever left standing, and well inside the
+// AUTO_SLEEP_TIMEOUT_MS that puts an abandoned cube to sleep altogether.
+static constexpr unsigned long IDLE_GAME_OVER_MS = 180000;
+static constexpr uint32_t IDLE_MAX_WAIT_MS = 50;
+
+class IdleGovernor {
+ public:
+  void noteActivity(unsigned long now_ms) { last_activity_ms_ = now_ms; }
+
+  // Activity that belongs to a game in progress.
+  void noteGameActivity(unsigned long now_ms) {
+    last_activity_ms_ = now_ms;
+    last_game_ms_ = now_ms;
+    game_seen_ = true;
+  }
+
+  // How long loop() may block now: 0 until it has been quiet for
+  // IDLE_ENTER_MS, then max_wait_ms.
+  uint32_t waitMs(unsigned long now_ms, uint32_t max_wait_ms) const {
+    return now_ms - last_activity_ms_ >= IDLE_ENTER_MS ? max_wait_ms : 0;
+  }
+
+  bool radioMayDoze(unsigned long now_ms) const {
+    if (game_seen_ && now_ms - last_game_ms_ < IDLE_GAME_OVER_MS) {
+      return false;
+    }
+    return now_ms - last_activity_ms_ >= IDLE_RADIO_ENTER_MS;
+  }
+
+  // wake_latency_us only counts for a wait an event cut short.
+  void recordWait(uint32_t rested_us, bool woken, uint32_t wake_latency_us) {
+    rested_us_ += rested_us;
+    if (!woken) return;
+    wakes_++;
+    wake_latency_total_us_ += wake_latency_us;
+    if (wake_latency_us > wake_latency_max_us_) wake_latency_max_us_ = wake_latency_us;
+  }
+
+  uint64_t restedUs() const { return rested_us_; }
+  uint32_t wakes() const { return wakes_; }
+  uint32_t wakeLatencyAvgUs() const {
+    return wakes_ == 0 ? 0 : (uint32_t)(wake_latency_total_us_ / wakes_);
+  }
+  uint32_t wakeLatencyMaxUs() const { return wake_latency_max_us_; }
+
+  // The diag report reads the figures for its window, then starts another.
+  void resetStats() {
+    rested_us_ = 0;
+    wakes_ = 0;
+    wake_latency_total_us_ = 0;
+    wake_latency_max_us_ = 0;
+  }
+
+ private:
+  unsigned long last_activity_ms_ = 0;
+  unsigned long last_game_ms_ = 0;
+  bool game_seen_ = false;
+  uint64_t rested_us_ = 0;
+  uint32_t wakes_ = 0;
+  uint64_t wake_latency_total_us_ = 0;
+  uint32_t wake_latency_max_us_ = 0;
+};
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdint.h>
+
+// Row blitting for DisplayManager::drawImage(). No Arduino dependencies, so it
+// unit-tests natively.
+//
+// drawRGBBitmap() hands the panel one pixel at a time through GFX's virtual
+// writePixel(), and each of those converts the colour and rewrites every bit
+// plane of the DMA buffer for a single pixel -- 4096 of them per image, twice a
+// frame while one slides in, including the rows that have slid off the panel.
+// Walked as runs instead, a row of one colour is one drawFastHLine(), which the
+// panel library turns into a single DMA-buffer line write with the colour
+// converted once. Tile art is a few flat colours, so most rows are a handful of
+// runs.
+//
+// Rows and columns that fall off the panel are skipped here rather than
+// clipped pixel by pixel downstream. Positions are in the panel's rotated
+// space, the same space drawRGBBitmap() took, and the panel applies the
+// rotation to each run.
+//
+// sink(x, y, length, color) is called once per run, rows top to bottom.
+template <typename Sink>
+inline void forEachImageRun(const uint16_t* image, int16_t width, int16_t height,
+                            int16_t x, int16_t y,
+                            int16_t panel_width, int16_t panel_height,
+                            Sink&& sink) {
+  const int16_t first_col = x < 0 ? -x : 0;
+  const int16_t last_col = x + width > panel_width ? panel_width - x : width;
+  if (first_col >= last_col) return;
+
+  for (int16_t row = 0; row < height; row++) {
+    const int16_t panel_y = y + row;
+    if (panel_y < 0) continue;
+    if (panel_y >= panel_height) break;
+
+    const uint16_t* pixels = image + (int32_t)row * width;
+    int16_t run_start = first_col;
+    for (int16_t col = first_col + 1; col <= last_col; col++) {
+      if (col == last_col || pixels[col] != pixels[run_start]) {
+        sink((int16_t)(x + run_start), panel_y, (int16_t)(col - run_start),
+             pixels[run_start]);
+        run_start = col;
+      }
+    }
+  }
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Compressed encodings for cube/N/imagez. No Arduino dependencies, so it
+// unit-tests natively.
+//
+// A raw /imagex frame is 8 KB of RGB565 however little is in it, and tile art
+// is a few flat colours. Every encoding here expands to that same frame --
+// RGB565, little-endian, rows top to bottom -- so the decoded pixels are
+// exactly what a raw payload would have memcpy'd in.
+//
+// The first byte names the encoding:
+//
+//   IMAGE_FORMAT_RLE          runs of [length-1][colour lo][colour hi]
+//   IMAGE_FORMAT_PALETTE      [entries-1][entries x colour lo,hi][indices]
+//                             indices packed MSB first at the narrowest of
+//                             1, 2, 4 or 8 bits that holds every entry
+//   IMAGE_FORMAT_PALETTE_RLE  [entries-1][entries x colour lo,hi] then runs
+//                             of [length-1][index]
+//
+// A run never exceeds 256 pixels and may cross a row. A payload must cover the
+// frame exactly: short, long or out-of-palette is rejected whole.
+enum ImageFormat : uint8_t {
+  IMAGE_FORMAT_RLE = 0x01,
+  IMAGE_FORMAT_PALETTE = 0x02,
+  IMAGE_FORMAT_PALETTE_RLE = 0x03,
+};
+
+namespace image_codec_detail {
+
+inline uint16_t readColor(const uint8_t* p) {
+  return (uint16_t)(p[0] | (p[1] << 8));
+}
+
+inline uint8_t paletteIndexBits(size_t entries) {
+  if (entries <= 2) return 1;
+  if (entries <= 4) return 2;
+  if (entries <= 16) return 4;
+  return 8;
+}
+
+// out may be null: the same walk then only checks the payload, so a bad one is
+// refused before a pixel of the destination is touched.
+inline bool decodeRle(const uint8_t* data, size_t length, uint16_t* out,
+                      size_t pixel_count) {
+  if (length % 3 != 0) return false;
+  size_t written = 0;
+  for (size_t i = 0; i < length; i += 3) {
+    const size_t run = (size_t)data[i] + 1;
+    if (run > pixel_count - written) return false;
+    if (out != nullptr) {
+      const uint16_t color = readColor(&data[i + 1]);
+      for (size_t j = 0; j < run; j++) out[written + j] = color;
+    }
+    written += run;
+  }
+  return written == pixel_count;
+}
+
+inline bool decodePalette(const uint8_t* data, size_t length, uint16_t* out,
+                          size_t pixel_count, bool run_length) {
+  if (length < 1) return false;
+  const size_t entries = (size_t)data[0] + 1;
+  const size_t header = 1 + entries * 2;
+  if (length < header) return false;
+  const uint8_t* palette = data + 1;
+  const uint8_t* body = data + header;
+  const size_t body_length = length - header;
+
+  if (run_length) {
+    if (body_length % 2 != 0) return false;
+    size_t written = 0;
+    for (size_t i = 0; i < body_length; i += 2) {
+      const size_t run = (size_t)body[i] + 1;
+      const uint8_t index = body[i + 1];
+      if (index >= entries || run > pixel_count - written) return false;
+      if (out != nullptr) {
+        const uint16_t color = readColor(&palette[index * 2]);
+        for (size_t j = 0; j < run; j++) out[written + j] = color;
+      }
+      written += run;
+    }
+    return written == pixel_count;
+  }
+
+  const uint8_t bits = paletteIndexBits(entries);
+  if (body_length != (pixel_count * bits + 7) / 8) return false;
+  const uint8_t mask = (uint8_t)((1u << bits) - 1);
+  for (size_t p = 0; p < pixel_count; p++) {
+    const size_t bit = p * bits;
+    const uint8_t index = (body[bit >> 3] >> (8 - bits - (bit & 7))) & mask;
+    if (index >= entries) return false;
+    if (out != nullptr) out[p] = readColor(&palette[index * 2]);
+  }
+  return true;
+}
+
+inline bool decodeBody(const uint8_t* data, size_t length, uint16_t* out,
+                       size_t pixel_count) {
+  if (length < 1) return false;
+  switch (data[0]) {
+    case IMAGE_FORMAT_RLE:
+      return decodeRle(data + 1, length - 1, out, pixel_count);
+    case IMAGE_FORMAT_PALETTE:
+      return decodePalette(data + 1, length - 1, out, pixel_count, false);
+    case IMAGE_FORMAT_PALETTE_RLE:
+      return decodePalette(data + 1, length - 1, out, pixel_count, true);
+    default:
+      return false;
+  }
+}
+
+}  // namespace image_codec_detail
+
+// Whether decodeImagePayload() would accept the payload, without decoding it.
+inline bool imagePayloadIsValid(const uint8_t* data, size_t length,
+                                size_t pixel_count) {
+  return image_codec_detail::decodeBody(data, length, nullptr, pixel_count);
+}
+
+// Expands an encoded payload into out, pixel_count RGB565 pixels. Returns false
+// for anything malformed, in which case out is left exactly as it was.
+inline bool decodeImagePayload(const uint8_t* data, size_t length, uint16_t* out,
+                               size_t pixel_count) {
+  if (!imagePayloadIsValid(data, length, pixel_count)) {
+    return false;
+  }
+  return image_codec_detail::decodeBody(data, length, out, pixel_count);
+}
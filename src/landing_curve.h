@@ -0,0 +1,121 @@
+#pragma once
+
+#include <stdint.h>
+
+// The letter/image landing curve. No Arduino dependencies, so it unit-tests
+// natively.
+#define ANIMATION_DURATION_MS 1000
+#define ANIMATION_SCALE 100
+
+// `Ease::BounceOut`, re-proportioned so the travel segment lasts `rise_ms`
+// instead of the library's fixed 4/11 of the duration. Mirrors
+// `bounce_out` in cubes/src/game/landing_transition.py -- the two must agree
+// or the cube and the screen stop meaning the same thing.
+//
+// TWO PARTS. Below `rise` the glyphs travel, on the parabola (t/rise)^2;
+// above it they have arrived and the settle tail rebounds. The tail is
+// REMAPPED rather than rewritten: `u` carries [rise, 1] back onto the stock
+// [1/2.75, 1], so the three rebounds keep their shape and their relative
+// depths and merely occupy whatever time is left. Continuous at the seam by
+// construction -- at t == rise, u == 1/2.75, where the stock curve is 1.0.
+//
+// This is the float reference. The firmware draws from LandingCurve below,
+// and the tests hold that to this.
+inline uint8_t bounceOutReference(unsigned long elapsed, uint16_t rise_ms) {
+  if (elapsed >= ANIMATION_DURATION_MS) {
+    return ANIMATION_SCALE;
+  }
+  const float n = 7.5625f, d = 2.75f;
+  float t = (float)elapsed / (float)ANIMATION_DURATION_MS;
+  float rise = (float)rise_ms / (float)ANIMATION_DURATION_MS;
+  if (rise < 0.000001f) rise = 0.000001f;
+  if (rise > 1.0f) rise = 1.0f;
+
+  float v;
+  if (t < rise) {
+    float u = t / rise;
+    v = u * u;
+  } else {
+    float u = 1.0f / d + (t - rise) / (1.0f - rise) * (1.0f - 1.0f / d);
+    if (u < 2.0f / d) {
+      u -= 1.5f / d;
+      v = n * u * u + 0.75f;
+    } else if (u < 2.5f / d) {
+      u -= 2.25f / d;
+      v = n * u * u + 0.9375f;
+    } else {
+      u -= 2.625f / d;
+      v = n * u * u + 0.984375f;
+    }
+  }
+  if (v < 0.0f) v = 0.0f;
+  if (v > 1.0f) v = 1.0f;
+  return (uint8_t)(v * ANIMATION_SCALE + 0.5f);
+}
+
+// The same curve in integers. Every constant in it is a ratio of elevenths:
+// 1/d is 4/11, the segment seams are 8/11 and 10/11, and n == 121/16 cancels
+// the 11^2 a squared offset brings in. With M = duration - rise and
+// N = elapsed - rise, 11u is P/M where P = 4M + 7N, and each rebound reduces
+// to (P - cM)^2 / 16M^2 plus its floor -- exact, with one rounding at the end.
+inline uint8_t bounceOutFixed(unsigned long elapsed, uint16_t rise_ms) {
+  if (elapsed >= ANIMATION_DURATION_MS) {
+    return ANIMATION_SCALE;
+  }
+  uint64_t rise = rise_ms < 1 ? 1 : rise_ms;
+  if (rise > ANIMATION_DURATION_MS) rise = ANIMATION_DURATION_MS;
+  const uint64_t t = elapsed;
+
+  uint64_t num;
+  uint64_t den;
+  if (t < rise) {
+    num = ANIMATION_SCALE * t * t;
+    den = rise * rise;
+  } else {
+    const int64_t m = (int64_t)(ANIMATION_DURATION_MS - rise);
+    const int64_t p = 4 * m + 7 * (int64_t)(t - rise);
+    int64_t offset;
+    uint64_t floor_num;
+    if (p < 8 * m) {
+      offset = p - 6 * m;
+      floor_num = 12;                   // 0.75 in sixteenths
+      den = 16;
+    } else if (p < 10 * m) {
+      offset = p - 9 * m;
+      floor_num = 15;                   // 0.9375 in sixteenths
+      den = 16;
+    } else {
+      offset = 2 * p - 21 * m;          // doubled: the seam is at 10.5M
+      floor_num = 63;                   // 0.984375 in sixty-fourths
+      den = 64;
+    }
+    const uint64_t m2 = (uint64_t)(m * m);
+    num = ANIMATION_SCALE * ((uint64_t)(offset * offset) + floor_num * m2);
+    den *= m2;
+  }
+  const uint64_t v = (num + den / 2) / den;
+  return (uint8_t)(v > ANIMATION_SCALE ? ANIMATION_SCALE : v);
+}
+
+// bounceOutFixed() baked for one rise_ms, one entry per elapsed millisecond, so
+// a frame costs an array read. Rebaked whenever /rise_ms changes -- rare, and
+// off the render path.
+class LandingCurve {
+ public:
+  void bake(uint16_t rise_ms) {
+    rise_ms_ = rise_ms;
+    for (unsigned long t = 0; t < ANIMATION_DURATION_MS; t++) {
+      table_[t] = bounceOutFixed(t, rise_ms);
+    }
+  }
+
+  uint8_t at(unsigned long elapsed) const {
+    return elapsed >= ANIMATION_DURATION_MS ? ANIMATION_SCALE : table_[elapsed];
+  }
+
+  uint16_t riseMs() const { return rise_ms_; }
+
+ private:
+  uint16_t rise_ms_ = 0;
+  uint8_t table_[ANIMATION_DURATION_MS] = {};
+};
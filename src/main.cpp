@@ -13,6 +13,27 @@ typedef struct MessageNfcId {
 #include "hall_presence.h"
 #include "sensor_mode.h"
 #include "cube_slot_store.h"
+#include "display_region.h"
+#include "glyph_spans.h"
+#include "landing_curve.h"
+#include "spsc_ring.h"
+#include "image_codec.h"
+#include "image_blit.h"
+#include "sprite_store.h"
+#include "status_overlay.h"
+#include "display_profile.h"
+#include "command_frame.h"
+#include "topic_dispatch.h"
+#include "topic_registry.h"
+#include "publish_queue.h"
+#include "udp_command.h"
+#include "fleet_command.h"
+#include "state_snapshot.h"
+#include "mqtt_session.h"
+#include "wifi_association.h"
+#include "checkin_datagram.h"
+#include "idle_governor.h"
+#include "wake_timeline.h"
 #include <Arduino.h>
 #include <Adafruit_GFX.h>
 #include <ESP32-HUB75-MatrixPanel-I2S-DMA.h>
@@ -28,7 +49,11 @@ typedef struct MessageNfcId {
 #include "cube_tags.h"
 #include "esp_system.h"
 #include "esp_task_wdt.h"
+#include "esp_heap_caps.h"
 #include "driver/rtc_io.h"
+#include "driver/adc.h"
+#include "esp32/ulp.h"
+#include "soc/rtc_cntl_reg.h"
 
 // ============= Configuration =============
 // Hardware pin configuration is determined at compile time by board type:
@@ -42,6 +67,14 @@ static int pn5180_busy_pin = 0; // Will be set by configurePins()
 extern PN5180ISO15693* nfc_reader;
 void initializeNfcReader();
 void publishPresence(const char* state);
+void flushPublishQueue(int budget);
+bool slotIsResolved();
+void walkSubscriptions();
+void publishWakeTimeline();
+void sendUdp(const IPAddress& ip, uint16_t port, const char* text);
+bool queuePublish(const char* topic, const char* payload);
+bool armHallDockWatch();
+void stopHallDockWatch();
 
 // Which neighbour sensor this cube carries. Both paths are compiled in;
 // detectSensorMode() sets this at boot and it selects between them.
@@ -118,9 +151,11 @@ void initialiseNeighbourSensor() {
 // Timing Constants
 #define NFC_DEBOUNCE_TIME_MS 200
 #define NFC_MIN_PUBLISH_INTERVAL_MS 100
-#define ANIMATION_DURATION_MS 1000
-#define ANIMATION_SCALE 100
+// ANIMATION_DURATION_MS and ANIMATION_SCALE are in landing_curve.h.
 #define DISPLAY_STARTUP_DELAY_MS 600
+// How long a status line posted after the boot lines were cleared stays over
+// the game; see StatusOverlay.
+#define OVERLAY_LINE_LIFETIME_MS 10000
 #define HALL_SENSOR_CHECK_INTERVAL_MS 50  /* Hall sensor polling interval (matches NFC read rate) */
 
 // Hall Sensor Status Strings
@@ -140,6 +175,16 @@ void initialiseNeighbourSensor() {
 // sleep flag has been delivered. Only reached when the broker or the link is
 // slow; the common case ends at KEEPALIVE_CHECKIN_WINDOW_MS above.
 #define KEEPALIVE_FLAG_READ_TIMEOUT_MS  3000UL
+// Limits for nextKeepAliveInterval(). The ceiling is the default for
+// cube/{id}/sleep_interval_max. The power-bank cap keeps a cube on a USB-C
+// bank pulsing often enough that the bank stays on. Off by default: no bank's
+// low-draw cut-off has been measured yet, and a guessed figure would only
+// clamp the fleet's intervals for nothing. Build a cube that runs from a bank
+// with -DKEEPALIVE_POWER_BANK_MAX_S=<seconds> once its bank has been timed.
+#define KEEPALIVE_INTERVAL_CEILING_S  300UL
+#ifndef KEEPALIVE_POWER_BANK_MAX_S
+#define KEEPALIVE_POWER_BANK_MAX_S  0UL
+#endif
 #define POWER_RAIL_SETTLE_MS  50  /* Let the HUB75 5V rail come up before I2S DMA drives the panel */
 #ifdef BOARD_V6
 #define POWER_SWITCH_PIN GPIO_NUM_5  /* GPIO5 controls TPS22975 HUB75 power switch */
@@ -173,6 +218,25 @@ static const uint8_t HALL_ID_PINS[6] = {32, 17, 23, 18, 34, 35};
 #define HALL_PRESENCE_FAST_SHIFT       3    // ~8 samples at the 1kHz poll
 #define HALL_PRESENCE_BASE_SHIFT       7
 #define HALL_PRESENCE_BASE_INTERVAL_MS 250  // baseline tau ~32s
+#define HALL_PRESENCE_ADC_CHANNEL      ADC1_CHANNEL_0  // GPIO36
+
+// Deep-sleep docking watch: the ULP samples the presence sensor against the
+// tracker's own thresholds and wakes the cube when a neighbour docks or
+// leaves; see hall_presence.h. Every HALL_DOCK_SAMPLE_MS it averages four
+// readings, and HALL_DOCK_CONFIRM_SAMPLES crossings in a row wake the cube, so
+// a lone noise spike does not.
+//
+// Off by default: the watch keeps the sensor powered and the ULP sampling for
+// the whole of every sleep, and nobody has measured what that costs a cube
+// that sleeps most of the day. Build with -DHALL_DOCK_WAKE=1 to try it, and
+// put the sleep current with and without it in docs/HARDWARE_LOG.md before
+// turning it on for the fleet. Off, the cube sleeps on the timer and the
+// button alone.
+#ifndef HALL_DOCK_WAKE
+#define HALL_DOCK_WAKE 0
+#endif
+#define HALL_DOCK_SAMPLE_MS            100
+#define HALL_DOCK_CONFIRM_SAMPLES      2
 
 // Presence telemetry. The ID sensors are digital, so cube/N/hall_debug shows
 // whether a magnet tripped them but nothing shows how much margin the analog
@@ -219,7 +283,12 @@ RTC_DATA_ATTR bool pin0_state_at_sleep = HIGH;
 // How long a sleeping cube stays down between keep-alive check-ins. Survives
 // deep sleep in RTC memory, and cube/{id}/sleep_interval overrides it.
 RTC_DATA_ATTR uint32_t sleep_interval_s = 20;
+// What the next sleep actually uses: sleep_interval_s backed off by
+// nextKeepAliveInterval() over confirmed check-ins, up to keepalive_ceiling_s.
+RTC_DATA_ATTR uint32_t keepalive_interval_s = 20;
+RTC_DATA_ATTR uint32_t keepalive_ceiling_s = KEEPALIVE_INTERVAL_CEILING_S;
 RTC_DATA_ATTR uint16_t saved_brightness = BRIGHTNESS;  // Persist brightness across sleep
+RTC_DATA_ATTR uint8_t saved_display_profile = 0;  // Index into DISPLAY_PROFILES, likewise
 
 // Auto-sleep inactivity tracking
 #define AUTO_SLEEP_TIMEOUT_MS  600000UL  // 10 minutes
@@ -234,6 +303,10 @@ RTC_DATA_ATTR unsigned long last_activity_time = 0;
 // wake.sh can never reach it. 3x the ~1s a static-IP association is expected
 // to take; the "wifi assoc" debug line below is how that gets confirmed.
 #define KEEPALIVE_WIFI_TIMEOUT_MS 3000UL
+// A directed connect to the cached AP skips the scan, so it either associates
+// well inside this or the AP is not where it was. Leaves a full scan's ~1s
+// inside KEEPALIVE_WIFI_TIMEOUT_MS after it.
+#define WIFI_DIRECTED_TIMEOUT_MS 1500UL
 #define WIFI_RETRY_INTERVAL_MS 5000
 #define MQTT_RECONNECT_DELAY_MS 5000
 #define MQTT_SOCKET_TIMEOUT_S 2
@@ -325,41 +398,45 @@ static bool slot_resolved = false;
 static unsigned long assignment_wait_started = 0;
 static String mac_nocolons;
 static String boot_id;
-static String mqtt_topic_assign;
-static String mqtt_topic_device_nfc;
 static char last_observation_published[NFCID_LENGTH * 2 + 1] = "";
-static String mqtt_topic_presence;
-static String mqtt_topic_liveness_response;
 static const unsigned long ASSIGNMENT_WAIT_MS = 3000;
 static RgbOrder current_rgb_order = RGB_ORDER_BGR;
 const char* nfc_topic_out;
 static bool wifi_connection_attempt_active = false;
 static unsigned long wifi_connection_attempt_started = 0;
 static unsigned long next_wifi_connection_attempt = 0;
+// See wifi_association.h.
+RTC_DATA_ATTR static WifiAssociation wifi_association;
+static bool wifi_attempt_directed = false;
+// See wake_timeline.h. wake_record is this wake's, from handleWakeUp() on.
+RTC_DATA_ATTR static WakeTimeline wake_timeline;
+static WakeRecord* wake_record = nullptr;
+static unsigned long setup_started_ms = 0;
+static bool wake_timeline_published = false;
+
+static void markWake(WakePhase phase) { markWakePhase(wake_record, phase, millis()); }
+
+static void noteWakeFlag(uint8_t flag) {
+  if (wake_record != nullptr) wake_record->flags |= flag;
+}
 
 // Animation
 char last_neighbor_id[NFCID_LENGTH * 2 + 1] = "INIT";  // last raw NFC value published to /nfc
 char last_right_published[8] = "INIT";                  // last value published to /right
 unsigned long last_nfc_publish_time = 0;
 
-// Pre-allocated MQTT topics
-String mqtt_topic_cube;
-String mqtt_topic_cube_nfc;
-String mqtt_topic_game_nfc;
-String mqtt_topic_echo;
-String mqtt_topic_cube_right;  // publishes neighbor cube index to cube/right/<id>
-String mqtt_topic_cube_proximity;  // publishes 0-100 closeness to cube/<id>/proximity
+// Pre-allocated MQTT topics: device topics from setup(), slot topics from
+// subscribeSlotTopics(). TOPIC_CUBE_RIGHT carries the neighbour cube index and
+// TOPIC_PROXIMITY the 0-100 closeness.
+static TopicRegistry topics;
 int published_proximity = -1;      // -1 forces the next poll to publish
-// Topics whose retained delete has not been accepted yet. The topic name is the
-// only handle on the stale value, so it is held rather than dropped.
-//
-// Several can be outstanding at once from a single rebinding: binding a slot
-// queues a delete for the topic being left, and resolving as a reader queues
-// another for the one just bound. One pending slot would let the second
-// overwrite the first while the broker is refusing writes, which is the case
-// that strands a record indefinitely.
-static constexpr size_t PROXIMITY_PENDING_CLEARS = 4;
-String mqtt_topic_proximity_pending_clear[PROXIMITY_PENDING_CLEARS];
+
+// Retained state on its way to the broker; see publish_queue.h. A few entries
+// per loop() pass is well ahead of the rate anything changes, and bounds what a
+// slow socket can cost one pass.
+#define PUBLISH_FLUSH_BUDGET 2
+static PublishQueue publish_queue;
+static int publishes_dropped = 0;
 
 // UDP Configuration
 #define UDP_PORT 54321  // Port for ping-pong
@@ -368,6 +445,22 @@ WiFiUDP udp;
 char udpBuffer[255];
 IPAddress debugIP = IPAddress(192, 168, 8, 196);  // Default debug destination
 
+// Fleet multicast group; see fleet_command.h. Only joined with a key to check
+// against.
+#define FLEET_MULTICAST_PORT 54323
+#define FLEET_DATAGRAM_MAX 160
+IPAddress fleet_group = IPAddress(239, 255, 54, 32);
+WiFiUDP fleet_udp;
+
+// Check-in responder; see checkin_datagram.h. Runs beside the broker.
+#define CHECKIN_RESPONDER_PORT 54324
+#define CHECKIN_DATAGRAM_ATTEMPTS 3
+#define CHECKIN_DATAGRAM_WAIT_MS 150
+// Wakes that go straight to the MQTT check-in after the responder failed to
+// answer, so a fleet without one deployed does not wait out the exchange on
+// every pulse first.
+#define CHECKIN_DATAGRAM_SKIP_WAKES 8
+
 // ============= Debug Functions =============
 void debugPrint(const char* message) {
   if (PRINT_DEBUG) {
@@ -383,11 +476,7 @@ void debugPrintln(const char* message) {
 
 // Send debug message via UDP
 void debugSend(const char* message) {
-  // Only send if UDP server is already running
-  if (udp.beginPacket(debugIP, DEBUG_UDP_PORT)) {
-    udp.write((const uint8_t*)message, strlen(message));
-    udp.endPacket();
-  }
+  sendUdp(debugIP, DEBUG_UDP_PORT, message);
 }
 
 void debugPrint(const __FlashStringHelper* message) {
@@ -417,11 +506,16 @@ private:
   bool is_image_mode;
   uint16_t* image1;
   uint16_t* image2;
+  uint16_t* image3;
   uint16_t* image;
   uint16_t* previous_image;
   String display_string;
   bool is_border_word;
-  uint8_t debug_line;
+  // Status text, composited over everything else by updateDisplay(). Lines
+  // expire once the boot lines have been cleared; until then they are boot
+  // progress, and stay up for as long as boot takes.
+  StatusOverlay overlay;
+  bool overlay_lines_expire = false;
   uint16_t border_color;
   unsigned long animation_start_time;
   long highlight_end_time;
@@ -446,6 +540,9 @@ private:
   //: DEFAULTS TO THE STOCK 4/11, so a cube that is never told still animates
   //: correctly, just on the library curve it used before.
   uint16_t rise_ms;
+  // rise_ms baked into a per-millisecond table, so a frame reads the curve
+  // rather than evaluating it.
+  LandingCurve landing_curve;
   const GFXfont* current_font;
   uint8_t text_size;
   uint8_t rotation;
@@ -453,53 +550,24 @@ private:
   bool is_dirty;
   char previous_letter;
   char current_letter;
-
-  // `Ease::BounceOut`, re-proportioned so the travel segment lasts `rise_ms`
-  // instead of the library's fixed 4/11 of the duration. Mirrors
-  // `bounce_out` in cubes/src/game/landing_transition.py -- the two must agree
-  // or the cube and the screen stop meaning the same thing.
-  //
-  // TWO PARTS. Below `rise` the glyphs travel, on the parabola (t/rise)^2;
-  // above it they have arrived and the settle tail rebounds. The tail is
-  // REMAPPED rather than rewritten: `u` carries [rise, 1] back onto the stock
-  // [1/2.75, 1], so the three rebounds keep their shape and their relative
-  // depths and merely occupy whatever time is left. Continuous at the seam by
-  // construction -- at t == rise, u == 1/2.75, where the stock curve is 1.0.
-  uint8_t bounceOut(unsigned long elapsed) const {
-    if (elapsed >= ANIMATION_DURATION_MS) {
-      return ANIMATION_SCALE;
-    }
-    const float n = 7.5625f, d = 2.75f;
-    float t = (float)elapsed / (float)ANIMATION_DURATION_MS;
-    float rise = (float)rise_ms / (float)ANIMATION_DURATION_MS;
-    if (rise < 0.000001f) rise = 0.000001f;
-    if (rise > 1.0f) rise = 1.0f;
-
-    float v;
-    if (t < rise) {
-      float u = t / rise;
-      v = u * u;
-    } else {
-      float u = 1.0f / d + (t - rise) / (1.0f - rise) * (1.0f - 1.0f / d);
-      if (u < 2.0f / d) {
-        u -= 1.5f / d;
-        v = n * u * u + 0.75f;
-      } else if (u < 2.5f / d) {
-        u -= 2.25f / d;
-        v = n * u * u + 0.9375f;
-      } else {
-        u -= 2.625f / d;
-        v = n * u * u + 0.984375f;
-      }
-    }
-    if (v < 0.0f) v = 0.0f;
-    if (v > 1.0f) v = 1.0f;
-    return (uint8_t)(v * ANIMATION_SCALE + 0.5f);
-  }
+  // What has to be repainted on the next frame, and what the last drawn frame
+  // repainted. The back buffer is two frames stale, so both go into a frame.
+  DirtyRegion invalid_region;
+  DirtyRegion previous_region;
+  GlyphSpanCache glyph_cache;
+  // Of the three image buffers, the one neither landing nor being displaced.
+  // It belongs to whoever writes the next picture, which is loop() while the
+  // render task draws the other two, so it changes hands atomically: null
+  // while a picture written into it is on its way to landImage().
+  std::atomic<uint16_t*> ingest_image;
+  // Measured by setupDisplay() for the profile in use, and read by the diag
+  // handler on the other core.
+  std::atomic<uint32_t> dma_bytes{0};
+  std::atomic<uint32_t> refresh_hz{0};
 
 public:
   DisplayManager(String cube_id) : is_image_mode(false), is_dirty(true),
-                                is_border_word(false), debug_line(0),
+                                is_border_word(false),
                                 animation_start_time(0), highlight_end_time(0), percent_complete(100),
                                 current_letter_color(LETTER_COLOR), current_font(&Roboto_Mono_Bold_78),
                                 text_size(1), font_size(1), is_lock(false),
@@ -507,21 +575,39 @@ public:
                                 vline_height(PANEL_RES),
                                 hline_color_top(0),
                                 hline_color_bottom(0),
-                                image1(nullptr), image2(nullptr), image(nullptr), previous_image(nullptr),
+                                image1(nullptr), image2(nullptr), image3(nullptr),
+                                image(nullptr), previous_image(nullptr),
                                 previous_letter(' '), current_letter(' ') {
     int cube_id_int = cube_id.toInt();    
     rotation = (cube_id_int <= 6) ? 2 : 0;
-    setupDisplay();
+    // The saved profile survives deep sleep, so a depth whose buffers no
+    // longer fit would fail every wake; the default is what always has.
+    if (!setupDisplay(saved_display_profile) && saved_display_profile != 0) {
+      delete led_display;
+      saved_display_profile = 0;
+      setupDisplay(0);
+    }
     rise_ms = (uint16_t)(ANIMATION_DURATION_MS * 4.0f / 11.0f);
+    landing_curve.bake(rise_ms);
 
     // Allocate image buffers. Failure is fatal.
     image = image1 = new uint16_t[PIXEL_COUNT];
     previous_image = image2 = new uint16_t[PIXEL_COUNT];
+    image3 = new uint16_t[PIXEL_COUNT];
     memset(image1, 0, PIXEL_COUNT * sizeof(uint16_t));
     memset(image2, 0, PIXEL_COUNT * sizeof(uint16_t));
+    memset(image3, 0, PIXEL_COUNT * sizeof(uint16_t));
+    ingest_image.store(image3);
+
+    // begin() cleared both buffers, but nothing has been composited into them
+    // yet.
+    invalidateAll();
   }
 
-  void setupDisplay() {
+  // Builds the panel at profile's colour depth. False when begin() could not
+  // set it up -- its DMA buffers did not fit -- with the half-built panel left
+  // in led_display for the caller to delete.
+  bool setupDisplay(uint8_t profile) {
     display_config.clkphase = false;
     display_config.double_buff = true;
     
@@ -533,87 +619,243 @@ public:
     display_config.gpio.g2 = rgb[4];
     display_config.gpio.b2 = rgb[5];
     led_display = new MatrixPanel_I2S_DMA(display_config);
-    led_display->begin();
+    // Depth has to be set before begin(), which sizes the DMA buffers from it.
+    led_display->setPixelColorDepthBits(DISPLAY_PROFILES[profile].color_depth_bits);
+    const size_t dma_free_before = heap_caps_get_free_size(MALLOC_CAP_DMA);
+    if (!led_display->begin()) {
+      Serial.printf("display begin failed at profile %s\n", DISPLAY_PROFILES[profile].name);
+      return false;
+    }
+    dma_bytes.store(dma_free_before - heap_caps_get_free_size(MALLOC_CAP_DMA));
     led_display->setBrightness(saved_brightness);  // Use saved brightness (persistent across sleep)
     led_display->setRotation(rotation);
     led_display->setTextWrap(true);
     led_display->clearScreen();
     led_display->setFont(current_font);
     led_display->setTextSize(text_size);
+    measureRefreshRate();
+    return true;
   }
 
+  // flipDMABuffer() returns once the frame being scanned out ends, so with the
+  // first flip lining up on a frame boundary, each one after it takes exactly
+  // one panel refresh.
+  void measureRefreshRate() {
+    led_display->flipDMABuffer();
+    const unsigned long start = micros();
+    led_display->flipDMABuffer();
+    led_display->flipDMABuffer();
+    const unsigned long elapsed = micros() - start;
+    refresh_hz.store(elapsed > 0 ? 2000000UL / elapsed : 0);
+  }
+
+  // Rebuilds the panel at the named profile's colour depth. Everything on it
+  // is state this class holds, so the first frame after puts it all back.
+  //
+  // The old panel has to go before the new one can claim its DMA memory, so a
+  // profile whose buffers do not fit is only found out after the old one is
+  // gone. It is rebuilt then at the profile it had, and saved_display_profile
+  // is left alone: it is what the next wake builds, and has to be one that
+  // worked.
+  void handleDisplayProfileCommand(const String& message) {
+    const int profile = findDisplayProfile(message.c_str());
+    if (profile < 0) {
+      Serial.printf("unknown display profile %s\n", message.c_str());
+      return;
+    }
+    if (profile == saved_display_profile) {
+      return;
+    }
+    led_display->stopDMAoutput();
+    delete led_display;
+    if (!setupDisplay((uint8_t)profile)) {
+      delete led_display;
+      setupDisplay(saved_display_profile);
+      invalidateAll();
+      return;
+    }
+    saved_display_profile = (uint8_t)profile;
+    invalidateAll();
+    Serial.printf("display profile %s: %u-bit, %lu Hz, %lu DMA bytes\n",
+                  DISPLAY_PROFILES[profile].name,
+                  DISPLAY_PROFILES[profile].color_depth_bits,
+                  (unsigned long)refresh_hz.load(), (unsigned long)dma_bytes.load());
+  }
+
+  uint32_t dmaBytes() const { return dma_bytes.load(); }
+  uint32_t refreshHz() const { return refresh_hz.load(); }
+
   void setSlotRotation(int slot) {
     rotation = (slot <= 6) ? 2 : 0;
     led_display->setRotation(rotation);
-    is_dirty = true;
+    invalidateAll();
   }
 
   void clearScreen() {
     led_display->clearScreen();
+    invalid_region.add(panelRect());
   }
 
   void clearDebugDisplay() {
-    led_display->clearScreen();
-    debug_line = 0;
+    invalidate(overlay.bounds(PANEL_RES_X, PANEL_RES_Y));
+    overlay.clear();
+    overlay_lines_expire = true;
+  }
+
+  static DisplayRect panelRect() {
+    return DisplayRect{0, 0, PANEL_RES_X, PANEL_RES_Y};
+  }
+
+  void invalidate(const DisplayRect& rect) {
+    invalid_region.add(rectClip(rect, PANEL_RES_X, PANEL_RES_Y));
+    is_dirty = true;
   }
 
+  void invalidateAll() {
+    invalidate(panelRect());
+  }
+
+  // Where drawLetter() puts a glyph, from the font's own metrics. Falls back to
+  // the whole panel for the built-in font, which /string switches to and whose
+  // metrics are not in a GFXfont.
+  DisplayRect letterBounds(uint16_t vertical_position, char letter) const {
+    if (current_font == nullptr ||
+        (uint8_t)letter < current_font->first ||
+        (uint8_t)letter > current_font->last) {
+      return panelRect();
+    }
+    const GFXglyph* glyph = &current_font->glyph[(uint8_t)letter - current_font->first];
+    const int16_t row = (PANEL_RES_Y * vertical_position) / 100;
+    return DisplayRect{
+        (int16_t)(BIG_COL + (int8_t)pgm_read_byte(&glyph->xOffset) * text_size),
+        (int16_t)(row - 4 + (int8_t)pgm_read_byte(&glyph->yOffset) * text_size),
+        (int16_t)(pgm_read_byte(&glyph->width) * text_size),
+        (int16_t)(pgm_read_byte(&glyph->height) * text_size)};
+  }
+
+  // Everything the letter layer can occupy right now. While a landing runs the
+  // glyphs sweep the full height, so that is the columns of both glyphs top to
+  // bottom rather than a pair of per-frame rectangles chasing them.
+  void invalidateLetter() {
+    if (is_image_mode) {
+      invalidateAll();
+      return;
+    }
+    DisplayRect current = letterBounds(percent_complete, current_letter);
+    if (previous_letter == current_letter) {
+      invalidate(current);
+      return;
+    }
+    DisplayRect band = rectUnion(current, letterBounds(percent_complete, previous_letter));
+    band.y = 0;
+    band.h = PANEL_RES_Y;
+    invalidate(band);
+  }
+
+  void invalidateOrientationIndicator() {
+    invalidate(DisplayRect{2, 60, 2, 2});
+    invalidate(DisplayRect{60, 60, 2, 2});
+  }
+
+  // Full length regardless of vline_height: the strip being replaced may have
+  // been taller than the one replacing it.
+  DisplayRect borderRect(bool isHorizontal, bool isTopLeft) const {
+    const int16_t pos = isTopLeft ? 0 : PANEL_RES - BORDER_LINE_COUNT/2;
+    if (isHorizontal) {
+      return DisplayRect{0, pos, PANEL_RES_X, BORDER_LINE_COUNT/2};
+    }
+    return DisplayRect{pos, 0, BORDER_LINE_COUNT/2, PANEL_RES_Y};
+  }
+
+  // Adds a status line to the overlay; the next frame draws it. Stays up until
+  // clearDebugDisplay() or, after the first one, OVERLAY_LINE_LIFETIME_MS.
   void displayDebugMessage(const char* message) {
-    int y_pos = debug_line * 8 + 8;
+    invalidate(overlay.add(message, PANEL_RES_X, PANEL_RES_Y, millis(),
+                           overlay_lines_expire ? OVERLAY_LINE_LIFETIME_MS : 0));
+  }
 
+  void drawOverlay() {
     // setFont(NULL) shifts the cursor up 6px when a custom font was active, so it
-    // must run before setCursor or the two buffers disagree on the y position.
-    led_display->setTextSize(1);
+    // must run before setCursor.
     led_display->setFont(NULL);
+    led_display->setTextSize(1);
     led_display->setTextColor(RED, BLACK);
-
-    // Write the same text to both DMA buffers so it survives subsequent flips.
-    led_display->setCursor(1, y_pos);
-    led_display->print(message);
-    led_display->flipDMABuffer();
-    led_display->setCursor(1, y_pos);
-    led_display->print(message);
-
-    debug_line++;
-    if (strlen(message) > 10) {
-      debug_line++;
+    for (int i = 0; i < overlay.count(); i++) {
+      led_display->setCursor(OVERLAY_TEXT_X, overlay[i].y);
+      led_display->print(overlay[i].text);
     }
+    led_display->setFont(current_font);
+    led_display->setTextSize(text_size);
   }
 
   void animate(unsigned long current_time) {
     static uint16_t last_letter_color = -1;
 
+    const DisplayRect expired = overlay.expire(current_time, PANEL_RES_X, PANEL_RES_Y);
+    if (!rectEmpty(expired)) {
+      invalidate(expired);
+    }
+
     current_letter_color = current_time < highlight_end_time ? HIGHLIGHT_LETTER_COLOR : LETTER_COLOR;
     if (is_lock) {
       current_letter_color = YELLOW;
     }
     if (last_letter_color != current_letter_color) {
       last_letter_color = current_letter_color;
-      is_dirty = true;
+      invalidateLetter();
     }
 
     if (previous_letter != current_letter || previous_image != image) {
       static uint8_t previous_percent_complete = -1;
       if (current_time - animation_start_time >= ANIMATION_DURATION_MS) {
         // complete animation
+        invalidateLetter();
         previous_image = image;
         previous_letter = current_letter;
         percent_complete = ANIMATION_SCALE;
-        is_dirty = true;
+        invalidateLetter();
+        invalidateOrientationIndicator();
       } 
       else {
         // animation in progress
-        percent_complete = bounceOut(current_time - animation_start_time);
+        percent_complete = landing_curve.at(current_time - animation_start_time);
         if (percent_complete != previous_percent_complete) {
             previous_percent_complete = percent_complete;
-            is_dirty = true;
+            invalidateLetter();
         }
       }
     }
   }
 
+  // The cache is built for the letter font at size 1 only; /string switches
+  // fonts, and that path still goes through GFX.
+  const GlyphSpanCache::Entry* cachedGlyph(char letter) {
+    if (current_font != &Roboto_Mono_Bold_78 || text_size != 1 ||
+        (uint8_t)letter < current_font->first ||
+        (uint8_t)letter > current_font->last) {
+      return nullptr;
+    }
+    const GFXglyph* glyph = &current_font->glyph[(uint8_t)letter - current_font->first];
+    return glyph_cache.insert(letter, previous_letter,
+                              &current_font->bitmap[pgm_read_word(&glyph->bitmapOffset)],
+                              pgm_read_byte(&glyph->width),
+                              pgm_read_byte(&glyph->height));
+  }
+
   void drawLetter(uint16_t vertical_position, char letter, uint16_t color) {
     // Serial.println("displayLetter");
     int16_t row = (PANEL_RES_Y * vertical_position) / 100;
+    const GlyphSpanCache::Entry* spans = cachedGlyph(letter);
+    if (spans != nullptr) {
+      // Same placement as GFX drawChar(): the cursor is the baseline, offset by
+      // the glyph's own x/y offsets.
+      const DisplayRect box = letterBounds(vertical_position, letter);
+      for (int i = 0; i < spans->count; i++) {
+        const GlyphSpan& span = spans->spans[i];
+        led_display->drawFastHLine(box.x + span.x, box.y + span.y, span.len, color);
+      }
+      return;
+    }
     led_display->setTextColor(color, BLACK);
     led_display->setTextSize(BIG_TEXT_SIZE);
     led_display->setCursor(BIG_COL, row-4);
@@ -661,25 +903,25 @@ public:
     handleBorderBottomBannerCommand(message);
     handleBorderVLineLeftCommand(message);
     handleBorderVLineRightCommand(message);
-    is_dirty = true;
   }
 
   void handleBorderVLineRightCommand(const String& message) {
     debugPrintln("setting border vline right color due to /border_vline_right");
     vline_color_right = strtol(message.c_str(), NULL, 16);
-    is_dirty = true;
+    invalidate(borderRect(false, false));
   }
 
   void handleBorderVLineLeftCommand(const String& message) {
     debugPrintln("setting border vline left color due to /border_vline_left");
     vline_color_left = strtol(message.c_str(), NULL, 16);
-    is_dirty = true;
+    invalidate(borderRect(false, true));
   }
 
   void handleBorderLineHeightCommand(const String& message) {
     debugPrintln("setting border vline height due to /border_vline_height");
     vline_height = message.length() == 0 ? PANEL_RES_Y : message.toInt();
-    is_dirty = true;
+    invalidate(borderRect(false, true));
+    invalidate(borderRect(false, false));
   }
 
   void handleFlashCommand(const String& message) {
@@ -688,7 +930,7 @@ public:
     }
     debugPrintln("flashing due to /flash");
     highlight_end_time = millis() + HIGHLIGHT_TIME_MS;
-    is_dirty = true;
+    invalidateLetter();
   }
 
   void handleFontSizeCommand(const String& message) {
@@ -718,6 +960,7 @@ public:
     if (value < 1) value = 1;
     if (value > ANIMATION_DURATION_MS) value = ANIMATION_DURATION_MS;
     rise_ms = (uint16_t)value;
+    landing_curve.bake(rise_ms);
     Serial.printf("[%lu] landing rise set to %u ms\n", millis(), rise_ms);
     // NOT is_dirty: this changes the shape of the NEXT landing, not anything
     // on screen right now. Marking dirty here would redraw the current frame
@@ -729,7 +972,7 @@ public:
     is_lock = message.length() > 0 && message.charAt(0) == '1';
     Serial.println(is_lock);
     Serial.println(message);
-    is_dirty = true;
+    invalidateLetter();
   }
 
   void drawImage(int8_t percent_complete, uint16_t* image) {
@@ -737,18 +980,69 @@ public:
     // Serial.printf("image_position: %d\n", image_position);
     // Serial.printf("image: %p\n", image);
     int16_t row = (PANEL_RES_Y * percent_complete) / 100;
-    led_display->drawRGBBitmap(0, row, image, 64, 64);
+    // An image layer covers the whole panel, so updateDisplay() has already
+    // cleared all of it to black, and black runs are left as they are.
+    forEachImageRun(image, PANEL_RES_X, PANEL_RES_Y, 0, row, PANEL_RES_X, PANEL_RES_Y,
+                    [this](int16_t x, int16_t y, int16_t length, uint16_t color) {
+                      if (color != BLACK) {
+                        led_display->drawFastHLine(x, y, length, color);
+                      }
+                    });
   }
 
+  // Repaints only what changed since the back buffer was last drawn: the rest
+  // of it already holds the right pixels, so clearing and redrawing the whole
+  // frame was time taken straight out of loop().
   void updateDisplay(unsigned long current_time) {
     if (!is_dirty) {
       return;
     }
+    is_dirty = false;
+    if (invalid_region.empty()) {
+      return;
+    }
 
     led_display->setFont(current_font);
     led_display->setTextSize(text_size);
     led_display->setRotation(rotation);
 
+    // Every layer's footprint, in draw order. An empty rect is a layer with
+    // nothing on screen this frame.
+    enum { LAYER_PREVIOUS, LAYER_CURRENT, LAYER_DOT_LEFT, LAYER_DOT_RIGHT,
+           LAYER_STRING, LAYER_TOP, LAYER_BOTTOM, LAYER_LEFT, LAYER_RIGHT,
+           LAYER_OVERLAY, LAYER_COUNT };
+    const DisplayRect none = {0, 0, 0, 0};
+    DisplayRect layers[LAYER_COUNT];
+    const bool animating = is_image_mode ? image != previous_image
+                                         : current_letter != previous_letter;
+    if (is_image_mode) {
+      layers[LAYER_PREVIOUS] = animating ? panelRect() : none;
+      layers[LAYER_CURRENT] = panelRect();
+    } else {
+      layers[LAYER_PREVIOUS] = animating
+          ? rectClip(letterBounds(100 + percent_complete, previous_letter), PANEL_RES_X, PANEL_RES_Y)
+          : none;
+      layers[LAYER_CURRENT] =
+          rectClip(letterBounds(percent_complete, current_letter), PANEL_RES_X, PANEL_RES_Y);
+    }
+    const bool dots = !is_image_mode && percent_complete >= 100;
+    layers[LAYER_DOT_LEFT] = dots ? DisplayRect{2, 60, 2, 2} : none;
+    layers[LAYER_DOT_RIGHT] = dots ? DisplayRect{60, 60, 2, 2} : none;
+    layers[LAYER_STRING] = display_string.length() > 0 ? panelRect() : none;
+    layers[LAYER_TOP] = hline_color_top ? borderRect(true, true) : none;
+    layers[LAYER_BOTTOM] = hline_color_bottom ? borderRect(true, false) : none;
+    layers[LAYER_LEFT] = vline_color_left ? borderRect(false, true) : none;
+    layers[LAYER_RIGHT] = vline_color_right ? borderRect(false, false) : none;
+    layers[LAYER_OVERLAY] = overlay.bounds(PANEL_RES_X, PANEL_RES_Y);
+
+    DirtyRegion region = invalid_region;
+    region.add(previous_region);
+    region.closeOver(layers, LAYER_COUNT);
+
+    for (int i = 0; i < region.count(); i++) {
+      led_display->fillRect(region[i].x, region[i].y, region[i].w, region[i].h, BLACK);
+    }
+
     if (is_image_mode) {
       // Serial.printf("image: %p, previous_image: %p\n", image, previous_image);
       if (image != previous_image) {
@@ -756,13 +1050,16 @@ public:
       }
       drawImage(100 - percent_complete, image);
     } else {
-      if (current_letter != previous_letter) {
+      if (region.intersects(layers[LAYER_PREVIOUS])) {
         drawLetter(100 + percent_complete, previous_letter, RED);
       }
-      drawLetter(percent_complete, current_letter, current_letter_color);
+      if (region.intersects(layers[LAYER_CURRENT])) {
+        drawLetter(percent_complete, current_letter, current_letter_color);
+      }
 
       // Draw orientation indicator only when letter animation is complete
-      if (percent_complete >= 100) {
+      if (dots && (region.intersects(layers[LAYER_DOT_LEFT]) ||
+                   region.intersects(layers[LAYER_DOT_RIGHT]))) {
         drawOrientationIndicator();
       }
     } 
@@ -775,10 +1072,16 @@ public:
       led_display->print(display_string);
     }
 
-    drawBorderFrame();
+    if (region.intersects(layers[LAYER_TOP])) drawBorders(true, true, hline_color_top);
+    if (region.intersects(layers[LAYER_BOTTOM])) drawBorders(true, false, hline_color_bottom);
+    if (region.intersects(layers[LAYER_LEFT])) drawBorders(false, true, vline_color_left);
+    if (region.intersects(layers[LAYER_RIGHT])) drawBorders(false, false, vline_color_right);
+    // Last, so status text reads over a letter or an image.
+    if (region.intersects(layers[LAYER_OVERLAY])) drawOverlay();
     led_display->flipDMABuffer();
-    led_display->clearScreen();
-    is_dirty = false;
+
+    previous_region = region;
+    invalid_region.clear();
   }
 
 #ifdef BOARD_V6
@@ -805,38 +1108,45 @@ public:
     led_display->setBrightness(brightness);
   }
 
-  void handleImageBinaryCommand(const String& message) {
-    Serial.println("handling binary image");
-    Serial.printf("message length: %d\n", message.length());
-    if (message.length() > IMAGE_SIZE) {
-      Serial.println("Image too large");
-      return;
-    }
-    
-    static unsigned long last_message_time = 0;
-    is_image_mode = true;
+  // The frame a new picture is written into, or null while the last one
+  // written is still waiting for landImage(). Pair with releaseIngestImage()
+  // or a DISPLAY_CMD_IMAGE.
+  uint16_t* claimIngestImage() {
+    return ingest_image.exchange(nullptr);
+  }
 
+  // For a claimed frame that turned out not to hold a picture.
+  void releaseIngestImage(uint16_t* frame) {
+    ingest_image.store(frame);
+  }
+
+  // Lands a frame filled through claimIngestImage(). The image it displaces
+  // slides out, and whichever buffer that leaves idle goes back to ingest.
+  void landImage(uint16_t* frame) {
+    is_image_mode = true;
     previous_image = image;
-    image = (image == image1) ? image2 : image1;
+    image = frame;
+    uint16_t* idle = image1;
+    if (idle == image || idle == previous_image) idle = image2;
+    if (idle == image || idle == previous_image) idle = image3;
+    ingest_image.store(idle);
 
     animation_start_time = millis();
-
-    memcpy(image, message.c_str(), message.length());
-    is_dirty = true;
+    invalidateAll();
   }
 
   void handleBorderTopBannerCommand(const String& message) {
     debugPrintln("setting border top banner due to /border_top_banner");
     Serial.println(message);
     hline_color_top = strtol(message.c_str(), NULL, 16);
-    is_dirty = true;  
+    invalidate(borderRect(true, true));
   }
 
   void handleBorderBottomBannerCommand(const String& message) {
     debugPrintln("setting border bottom banner due to /border_bottom_banner");
     Serial.println(message);
     hline_color_bottom = strtol(message.c_str(), NULL, 16);    
-    is_dirty = true;  
+    invalidate(borderRect(true, false));
   }
 
   void handleConsolidatedBorderCommand(const String& message) {
@@ -883,35 +1193,22 @@ public:
       }
     }
     
-    // Force display update
-    is_dirty = true;
+    // Every side was cleared above, so every side is repainted.
+    invalidate(borderRect(true, true));
+    invalidate(borderRect(true, false));
+    invalidate(borderRect(false, true));
+    invalidate(borderRect(false, false));
   }
 
+  // Arrival timing is taken by noteLetterArrival() when the message comes off
+  // MQTT; by the time this runs on the render task it is up to a frame late.
   void handleLetterCommand(const String& message) {
-    static unsigned long last_message_time = 0;
-    unsigned long current_time = millis();
-    unsigned long time_since_last = current_time - last_message_time;
-
-    if (time_since_last > 1000) {
-        Serial.println("----------------------------------------");
-        Serial.printf("[%lu] WARNING: %lu ms since last message\n", current_time, time_since_last);
-        Serial.println("----------------------------------------");
+    // Whatever is on screen now is replaced, wherever it happens to be.
+    invalidateLetter();
+    if (percent_complete >= 100) {
+      invalidateOrientationIndicator();
     }
 
-    // Track letter interval statistics
-    if (last_message_time > 0 && time_since_last < 5000) {
-      letter_interval_accum += time_since_last;
-      letter_interval_count++;
-      if (time_since_last > max_letter_interval) {
-        max_letter_interval = time_since_last;
-      }
-    }
-    last_letter_recv_time = current_time;
-
-    last_message_time = current_time;
-
-    Serial.printf("[%lu] MQTT letter '%s' delta=%lu ms\n", current_time, message.c_str(), time_since_last);
-    
     if (previous_letter != current_letter) {
       previous_letter = current_letter;
     }
@@ -922,7 +1219,9 @@ public:
       animation_start_time = millis();
       current_font = &Roboto_Mono_Bold_78;  // Restore custom font for letter mode
       text_size = 1;  // Always use size 1 for letter mode
-      is_dirty = true;
+      // Rasterized now, once, rather than on the first frame of the landing.
+      cachedGlyph(current_letter);
+      invalidateLetter();
     }
   }
 
@@ -930,7 +1229,7 @@ public:
     debugPrintln("setting string due to /string");
     display_string = message;
     current_font = nullptr;  // Use default font for string mode
-    is_dirty = true;
+    invalidateAll();
   }
 };
 
@@ -938,6 +1237,762 @@ public:
 // ============= Global Variables =============
 DisplayManager* display_manager;
 
+// ============= Render Task =============
+// Once setup() starts it, the render task owns display_manager: it applies the
+// display commands the MQTT handlers post, then animates and draws, on a frame
+// clock of its own. Before it starts and after stopRenderTask() a posted
+// command runs on the caller instead, so callers never need to know which.
+//
+// Pinned away from ARDUINO_RUNNING_CORE, where loop() and the NFC worker run:
+// a frame -- flipDMABuffer() waits out the panel refresh -- costs loop()
+// nothing. It shares core 0 with the network task, above it, so a slow
+// mqtt_client.loop() does not cost a frame either.
+#define RENDER_FRAME_MS 33              // ~30 FPS, the rate loop() used to throttle to
+#define RENDER_TASK_CORE 0
+#define RENDER_TASK_PRIORITY 2
+#define RENDER_TASK_STACK 4096
+#define RENDER_STOP_TIMEOUT_MS 200
+#define DISPLAY_COMMAND_QUEUE_LENGTH 32
+// Longer than any command payload, /string included: the built-in 6x8 font
+// fits 10 columns by 8 rows on the panel, so a string past 80 characters runs
+// off the bottom anyway. Anything longer is truncated, and says so.
+#define DISPLAY_COMMAND_TEXT_MAX 96
+// A full queue means the render task has fallen a second behind; waiting a few
+// frames for room beats dropping a /letter outright.
+#define DISPLAY_QUEUE_FULL_WAIT_MS 100
+
+enum DisplayCommandType : uint8_t {
+  DISPLAY_CMD_BORDER_TOP_BANNER,
+  DISPLAY_CMD_BORDER_BOTTOM_BANNER,
+  DISPLAY_CMD_BORDER,
+  DISPLAY_CMD_BORDER_FRAME,
+  DISPLAY_CMD_BORDER_VLINE_HEIGHT,
+  DISPLAY_CMD_BORDER_VLINE_LEFT,
+  DISPLAY_CMD_BORDER_VLINE_RIGHT,
+  DISPLAY_CMD_STRING,
+  DISPLAY_CMD_FONT_SIZE,
+  DISPLAY_CMD_FLASH,
+  DISPLAY_CMD_IMAGE,
+  DISPLAY_CMD_LETTER,
+  DISPLAY_CMD_LOCK,
+  DISPLAY_CMD_RISE_MS,
+  DISPLAY_CMD_BRIGHTNESS,
+  DISPLAY_CMD_DISPLAY_PROFILE,
+  DISPLAY_CMD_DEBUG_MESSAGE,
+  DISPLAY_CMD_CLEAR_DEBUG,
+  DISPLAY_CMD_SLOT_ROTATION,
+};
+
+struct DisplayCommand {
+  DisplayCommandType type;
+  char text[DISPLAY_COMMAND_TEXT_MAX];
+  // DISPLAY_CMD_IMAGE only: the claimed ingest frame, already filled.
+  uint16_t* frame;
+  // Set on every command of a batch but the last: the render task applies
+  // through to the end of the batch before it draws.
+  bool more;
+};
+
+// The Arduino loop task -- setup(), then loop() -- is the only producer and the
+// render task the only consumer.
+static SpscRing<DisplayCommand, DISPLAY_COMMAND_QUEUE_LENGTH> display_commands;
+TaskHandle_t render_task_handle = nullptr;
+static std::atomic<TaskHandle_t> render_stop_waiter{nullptr};
+// Counted by loop() and, for a picture, by whichever side runs the MQTT client.
+static std::atomic<int> display_commands_dropped{0};
+
+// Written by the render task and read and reset by the diag handler on the
+// other core, hence the lock; it is held for a handful of adds.
+struct RenderTiming {
+  unsigned long frame_us;
+  unsigned long frame_max_us;
+  int frames;
+};
+static RenderTiming render_timing = {0, 0, 0};
+static portMUX_TYPE render_timing_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void applyDisplayCommand(const DisplayCommand& command) {
+  if (command.type == DISPLAY_CMD_IMAGE) {
+    display_manager->landImage(command.frame);
+    return;
+  }
+  const String text(command.text);
+  switch (command.type) {
+    case DISPLAY_CMD_BORDER_TOP_BANNER: display_manager->handleBorderTopBannerCommand(text); break;
+    case DISPLAY_CMD_BORDER_BOTTOM_BANNER: display_manager->handleBorderBottomBannerCommand(text); break;
+    case DISPLAY_CMD_BORDER: display_manager->handleConsolidatedBorderCommand(text); break;
+    case DISPLAY_CMD_BORDER_FRAME: display_manager->handleBorderFrameCommand(text); break;
+    case DISPLAY_CMD_BORDER_VLINE_HEIGHT: display_manager->handleBorderLineHeightCommand(text); break;
+    case DISPLAY_CMD_BORDER_VLINE_LEFT: display_manager->handleBorderVLineLeftCommand(text); break;
+    case DISPLAY_CMD_BORDER_VLINE_RIGHT: display_manager->handleBorderVLineRightCommand(text); break;
+    case DISPLAY_CMD_STRING: display_manager->handleStringCommand(text); break;
+    case DISPLAY_CMD_FONT_SIZE: display_manager->handleFontSizeCommand(text); break;
+    case DISPLAY_CMD_FLASH: display_manager->handleFlashCommand(text); break;
+    case DISPLAY_CMD_LETTER: display_manager->handleLetterCommand(text); break;
+    case DISPLAY_CMD_LOCK: display_manager->handleLockCommand(text); break;
+    case DISPLAY_CMD_RISE_MS: display_manager->handleRiseMsCommand(text); break;
+    case DISPLAY_CMD_BRIGHTNESS: display_manager->handleBrightnessCommand(text); break;
+    case DISPLAY_CMD_DISPLAY_PROFILE: display_manager->handleDisplayProfileCommand(text); break;
+    case DISPLAY_CMD_DEBUG_MESSAGE: display_manager->displayDebugMessage(command.text); break;
+    case DISPLAY_CMD_CLEAR_DEBUG: display_manager->clearDebugDisplay(); break;
+    case DISPLAY_CMD_SLOT_ROTATION: display_manager->setSlotRotation(text.toInt()); break;
+    case DISPLAY_CMD_IMAGE: break;
+  }
+}
+
+// When loop() may rest, and the radio doze; see idle_governor.h. loop()'s own,
+// like everything that posts display commands. Up here because what those
+// commands show decides whether a game is on.
+static IdleGovernor idle_governor;
+
+// What a game shows, as opposed to the cube's own housekeeping on the panel;
+// see IdleGovernor::noteGameActivity().
+static bool isGameDisplayCommand(DisplayCommandType type) {
+  switch (type) {
+    case DISPLAY_CMD_BORDER_TOP_BANNER:
+    case DISPLAY_CMD_BORDER_BOTTOM_BANNER:
+    case DISPLAY_CMD_BORDER:
+    case DISPLAY_CMD_BORDER_FRAME:
+    case DISPLAY_CMD_BORDER_VLINE_HEIGHT:
+    case DISPLAY_CMD_BORDER_VLINE_LEFT:
+    case DISPLAY_CMD_BORDER_VLINE_RIGHT:
+    case DISPLAY_CMD_STRING:
+    case DISPLAY_CMD_FLASH:
+    case DISPLAY_CMD_IMAGE:
+    case DISPLAY_CMD_LETTER:
+    case DISPLAY_CMD_LOCK:
+      return true;
+    default:
+      return false;
+  }
+}
+
+static bool enqueueDisplayCommand(const DisplayCommand& command) {
+  if (isGameDisplayCommand(command.type)) {
+    idle_governor.noteGameActivity(millis());
+  }
+  if (render_task_handle == nullptr) {
+    applyDisplayCommand(command);
+    return true;
+  }
+  unsigned long wait_start = millis();
+  while (!display_commands.push(command)) {
+    if (millis() - wait_start >= DISPLAY_QUEUE_FULL_WAIT_MS) {
+      display_commands_dropped++;
+      Serial.printf("display queue full, dropped command %d\n", command.type);
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+// Queues commands that the render task applies within one frame. Room for the
+// whole batch is found before any of it is pushed, so a batch is never cut
+// short with the render task waiting on a tail that is not coming.
+static bool enqueueDisplayBatch(DisplayCommand* commands, int count) {
+  for (int i = 0; i < count; i++) {
+    if (isGameDisplayCommand(commands[i].type)) {
+      idle_governor.noteGameActivity(millis());
+      break;
+    }
+  }
+  if (render_task_handle == nullptr) {
+    for (int i = 0; i < count; i++) {
+      applyDisplayCommand(commands[i]);
+    }
+    return true;
+  }
+  unsigned long wait_start = millis();
+  while (display_commands.capacity() - display_commands.size() < (size_t)count) {
+    if (millis() - wait_start >= DISPLAY_QUEUE_FULL_WAIT_MS) {
+      display_commands_dropped += count;
+      Serial.printf("display queue full, dropped batch of %d\n", count);
+      return false;
+    }
+    delay(1);
+  }
+  for (int i = 0; i < count; i++) {
+    commands[i].more = i + 1 < count;
+    display_commands.push(commands[i]);
+  }
+  return true;
+}
+
+bool postDisplayCommand(DisplayCommandType type, const char* text) {
+  DisplayCommand command = {};
+  command.type = type;
+  const size_t length = strlen(text);
+  if (length >= sizeof(command.text)) {
+    Serial.printf("display command %d truncated: %u of %u chars kept\n", type,
+                  (unsigned)(sizeof(command.text) - 1), (unsigned)length);
+  }
+  strncpy(command.text, text, sizeof(command.text) - 1);
+  command.text[sizeof(command.text) - 1] = '\0';
+  return enqueueDisplayCommand(command);
+}
+
+bool postDisplayCommand(DisplayCommandType type, const String& text) {
+  return postDisplayCommand(type, text.c_str());
+}
+
+// The payload is written once, into the frame it will be shown from: copied
+// for a raw /imagex, decoded for /imagez. Nothing is allocated on the way, and
+// the render task only swaps pointers. Takes a byte span so that it does not
+// care what the MQTT client delivered the payload in.
+//
+// Runs where the MQTT client does -- the network task, or the caller without
+// it -- and reads the payload straight out of the client's message: copied
+// across to loop() first, every 8 KB picture was a heap String of its own, up
+// to a ring's worth at once beside the DMA buffers. Only the filled frame goes
+// on, to postIngestImage(). The claim is atomic, so either side may make it.
+// Null when nothing was filled.
+uint16_t* fillIngestImage(const uint8_t* data, size_t length, bool compressed) {
+  if (!compressed && length > IMAGE_SIZE) {
+    Serial.println("Image too large");
+    return nullptr;
+  }
+  // Only empty while the previous picture is still queued, which a render
+  // frame clears.
+  uint16_t* frame = display_manager->claimIngestImage();
+  unsigned long wait_start = millis();
+  while (frame == nullptr) {
+    if (millis() - wait_start >= DISPLAY_QUEUE_FULL_WAIT_MS) {
+      display_commands_dropped++;
+      Serial.println("image dropped, previous one not yet landed");
+      return nullptr;
+    }
+    delay(1);
+    frame = display_manager->claimIngestImage();
+  }
+
+  if (compressed) {
+    if (!decodeImagePayload(data, length, frame, PIXEL_COUNT)) {
+      Serial.println("Malformed compressed image");
+      display_manager->releaseIngestImage(frame);
+      return nullptr;
+    }
+  } else {
+    memcpy(frame, data, length);
+  }
+  return frame;
+}
+
+// loop()'s side: queues a filled frame to land, or gives it back.
+bool postIngestImage(uint16_t* frame) {
+  DisplayCommand command = {};
+  command.type = DISPLAY_CMD_IMAGE;
+  command.frame = frame;
+  if (!enqueueDisplayCommand(command)) {
+    display_manager->releaseIngestImage(frame);
+    return false;
+  }
+  return true;
+}
+
+void renderTask(void* /*parameter*/) {
+  TickType_t last_wake = xTaskGetTickCount();
+  for (;;) {
+    // Taken, not read: a stop that gave up takes it back the same way, so
+    // exactly one side has it.
+    TaskHandle_t waiter = render_stop_waiter.exchange(nullptr);
+    if (waiter != nullptr) {
+      xTaskNotifyGive(waiter);
+      vTaskSuspend(nullptr);
+    }
+
+    unsigned long frame_start = micros();
+    DisplayCommand command;
+    while (display_commands.pop(&command)) {
+      applyDisplayCommand(command);
+      // The rest of a batch is being pushed right now; loop() made room for
+      // all of it before it pushed the first.
+      while (command.more) {
+        if (display_commands.pop(&command)) {
+          applyDisplayCommand(command);
+        } else {
+          vTaskDelay(1);
+        }
+      }
+    }
+    unsigned long current_time = millis();
+    display_manager->animate(current_time);
+    display_manager->updateDisplay(current_time);
+    unsigned long frame_us = micros() - frame_start;
+
+    portENTER_CRITICAL(&render_timing_mux);
+    render_timing.frame_us += frame_us;
+    if (frame_us > render_timing.frame_max_us) {
+      render_timing.frame_max_us = frame_us;
+    }
+    render_timing.frames++;
+    portEXIT_CRITICAL(&render_timing_mux);
+
+    // Paced from the last wake, not from now, so the frame's own work does not
+    // stretch the period.
+    vTaskDelayUntil(&last_wake, pdMS_TO_TICKS(RENDER_FRAME_MS));
+  }
+}
+
+bool startRenderTask() {
+  BaseType_t task_created = xTaskCreatePinnedToCore(
+    renderTask,
+    "render",
+    RENDER_TASK_STACK,
+    nullptr,
+    RENDER_TASK_PRIORITY,
+    &render_task_handle,
+    RENDER_TASK_CORE
+  );
+  if (task_created != pdPASS) {
+    render_task_handle = nullptr;
+    Serial.println(F("ERROR: failed to create render task"));
+    return false;
+  }
+  return true;
+}
+
+// Hands the panel back to the caller, for the paths that tear it down. The
+// task parks between frames -- never halfway through a flip -- and is deleted
+// there. Whatever is still queued is discarded: nothing that follows a stop is
+// going to show it.
+// True once the task has parked and is gone, and the panel is the caller's.
+// False if it did not park in time: it is then inside a frame, possibly
+// partway through a flip with DMA in flight, so -- as with stopNetworkTask()
+// -- it is left to finish and park rather than deleted, its queue is left to
+// it, and the caller must not tear the panel down under it.
+bool stopRenderTask() {
+  if (render_task_handle == nullptr) {
+    return true;
+  }
+  // A network task that parked after its own stop gave up notifies late;
+  // that must not read as this task parking.
+  ulTaskNotifyTake(pdTRUE, 0);
+  render_stop_waiter.store(xTaskGetCurrentTaskHandle());
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(RENDER_STOP_TIMEOUT_MS)) == 0) {
+    // Disarmed, so it carries on rendering rather than parking unseen --
+    // unless it took the request in the meantime, and is parking now.
+    if (render_stop_waiter.exchange(nullptr) != nullptr) {
+      Serial.println(F("WARNING: render task did not park"));
+      return false;
+    }
+    ulTaskNotifyTake(pdTRUE, portMAX_DELAY);
+  }
+  vTaskDelete(render_task_handle);
+  render_task_handle = nullptr;
+
+  // power_test keeps the cube running afterwards, so a picture caught in the
+  // queue has to give its frame back or no image would ever land again.
+  DisplayCommand command;
+  while (display_commands.pop(&command)) {
+    if (command.type == DISPLAY_CMD_IMAGE) {
+      display_manager->releaseIngestImage(command.frame);
+    }
+  }
+  return true;
+}
+
+// Builds the panel and hands it straight to the render task, so the status
+// lines setup() posts from here on are composited a frame at a time instead of
+// each being painted and flipped on its own. Without the task they are only
+// drawn once loop() starts rendering inline.
+void startDisplay(const String& cube_id) {
+  display_manager = new DisplayManager(cube_id);
+  if (!startRenderTask()) {
+    postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, "render task err");
+  }
+  postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, GIT_TIMESTAMP);
+}
+
+// ============= Network Task =============
+// Once setup() starts it, the network task owns the WiFi/MQTT/UDP stack:
+// serviceWiFiConnection(), mqtt_client.loop() and the UDP socket. Nothing else
+// touches them. What arrives -- MQTT messages, the session coming up, UDP
+// requests -- is handed to loop() on net_inbound and handled there, exactly as
+// the callbacks used to be; what the application sends goes back on
+// net_outbound and udp_outbound. Each ring has one producer and one consumer,
+// so neither side ever waits on the other's work.
+//
+// Pinned to core 0, below the render task: the WiFi and lwIP tasks already
+// live there, and loop() on ARDUINO_RUNNING_CORE keeps the hall poll and the
+// NFC results. A broker reconnect blocking for its timeout, or a socket write
+// stalling on a weak link, now costs the network task and no longer a loop()
+// pass.
+//
+// Before it starts -- all of setup(), including the wake check-in -- and after
+// stopNetworkTask(), the same calls go straight to the client on the caller,
+// the way display commands do without the render task.
+#define NET_TASK_CORE 0
+#define NET_TASK_PRIORITY 1
+#define NET_TASK_STACK 8192
+#define NET_TASK_PERIOD_MS 2
+// The task only parks between passes, and one pass can block in two connects
+// back to back -- ending a lingering session, then the client's own -- each a
+// TCP connect of up to WIFI_CLIENT_CONNECT_TIMEOUT_MS plus a CONNACK wait of
+// up to MQTT_SOCKET_TIMEOUT_S. Twice that, with margin.
+#define WIFI_CLIENT_CONNECT_TIMEOUT_MS 3000
+#define NET_STOP_TIMEOUT_MS \
+  (2 * (WIFI_CLIENT_CONNECT_TIMEOUT_MS + MQTT_SOCKET_TIMEOUT_S * 1000) + 2000)
+#define NET_INBOUND_LENGTH 16
+#define NET_OUTBOUND_LENGTH 32
+#define NET_UDP_OUTBOUND_LENGTH 8
+// MQTT requests sent per network pass.
+#define NET_OUTBOUND_BUDGET 8
+// As with display commands, waiting briefly for room beats dropping a /letter.
+#define NET_QUEUE_FULL_WAIT_MS 100
+
+typedef void (*MessageHandler)(const String& message);
+typedef void (*TopicMessageHandler)(const String& topic, const String& message);
+// Asked where the MQTT client runs before a topic_handler message is copied
+// to loop(): false when loop() is not to have it, because nothing there wants
+// it or it has been dealt with on the spot. It must not touch loop()'s state.
+typedef bool (*TopicFilter)(const String& topic, const String& message);
+
+void handleConnectionEstablished();
+void handleClientImage(const String& topic, uint16_t* frame, const String& missing);
+void handleUdpRequest(const String& request, const IPAddress& remote_ip, uint16_t remote_port);
+void networkPass();
+bool stopNetworkTask();
+
+enum NetInboundType : uint8_t {
+  NET_IN_MESSAGE,    // For handler, or for topic_handler with the topic.
+  NET_IN_CONNECTED,  // The MQTT session came up.
+  NET_IN_UDP,        // payload is the request text.
+  NET_IN_IMAGE,      // A cube/N/ payload consumed on the client's side; topic,
+                     // frame, and payload names a sprite /show did not find.
+};
+
+struct NetInbound {
+  NetInboundType type;
+  MessageHandler handler;
+  TopicMessageHandler topic_handler;
+  String topic;
+  String payload;
+  IPAddress remote_ip;
+  uint16_t remote_port;
+  uint16_t* frame;  // NET_IN_IMAGE: filled by fillIngestImage(), or null.
+};
+
+enum NetOutboundType : uint8_t {
+  NET_OUT_PUBLISH,
+  NET_OUT_SUBSCRIBE,
+};
+
+struct NetOutbound {
+  NetOutboundType type;
+  bool retain;
+  uint32_t session;  // Subscribes: the connect they were made for.
+  MessageHandler handler;
+  TopicMessageHandler topic_handler;
+  TopicFilter topic_filter;  // Subscribes with a topic_handler; null takes all.
+  String topic;
+  String payload;
+};
+
+// Sent from the UDP_PORT socket, so a reply comes from the port the request
+// went to.
+struct UdpOutbound {
+  IPAddress remote_ip;
+  uint16_t remote_port;
+  String text;
+};
+
+// net_inbound: the network task produces, loop() consumes. The other two run
+// the opposite way.
+static SpscRing<NetInbound, NET_INBOUND_LENGTH> net_inbound;
+static SpscRing<NetOutbound, NET_OUTBOUND_LENGTH> net_outbound;
+static SpscRing<UdpOutbound, NET_UDP_OUTBOUND_LENGTH> udp_outbound;
+TaskHandle_t net_task_handle = nullptr;
+// Set before the task is created, so its first pass already hands off: the
+// handle is not written until xTaskCreatePinnedToCore() returns.
+static std::atomic<bool> net_task_active{false};
+static std::atomic<TaskHandle_t> net_stop_waiter{nullptr};
+// The client's own isConnected() belongs to the network task; this is its
+// answer as of the last pass.
+static std::atomic<bool> net_mqtt_connected{false};
+// millis() when the network task last saw the session drop, for the outage
+// time handleConnectionEstablished() reports; 0 until the first drop.
+static std::atomic<unsigned long> net_session_lost_at{0};
+static std::atomic<int> net_dropped{0};
+// Connects the client has made, and subscribes that never reached a session.
+// A subscribe queued for one connect is not sent on the next: the broker may
+// have started that one afresh, and it is walked from scratch if so.
+static std::atomic<uint32_t> net_sessions{0};
+static std::atomic<int> net_subscribes_lost{0};
+// loop()'s side: the connect it last handled, which its subscribes belong to.
+static uint32_t subscribe_session = 0;
+
+// Idle rest, for idle_governor above. loop() waits on a semaphore rather than
+// a task notification, which stopNetworkTask() already waits on.
+// loop_wake_at_us is when the first event of a wait arrived, for its latency.
+static SemaphoreHandle_t loop_wake = nullptr;
+static std::atomic<unsigned long> loop_wake_at_us{0};
+// Set by loop(), applied by the network task, which owns the radio. A ping is
+// answered there without waking loop(), so it leaves a dozing radio dozing:
+// pinging a quiet cube measures what the doze costs.
+static std::atomic<bool> net_radio_doze{false};
+static bool wifi_radio_dozing = false;
+
+// Start of the diag report's window for idle_pct.
+static unsigned long idle_window_start_us = 0;
+
+static void wakeLoop() {
+  if (loop_wake == nullptr) {
+    return;
+  }
+  unsigned long none = 0;
+  loop_wake_at_us.compare_exchange_strong(none, micros());
+  xSemaphoreGive(loop_wake);
+}
+
+// Written by the network task and read and reset by the diag handler, hence
+// the lock.
+struct NetTiming {
+  unsigned long mqtt_us;
+  unsigned long udp_us;
+  int passes;
+};
+static NetTiming net_timing = {0, 0, 0};
+static portMUX_TYPE net_timing_mux = portMUX_INITIALIZER_UNLOCKED;
+
+static void dispatchNetInbound(const NetInbound& item) {
+  idle_governor.noteActivity(millis());
+  switch (item.type) {
+    case NET_IN_MESSAGE:
+      if (item.topic_handler != nullptr) {
+        item.topic_handler(item.topic, item.payload);
+      } else {
+        item.handler(item.payload);
+      }
+      break;
+    case NET_IN_CONNECTED:
+      handleConnectionEstablished();
+      break;
+    case NET_IN_UDP:
+      handleUdpRequest(item.payload, item.remote_ip, item.remote_port);
+      break;
+    case NET_IN_IMAGE:
+      handleClientImage(item.topic, item.frame, item.payload);
+      break;
+  }
+}
+
+// Network task side. Without the task, the caller is loop() and handles the
+// item on the spot.
+static void deliverNetInbound(NetInbound&& item) {
+  if (!net_task_active) {
+    dispatchNetInbound(item);
+    return;
+  }
+  unsigned long wait_start = millis();
+  while (!net_inbound.push(std::move(item))) {
+    if (millis() - wait_start >= NET_QUEUE_FULL_WAIT_MS) {
+      net_dropped++;
+      Serial.printf("net inbound full, dropped %s\n", item.topic.c_str());
+      if (item.frame != nullptr) {
+        display_manager->releaseIngestImage(item.frame);
+      }
+      return;
+    }
+    vTaskDelay(1);
+  }
+  wakeLoop();
+}
+
+// loop() side.
+static void drainNetInbound() {
+  NetInbound item;
+  for (int i = 0; i < NET_INBOUND_LENGTH && net_inbound.pop(&item); i++) {
+    dispatchNetInbound(item);
+  }
+}
+
+static bool queueNetOutbound(NetOutbound&& item) {
+  unsigned long wait_start = millis();
+  while (!net_outbound.push(std::move(item))) {
+    if (millis() - wait_start >= NET_QUEUE_FULL_WAIT_MS) {
+      net_dropped++;
+      Serial.printf("net outbound full, dropped %s\n", item.topic.c_str());
+      return false;
+    }
+    delay(1);
+  }
+  return true;
+}
+
+// Whether the MQTT session is up, from whichever side is asking.
+bool mqttConnected() {
+  return net_task_active ? net_mqtt_connected.load() : mqtt_client.isConnected();
+}
+
+// With the task running, true once the publish is queued for it: see
+// sendNetOutbound() for what happens to it after that.
+bool netPublish(const String& topic, const String& payload, bool retain = false) {
+  if (!net_task_active) {
+    return mqtt_client.publish(topic, payload, retain);
+  }
+  NetOutbound item = {};
+  item.type = NET_OUT_PUBLISH;
+  item.retain = retain;
+  item.topic = topic;
+  item.payload = payload;
+  return queueNetOutbound(std::move(item));
+}
+
+// Network task side: the client's callback only packs the message up, and the
+// handler runs on loop() -- unless the subscription's TopicFilter takes the
+// payload itself, which a picture's does.
+//
+// QoS 1, so a broker holding the session queues what arrives during a link
+// drop rather than dropping it: a resumed session gets no retained replay.
+// Deep sleep ends the session instead; see endMqttSession().
+static void subscribeNow(const NetOutbound& request) {
+  bool subscribed;
+  if (request.topic_handler != nullptr) {
+    TopicMessageHandler handler = request.topic_handler;
+    TopicFilter filter = request.topic_filter;
+    subscribed = mqtt_client.subscribe(request.topic, [handler, filter](const String& topic, const String& message) {
+      if (filter != nullptr && !filter(topic, message)) {
+        return;
+      }
+      NetInbound item = {};
+      item.type = NET_IN_MESSAGE;
+      item.topic_handler = handler;
+      item.topic = topic;
+      item.payload = message;
+      deliverNetInbound(std::move(item));
+    }, 1);
+  } else {
+    MessageHandler handler = request.handler;
+    subscribed = mqtt_client.subscribe(request.topic, [handler](const String& message) {
+      NetInbound item = {};
+      item.type = NET_IN_MESSAGE;
+      item.handler = handler;
+      item.payload = message;
+      deliverNetInbound(std::move(item));
+    }, 1);
+  }
+  if (!subscribed) {
+    net_subscribes_lost++;
+  }
+}
+
+static void netSubscribe(NetOutbound&& request) {
+  request.type = NET_OUT_SUBSCRIBE;
+  request.session = subscribe_session;
+  if (!net_task_active) {
+    subscribeNow(request);
+    return;
+  }
+  queueNetOutbound(std::move(request));
+}
+
+void netSubscribe(const String& topic, MessageHandler handler) {
+  NetOutbound request = {};
+  request.topic = topic;
+  request.handler = handler;
+  netSubscribe(std::move(request));
+}
+
+void netSubscribe(const String& topic, TopicMessageHandler handler,
+                  TopicFilter filter = nullptr) {
+  NetOutbound request = {};
+  request.topic = topic;
+  request.topic_handler = handler;
+  request.topic_filter = filter;
+  netSubscribe(std::move(request));
+}
+
+// Best effort, as UDP is: a full ring drops the datagram rather than waiting.
+void sendUdp(const IPAddress& ip, uint16_t port, const char* text) {
+  if (!net_task_active) {
+    if (udp.beginPacket(ip, port)) {
+      udp.write((const uint8_t*)text, strlen(text));
+      udp.endPacket();
+    }
+    return;
+  }
+  UdpOutbound item;
+  item.remote_ip = ip;
+  item.remote_port = port;
+  item.text = text;
+  if (!udp_outbound.push(std::move(item))) {
+    net_dropped++;
+  }
+}
+
+// Network task side, or the caller's once the task has stopped. A publish
+// waits at the head while the session is down, so order holds and retained
+// state queued during an outage still lands after it; one the connected
+// client refuses -- too big for its buffer -- is dropped. A subscribe is never
+// held, and one made for an earlier connect is dropped: each connect either
+// resumes a session that already has it or walks the subscriptions afresh
+// from handleConnectionEstablished(). Either way it is counted as lost, so
+// the next connect does not take a session missing it as complete.
+static void sendNetOutbound(int budget) {
+  static NetOutbound held;
+  static bool holding = false;
+  for (int sent = 0; sent < budget; sent++) {
+    if (!holding) {
+      if (!net_outbound.pop(&held)) return;
+      holding = true;
+    }
+    if (held.type == NET_OUT_PUBLISH) {
+      if (!mqtt_client.isConnected()) return;
+      if (!mqtt_client.publish(held.topic, held.payload, held.retain)) {
+        if (!mqtt_client.isConnected()) return;
+        net_dropped++;
+        Serial.printf("publish refused: %s\n", held.topic.c_str());
+      }
+    } else if (mqtt_client.isConnected() && held.session == net_sessions.load()) {
+      subscribeNow(held);
+    } else {
+      net_subscribes_lost++;
+    }
+    holding = false;
+    held = NetOutbound();
+  }
+}
+
+static void sendUdpOutbound() {
+  UdpOutbound item;
+  while (udp_outbound.pop(&item)) {
+    if (udp.beginPacket(item.remote_ip, item.remote_port)) {
+      udp.write((const uint8_t*)item.text.c_str(), item.text.length());
+      udp.endPacket();
+    }
+  }
+}
+
+// Letter interval statistics for the diag report. Taken as each /letter comes
+// off MQTT rather than when the render task applies it, which is quantised to
+// its frame.
+void noteLetterArrival(const String& message) {
+  static unsigned long last_message_time = 0;
+  unsigned long current_time = millis();
+  unsigned long time_since_last = current_time - last_message_time;
+
+  if (time_since_last > 1000) {
+      Serial.println("----------------------------------------");
+      Serial.printf("[%lu] WARNING: %lu ms since last message\n", current_time, time_since_last);
+      Serial.println("----------------------------------------");
+  }
+
+  // Track letter interval statistics
+  if (last_message_time > 0 && time_since_last < 5000) {
+    letter_interval_accum += time_since_last;
+    letter_interval_count++;
+    if (time_since_last > max_letter_interval) {
+      max_letter_interval = time_since_last;
+    }
+  }
+  last_letter_recv_time = current_time;
+
+  last_message_time = current_time;
+
+  Serial.printf("[%lu] MQTT letter '%s' delta=%lu ms\n", current_time, message.c_str(), time_since_last);
+}
+
 
 // Loop timing variables
 unsigned long loop_start_time = 0;
@@ -950,14 +2005,13 @@ bool timing_samples_filled = false;
 unsigned long timing_accumulator = 0;
 
 // Per-section timing diagnostics
+// Rendering, MQTT and UDP are no longer sections of loop(); see RenderTiming
+// and NetTiming.
 struct SectionTiming {
-  unsigned long mqtt_us;
-  unsigned long display_us;
-  unsigned long udp_us;
   unsigned long nfc_us;
   unsigned long total_us;
 };
-SectionTiming section_timing_accum = {0, 0, 0, 0, 0};
+SectionTiming section_timing_accum = {0, 0};
 int section_timing_count = 0;
 
 // Per-section timing diagnostics (forward declarations removed, definitions below)
@@ -1005,7 +2059,7 @@ void setupNfcReader() {
 }
 
 // Set by detectSensorMode() when stage 2 rejects a reader; published from
-// subscribeSlotTopics() once mqtt_topic_cube exists. RTC_DATA_ATTR for the
+// subscribeSlotTopics() once the slot topics exist. RTC_DATA_ATTR for the
 // same reason as cached_sensor_mode below: detectSensorMode() only runs once
 // per power session, so a wake that used plain RAM here would republish an
 // empty report and this diagnostic would go stale until the next power cycle.
@@ -1093,16 +2147,31 @@ uint8_t getCubeIpOctet() {
 }
 
 void startWiFiConnectionAttempt() {
-  Serial.print("Connecting to ");
-  Serial.println(SSID_NAME_PORTABLE);
   WiFi.setSleep(WIFI_PS_NONE);
-  WiFi.begin(SSID_NAME_PORTABLE, WIFI_PASSWORD_PORTABLE);
+  wifi_radio_dozing = false;
+  wifi_attempt_directed = wifiAssociationKnown(wifi_association);
+  if (wifi_attempt_directed) {
+    Serial.printf("Connecting to %s on channel %ld (cached)\n", SSID_NAME_PORTABLE,
+                  (long)wifi_association.channel);
+    WiFi.begin(SSID_NAME_PORTABLE, WIFI_PASSWORD_PORTABLE,
+               wifi_association.channel, wifi_association.bssid);
+  } else {
+    Serial.print("Connecting to ");
+    Serial.println(SSID_NAME_PORTABLE);
+    WiFi.begin(SSID_NAME_PORTABLE, WIFI_PASSWORD_PORTABLE);
+  }
   wifi_connection_attempt_started = millis();
   wifi_connection_attempt_active = true;
 }
 
 void serviceWiFiConnection() {
   if (WiFi.status() == WL_CONNECTED) {
+    if (wifi_connection_attempt_active) {
+      Serial.printf("WiFi associated in %lums (%s)\n",
+                    millis() - wifi_connection_attempt_started,
+                    wifi_attempt_directed ? "cached" : "scan");
+      rememberWifiAssociation(&wifi_association, WiFi.BSSID(), WiFi.channel());
+    }
     wifi_connection_attempt_active = false;
     next_wifi_connection_attempt = 0;
     return;
@@ -1110,6 +2179,14 @@ void serviceWiFiConnection() {
 
   unsigned long now = millis();
   if (wifi_connection_attempt_active) {
+    if (wifi_attempt_directed &&
+        now - wifi_connection_attempt_started >= WIFI_DIRECTED_TIMEOUT_MS) {
+      Serial.println("WiFi: cached AP did not answer, scanning");
+      forgetWifiAssociation(&wifi_association);
+      WiFi.disconnect();
+      startWiFiConnectionAttempt();
+      return;
+    }
     if (now - wifi_connection_attempt_started < WIFI_CONNECT_ATTEMPT_TIMEOUT_MS) {
       return;
     }
@@ -1158,7 +2235,7 @@ void handlePingCommand(const String& message) {
     return;
   }
   debugPrintln("pinging due to /ping");
-  mqtt_client.publish(mqtt_topic_echo, message);
+  netPublish(topics.get(TOPIC_ECHO), message);
 }
 
 void handleRebootCommand(const String& message) {
@@ -1184,12 +2261,187 @@ void handleResetCommand(const String& message) {
   }
 }
 
+// Belongs to whichever side runs the MQTT client, as /sprite and /show are
+// both consumed there (CUBE_PAYLOAD_ROUTES): the payload is never copied to
+// loop(), and the store is never read and written from two tasks.
+static SpriteStore sprite_store;
+
+// cube/N/sprite: one byte of sprite id, then an /imagez payload. Checked now
+// rather than when it is shown, so a bad upload is reported against the
+// message that carried it. The id alone deletes the sprite.
+static uint16_t* consumeSprite(const String& /*topic*/, const String& message,
+                               String& /*missing*/) {
+  if (message.length() == 0) {
+    return nullptr;
+  }
+  const uint8_t* bytes = reinterpret_cast<const uint8_t*>(message.c_str());
+  const int id = bytes[0];
+  if (message.length() == 1) {
+    sprite_store.remove(id);
+    Serial.printf("sprite %d deleted\n", id);
+    return nullptr;
+  }
+  if (!imagePayloadIsValid(bytes + 1, message.length() - 1, PIXEL_COUNT)) {
+    sprite_store.remove(id);
+    Serial.printf("sprite %d malformed, not stored\n", id);
+    return nullptr;
+  }
+  if (!sprite_store.put(id, bytes + 1, message.length() - 1)) {
+    Serial.printf("sprite %d not stored: %d bytes, %d of %d in use\n", id,
+                  message.length() - 1, sprite_store.bytesUsed(), SPRITE_ARENA_BYTES);
+    return nullptr;
+  }
+  Serial.printf("sprite %d stored, %d bytes\n", id, message.length() - 1);
+  return nullptr;
+}
+
+// cube/N/show: a sprite id, in decimal. Lands exactly as an /imagez would. A
+// sprite this cube does not hold -- it rebooted, or the upload did not fit --
+// is reported on cube/N/sprite_missing so the server can send it again. That
+// goes back to loop() as the id in the payload, as the topics and net_outbound
+// are both loop()'s.
+static uint16_t* consumeShow(const String& /*topic*/, const String& message,
+                             String& missing) {
+  int id;
+  if (!parseSpriteId(message.c_str(), &id)) {
+    Serial.printf("show: not a sprite id: %s\n", message.c_str());
+    return nullptr;
+  }
+  const uint8_t* data;
+  size_t length;
+  if (!sprite_store.get(id, &data, &length)) {
+    Serial.printf("sprite %d not held\n", id);
+    missing = String(id);
+    return nullptr;
+  }
+  return fillIngestImage(data, length, true);
+}
+
+// Indexed by CommandFrameType - 1.
+static const DisplayCommandType COMMAND_FRAME_TYPES[] = {
+  DISPLAY_CMD_LETTER,
+  DISPLAY_CMD_BORDER,
+  DISPLAY_CMD_LOCK,
+  DISPLAY_CMD_FLASH,
+  DISPLAY_CMD_RISE_MS,
+  DISPLAY_CMD_STRING,
+  DISPLAY_CMD_FONT_SIZE,
+  DISPLAY_CMD_BORDER_FRAME,
+  DISPLAY_CMD_BORDER_TOP_BANNER,
+  DISPLAY_CMD_BORDER_BOTTOM_BANNER,
+  DISPLAY_CMD_BORDER_VLINE_LEFT,
+  DISPLAY_CMD_BORDER_VLINE_RIGHT,
+  DISPLAY_CMD_BORDER_VLINE_HEIGHT,
+  DISPLAY_CMD_BRIGHTNESS,
+};
+static_assert(sizeof(COMMAND_FRAME_TYPES) / sizeof(COMMAND_FRAME_TYPES[0]) == CMD_FRAME_TYPE_LAST,
+              "every CommandFrameType needs a display command");
+
+// A batch of display commands, framed as in command_frame.h, that lands in a
+// single display frame.
+void applyCommandFrame(const uint8_t* data, size_t length) {
+  CommandRecord records[CMD_FRAME_MAX_RECORDS];
+  const int count = parseCommandFrame(data, length, records, CMD_FRAME_MAX_RECORDS,
+                                      DISPLAY_COMMAND_TEXT_MAX - 1);
+  if (count < 0) {
+    Serial.println("Malformed command frame");
+    return;
+  }
+  // Static: loop() is the only caller, and this is over a kilobyte.
+  static DisplayCommand batch[CMD_FRAME_MAX_RECORDS];
+  for (int i = 0; i < count; i++) {
+    batch[i] = {};
+    batch[i].type = COMMAND_FRAME_TYPES[records[i].type - 1];
+    memcpy(batch[i].text, records[i].value, records[i].length);
+    batch[i].text[records[i].length] = '\0';
+    if (batch[i].type == DISPLAY_CMD_LETTER) {
+      noteLetterArrival(String(batch[i].text));
+    }
+  }
+  enqueueDisplayBatch(batch, count);
+}
+
+// cube/N/cmd.
+void handleCommandFrame(const String& message) {
+  applyCommandFrame(reinterpret_cast<const uint8_t*>(message.c_str()), message.length());
+}
+
+// The same frame over UDP; see udp_command.h. Counts as activity here, as its
+// MQTT route does in the table.
+static UdpSequenceFilter udp_command_sequence;
+static int udp_commands_applied = 0;
+static int udp_commands_dropped = 0;
+
+void handleUdpCommand(const String& datagram) {
+  const uint8_t* data = reinterpret_cast<const uint8_t*>(datagram.c_str());
+  UdpCommandHeader header;
+  if (!parseUdpCommandHeader(data, datagram.length(), &header) ||
+      !slotIsResolved() || header.slot != applied_slot ||
+      !udp_command_sequence.accept(header.epoch, header.sequence, millis())) {
+    udp_commands_dropped++;
+    return;
+  }
+  udp_commands_applied++;
+  last_activity_time = millis();
+  applyCommandFrame(data + UDP_COMMAND_HEADER_BYTES,
+                    datagram.length() - UDP_COMMAND_HEADER_BYTES);
+}
+
+// Always followed by enterSleepMode(), which sends what is still queued before
+// it disconnects.
 void publishAutoSleepFlag() {
-  mqtt_client.publish("cube/device/" + mac_nocolons + "/auto_sleep", "1", true);
-  if (!mqtt_topic_cube.isEmpty()) {
-    mqtt_client.publish(mqtt_topic_cube + "/auto_sleep", "1", true);
+  netPublish(topics.get(TOPIC_DEVICE_AUTO_SLEEP), "1", true);
+  if (topics.has(TOPIC_CUBE)) {
+    netPublish(topics.get(TOPIC_AUTO_SLEEP), "1", true);
+  }
+}
+
+// Set once the main client has had a session, cleared once one has been ended;
+// see endPersistentSession() in mqtt_session.h. In RTC memory so that a sleep
+// whose teardown failed is ended on the next wake, before the client connects.
+RTC_DATA_ATTR static bool mqtt_session_lingering = false;
+
+class PubSubSessionEndPorts : public SessionEndPorts {
+ public:
+  PubSubSessionEndPorts() : clean_(tcp_) {
+    clean_.setServer(MQTT_SERVER_PI, MQTT_PORT);
+    clean_.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  }
+
+  void disconnectSession() override {
+    if (mqtt_client.isConnected()) {
+      mqtt_client.disconnect();
+      delay(100);
+    }
+  }
+
+  // The main client's ID, without its last will.
+  bool connectClean() override {
+    const String client_id = makeMqttClientId(WiFi.macAddress(), "");
+    return clean_.connect(client_id.c_str(), nullptr, nullptr, nullptr, 0, false, nullptr, true);
+  }
+
+  void disconnectClean() override {
+    clean_.disconnect();
+    delay(100);
+  }
+
+ private:
+  WiFiClient tcp_;
+  PubSubClient clean_;
+};
+
+// On the network task before this boot's first connect, or on the sleep path
+// once the task has stopped: the main client is the caller's either way. The
+// caller reports the result, as only the sleep path may use debugSend(): on
+// the network task it would be a second producer on udp_outbound.
+static bool endMqttSession() {
+  PubSubSessionEndPorts ports;
+  if (!endPersistentSession(ports)) {
+    return false;
   }
-  delay(100);  // Give MQTT time to flush before sleep
+  mqtt_session_lingering = false;
+  return true;
 }
 
 void enterSleepMode() {
@@ -1197,17 +2449,27 @@ void enterSleepMode() {
   // display_manager is null on a timer-wake check-in that never powered the
   // panel — skip the "sleep..." paint and its 2s dwell so that pulse stays cheap.
   if (display_manager != nullptr) {
-    display_manager->displayDebugMessage("sleep...");
+    postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, "sleep...");
     delay(2000);
   }
 
-  if (mqtt_client.isConnected()) {
+  // From here the client is this task's, and everything below talks to it
+  // directly -- unless the network task would not park, in which case it is
+  // still inside the client and the cube sleeps without the goodbyes.
+  const bool client_ours = stopNetworkTask();
+
+  if (client_ours && mqtt_client.isConnected()) {
+    // Whatever is still queued goes out before the cube says it is leaving:
+    // requests already handed to the network task first, as they are older.
+    sendNetOutbound(NET_OUTBOUND_LENGTH + 1);
+    flushPublishQueue(PUBLISH_QUEUE_SLOTS);
     publishPresence("sleeping");
     // Settle before tearing the connection down. Deliberately no loop() here:
-    // enterSleepMode() is reachable from the sleep_now subscribe callback, so
-    // pumping the client would re-enter PubSubClient::loop() while it is still
-    // dispatching -- and it would buy nothing, since publish() writes straight
-    // to the socket rather than queueing.
+    // without the network task, enterSleepMode() is reachable from inside the
+    // sleep_now subscribe callback, so pumping the client would re-enter
+    // PubSubClient::loop() while it is still dispatching -- and it would buy
+    // nothing, since publish() writes straight to the socket rather than
+    // queueing.
     delay(100);
     mqtt_client.disconnect();
     // PubSubClient::disconnect() writes the DISCONNECT packet and immediately
@@ -1219,18 +2481,33 @@ void enterSleepMode() {
     // broker logged "has exceeded timeout, disconnecting" at 02:21:32.
     delay(100);
   }
+  // The session would otherwise outlive the disconnect, with the broker
+  // queueing for it through the whole sleep. Also on a check-in re-sleep, for
+  // a session an earlier teardown could not end.
+  if (client_ours && mqtt_session_lingering && WiFi.status() == WL_CONNECTED) {
+    debugSend(endMqttSession() ? "MQTT session ended" : "MQTT session end failed");
+  }
 
 #ifdef BOARD_V6
   // Stop DMA and tri-state HUB75 pins to prevent backfeed through panel clamping diodes.
   // Hold all GPIO states through deep sleep so tri-stated pins don't float on power-down.
   // On a check-in re-sleep the panel was never powered and DMA never started, so there
   // is nothing to tear down — the pads are already Hi-Z after gpio_deep_sleep_hold_dis().
+  // A render task that did not park keeps the panel: stopping DMA under a flip
+  // is worse than the backfeed, and the deep sleep below halts both anyway.
   if (display_manager != nullptr) {
-    display_manager->shutdownForSleep();
+    if (stopRenderTask()) {
+      display_manager->shutdownForSleep();
+    } else {
+      Serial.println("Panel left running, render task busy");
+    }
   }
   digitalWrite(POWER_SWITCH_PIN, LOW);
   gpio_hold_en(POWER_SWITCH_PIN);
   gpio_deep_sleep_hold_en();
+  if (armHallDockWatch()) {
+    Serial.println("Will also wake on a neighbour docking or leaving");
+  }
 #endif
 
   // Read current pin state and store it in RTC memory
@@ -1250,44 +2527,61 @@ void enterSleepMode() {
   rtc_gpio_pullup_en(SLEEP_PIN);
 
   // Enable timer wake-up using configurable interval
-  esp_sleep_enable_timer_wakeup((uint64_t)sleep_interval_s * uS_TO_S_FACTOR);
+  esp_sleep_enable_timer_wakeup((uint64_t)keepalive_interval_s * uS_TO_S_FACTOR);
 
   sleep_start_time = millis();
 
   // Send debug via UDP
   char dbg[64];
-  snprintf(dbg, sizeof(dbg), "sleeping for %lu seconds", sleep_interval_s);
+  snprintf(dbg, sizeof(dbg), "sleeping for %lu seconds", (unsigned long)keepalive_interval_s);
   debugSend(dbg);
-  Serial.printf("Will wake on Pin 0 release or every %lu seconds...\n", sleep_interval_s);
+  Serial.printf("Will wake on Pin 0 release or in %lu seconds...\n",
+                (unsigned long)keepalive_interval_s);
+  markWake(WAKE_PHASE_SLEEP);
   Serial.flush();
   
   esp_deep_sleep_start();
 }
 
+void adaptKeepAliveInterval(KeepAliveOutcome outcome) {
+  const KeepAliveLimits limits = {sleep_interval_s, keepalive_ceiling_s,
+                                  KEEPALIVE_POWER_BANK_MAX_S};
+  keepalive_interval_s = nextKeepAliveInterval(keepalive_interval_s, outcome, limits);
+}
+
 class KeepAliveCheckInPorts : public WakeCheckInPorts {
  public:
   KeepAliveCheckInPorts() : mqtt_(tcp_) {
+    // The slot topic is the stored slot's, which is not the registry's: no slot
+    // is applied on a check-in.
     StoredSlot stored = loadStoredSlot();
-    device_topic_ = "cube/device/" + mac_nocolons + "/auto_sleep";
-    slot_topic_ = stored.slot > 0
-        ? "cube/" + String(stored.slot) + "/auto_sleep"
-        : String("");
-    status_topic_ = "cube/device/" + mac_nocolons + "/status";
+    stored_slot_ = stored.slot;
+    slot_topic_[0] = '\0';
+    if (stored.slot > 0) {
+      snprintf(slot_topic_, sizeof(slot_topic_), TOPIC_FORMATS[TOPIC_AUTO_SLEEP],
+               String(stored.slot).c_str());
+    }
     mqtt_.setServer(MQTT_SERVER_PI, MQTT_PORT);
     mqtt_.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
   }
 
   // setupWiFiConnection() fired a non-blocking WiFi.begin(); WiFi may not be
   // associated yet, so give it until KEEPALIVE_WIFI_TIMEOUT_MS before treating
-  // the check-in as a network failure.
+  // the check-in as a network failure. Serviced meanwhile, so a directed
+  // connect that misses falls back to a scan, and a success is cached.
   bool awaitWifi() override {
     unsigned long wifi_wait_start = millis();
     while (WiFi.status() != WL_CONNECTED &&
            millis() - wifi_wait_start < KEEPALIVE_WIFI_TIMEOUT_MS) {
+      serviceWiFiConnection();
       delay(10);
     }
+    serviceWiFiConnection();
+    markWake(WAKE_PHASE_WIFI);
+    if (wifi_attempt_directed) noteWakeFlag(WAKE_FLAG_CACHED_WIFI);
     char dbg[64];
-    snprintf(dbg, sizeof(dbg), "wifi assoc %lums", millis() - wifi_wait_start);
+    snprintf(dbg, sizeof(dbg), "wifi assoc %lums %s", millis() - wifi_wait_start,
+             wifi_attempt_directed ? "cached" : "scan");
     // Also to serial: a failed association is the case KEEPALIVE_WIFI_TIMEOUT_MS
     // has to be validated against, and it is the case UDP cannot report.
     debugSend(dbg);
@@ -1302,7 +2596,9 @@ class KeepAliveCheckInPorts : public WakeCheckInPorts {
 
   bool connectMqtt() override {
     String client_id = makeMqttClientId(WiFi.macAddress(), "-ka");
-    if (!mqtt_.connect(client_id.c_str())) {
+    const bool connected = mqtt_.connect(client_id.c_str());
+    markWake(WAKE_PHASE_MQTT);
+    if (!connected) {
       debugSend("mqtt fail");
       return false;
     }
@@ -1310,7 +2606,7 @@ class KeepAliveCheckInPorts : public WakeCheckInPorts {
     return true;
   }
 
-  bool hasSlotTopic() override { return !slot_topic_.isEmpty(); }
+  bool hasSlotTopic() override { return slot_topic_[0] != '\0'; }
 
   // An empty retained topic delivers nothing at all, so elapsed time cannot
   // tell "no flag is set" from "the flag has not arrived yet". The keep-alive
@@ -1328,21 +2624,21 @@ class KeepAliveCheckInPorts : public WakeCheckInPorts {
     // publishing inside the callback overwrites the payload bytes.
     mqtt_.setCallback([this](char* topic, byte* payload, unsigned int length) {
       bool requested = length == 1 && payload[0] == '1';
-      if (device_topic_ == topic) {
+      if (strcmp(topics.get(TOPIC_DEVICE_AUTO_SLEEP), topic) == 0) {
         flags_.device_requests_sleep = requested;
-      } else if (slot_topic_ == topic) {
+      } else if (strcmp(slot_topic_, topic) == 0) {
         flags_.slot_requests_sleep = requested;
-      } else if (status_topic_ == topic) {
+      } else if (strcmp(topics.get(TOPIC_DEVICE_STATUS), topic) == 0) {
         marker_seen_ = true;
       }
     });
 
-    mqtt_.subscribe(status_topic_.c_str());
-    mqtt_.subscribe(device_topic_.c_str());
+    mqtt_.subscribe(topics.get(TOPIC_DEVICE_STATUS));
+    mqtt_.subscribe(topics.get(TOPIC_DEVICE_AUTO_SLEEP));
     if (hasSlotTopic()) {
-      mqtt_.subscribe(slot_topic_.c_str());
+      mqtt_.subscribe(slot_topic_);
     }
-    mqtt_.publish(status_topic_.c_str(), "keep-alive");
+    mqtt_.publish(topics.get(TOPIC_DEVICE_STATUS), "keep-alive");
 
     unsigned long check_start = millis();
     while (true) {
@@ -1356,6 +2652,8 @@ class KeepAliveCheckInPorts : public WakeCheckInPorts {
       if (elapsed >= KEEPALIVE_FLAG_READ_TIMEOUT_MS) break;
     }
 
+    markWake(WAKE_PHASE_FLAGS);
+    if (marker_seen_) noteWakeFlag(WAKE_FLAG_CONFIRMED);
     char dbg[64];
     snprintf(dbg, sizeof(dbg), "flags device=%d slot=%d confirmed=%d",
              flags_.device_requests_sleep, flags_.slot_requests_sleep,
@@ -1366,36 +2664,133 @@ class KeepAliveCheckInPorts : public WakeCheckInPorts {
   }
 
   void clearSleepFlags() override {
-    mqtt_.publish(device_topic_.c_str(), "", true);
+    mqtt_.publish(topics.get(TOPIC_DEVICE_AUTO_SLEEP), "", true);
     if (hasSlotTopic()) {
-      mqtt_.publish(slot_topic_.c_str(), "", true);
+      mqtt_.publish(slot_topic_, "", true);
     }
     delay(100);
     mqtt_.disconnect();
   }
 
   void enterSleep() override {
+    // Only a confirmed flag backs off: a check-in that never got an answer
+    // says nothing about how long the cube will stay on the shelf.
+    adaptKeepAliveInterval(marker_seen_ ? KEEPALIVE_CONFIRMED_ASLEEP : KEEPALIVE_UNCONFIRMED);
     mqtt_.disconnect();
     debugSend("sleep again");
     enterSleepMode();
   }
 
   void stayAwake() override {
+    noteWakeFlag(WAKE_FLAG_WOKE);
+    adaptKeepAliveInterval(KEEPALIVE_WOKE);
     last_activity_time = millis();
     debugSend("WAKE FULL - staying awake");
     Serial.println("Waking fully - continuing setup");
   }
 
- private:
+ protected:
   WiFiClient tcp_;
   PubSubClient mqtt_;
-  String device_topic_;
-  String slot_topic_;
-  String status_topic_;
+  int stored_slot_;
+  char slot_topic_[32];
   bool marker_seen_ = false;
   SleepFlags flags_ = {false, false};
 };
 
+RTC_DATA_ATTR static uint8_t checkin_datagram_skip = 0;
+
+// The check-in over one datagram to the responder, with the MQTT check-in
+// above as the fallback whenever the responder does not answer: a missing
+// responder then costs the exchange's wait, not the cube's reachability.
+class DatagramCheckInPorts : public KeepAliveCheckInPorts {
+ public:
+  // Nothing to connect: the datagram needs no session, and the fallback
+  // connects for itself.
+  bool connectMqtt() override { return true; }
+
+  bool readSleepFlags(SleepFlags* out) override {
+#if KEEPALIVE_POWER_BANK_MAX_S != 0
+    const unsigned long check_start = millis();
+#endif
+    if (exchange(out)) {
+      marker_seen_ = true;
+      // The exchange is the confirmation; the dwell below is not check-in time.
+      markWake(WAKE_PHASE_FLAGS);
+      noteWakeFlag(WAKE_FLAG_DATAGRAM | WAKE_FLAG_CONFIRMED);
+#if KEEPALIVE_POWER_BANK_MAX_S != 0
+      // The round trip ends well inside the window, but the window is also
+      // the bank's current-pulse dwell; see KEEPALIVE_CHECKIN_WINDOW_MS.
+      while (millis() - check_start < KEEPALIVE_CHECKIN_WINDOW_MS) {
+        delay(10);
+      }
+#endif
+      char dbg[64];
+      snprintf(dbg, sizeof(dbg), "flags device=%d slot=%d via datagram",
+               out->device_requests_sleep, out->slot_requests_sleep);
+      debugSend(dbg);
+      return true;
+    }
+    debugSend("no check-in responder, using MQTT");
+    checkin_datagram_skip = CHECKIN_DATAGRAM_SKIP_WAKES;
+    fallback_ = true;
+    return KeepAliveCheckInPorts::connectMqtt() &&
+           KeepAliveCheckInPorts::readSleepFlags(out);
+  }
+
+  void clearSleepFlags() override {
+    if (fallback_) {
+      KeepAliveCheckInPorts::clearSleepFlags();
+      return;
+    }
+    // No session to clear them over; the one the full wake brings up sends
+    // these as soon as it connects.
+    queuePublish(topics.get(TOPIC_DEVICE_AUTO_SLEEP), "");
+    if (hasSlotTopic()) {
+      queuePublish(slot_topic_, "");
+    }
+  }
+
+ private:
+  bool exchange(SleepFlags* out) {
+    uint8_t request[CHECKIN_REQUEST_BYTES];
+    const uint32_t nonce = esp_random();
+    const uint8_t slot = stored_slot_ > 0 && stored_slot_ <= 255 ? stored_slot_ : 0;
+    if (buildCheckInRequest(request, nonce, slot, mac_nocolons.c_str()) == 0) {
+      return false;
+    }
+    IPAddress responder;
+    responder.fromString(MQTT_SERVER_PI);
+    WiFiUDP socket;
+    socket.begin(CHECKIN_RESPONDER_PORT);
+    bool answered = false;
+    for (int attempt = 0; attempt < CHECKIN_DATAGRAM_ATTEMPTS && !answered; attempt++) {
+      if (socket.beginPacket(responder, CHECKIN_RESPONDER_PORT)) {
+        socket.write(request, sizeof(request));
+        socket.endPacket();
+      }
+      const unsigned long sent_at = millis();
+      while (!answered && millis() - sent_at < CHECKIN_DATAGRAM_WAIT_MS) {
+        uint8_t response[CHECKIN_RESPONSE_BYTES + 1];
+        const int length = socket.parsePacket();
+        if (length > 0) {
+          const int read = socket.read(response, sizeof(response));
+          answered = read > 0 &&
+                     parseCheckInResponse(response, (size_t)read, nonce,
+                                          &out->device_requests_sleep,
+                                          &out->slot_requests_sleep);
+        } else {
+          delay(5);
+        }
+      }
+    }
+    socket.stop();
+    return answered;
+  }
+
+  bool fallback_ = false;
+};
+
 void handleWakeUp() {
   esp_sleep_wakeup_cause_t wakeup_reason = esp_sleep_get_wakeup_cause();
 
@@ -1406,11 +2801,22 @@ void handleWakeUp() {
   } else if (wakeup_reason == ESP_SLEEP_WAKEUP_EXT0) {
     reason = WAKE_REASON_BUTTON;
     debugPrintln("Woken by external signal (Pin 0 released)");
+  } else if (wakeup_reason == ESP_SLEEP_WAKEUP_ULP) {
+    reason = WAKE_REASON_DOCK;
+    debugSend("dock wake");
   } else {
     debugPrintln("Normal boot - staying awake");
   }
+  wake_record = beginWakeRecord(&wake_timeline, reason);
+  markWakePhase(wake_record, WAKE_PHASE_BOOT, setup_started_ms);
 
-  KeepAliveCheckInPorts ports;
+  if (checkin_datagram_skip > 0) {
+    checkin_datagram_skip--;
+    KeepAliveCheckInPorts ports;
+    runWakeCheckIn(reason, ports);
+    return;
+  }
+  DatagramCheckInPorts ports;
   runWakeCheckIn(reason, ports);
 }
 
@@ -1423,6 +2829,11 @@ void handleSleepNowCommand(const String& /*message*/) {
 #ifdef BOARD_V6
 void handlePowerTestCommand(const String& message) {
   if (message == "0") {
+    // The cube keeps running, so a busy render task just means try again.
+    if (!stopRenderTask()) {
+      debugSend("render task busy, panel left on");
+      return;
+    }
     display_manager->shutdownForSleep();
     digitalWrite(POWER_SWITCH_PIN, LOW);
     debugSend("DMA stopped, pins tri-stated, GPIO5 LOW");
@@ -1437,6 +2848,7 @@ void handleSleepIntervalCommand(const String& message) {
   uint32_t new_interval = message.toInt();
   if (new_interval >= 10 && new_interval <= 300) {
     sleep_interval_s = new_interval;
+    keepalive_interval_s = new_interval;
     char dbg[64];
     snprintf(dbg, sizeof(dbg), "sleep_interval=%lu", sleep_interval_s);
     debugSend(dbg);
@@ -1447,19 +2859,40 @@ void handleSleepIntervalCommand(const String& message) {
   }
 }
 
+void handleSleepIntervalMaxCommand(const String& message) {
+  uint32_t new_ceiling = message.toInt();
+  if (new_ceiling >= 10 && new_ceiling <= 3600) {
+    keepalive_ceiling_s = new_ceiling;
+    char dbg[64];
+    snprintf(dbg, sizeof(dbg), "sleep_interval_max=%lu", (unsigned long)keepalive_ceiling_s);
+    debugSend(dbg);
+  } else {
+    debugSend("invalid sleep_interval_max");
+    Serial.println("Invalid sleep interval ceiling: must be 10-3600 seconds");
+  }
+}
+
 
-// Retried from loop() until the broker accepts it. Only one delete is tracked:
-// a second rebinding during a sustained outage drops the earlier tombstone, and
-// that is bounded because a cube that cannot publish is not producing new
-// proximity values either, so the stale record can only predate the outage.
-void flushProximityClears() {
-  if (!mqtt_client.isConnected()) return;
-  for (String& pending : mqtt_topic_proximity_pending_clear) {
-    if (pending.isEmpty()) continue;
-    if (mqtt_client.publish(pending, "", true)) {
-      pending = "";
-    }
+// Queues a retained publish. True once it is certain to reach the broker, so
+// a publish-on-change cache may advance; false leaves the cache where it was
+// and the change is offered again on the next poll.
+bool queuePublish(const char* topic, const char* payload) {
+  idle_governor.noteActivity(millis());
+  if (publish_queue.post(topic, payload, true)) {
+    return true;
   }
+  publishes_dropped++;
+  Serial.printf("publish not queued: %s\n", topic);
+  return false;
+}
+
+// While the session is down entries stay here, where they coalesce, rather
+// than piling up behind it in the network task's ring.
+void flushPublishQueue(int budget) {
+  if (!mqttConnected()) return;
+  publish_queue.flush(budget, [](const char* topic, const char* payload, bool retain) {
+    return netPublish(topic, payload, retain);
+  });
 }
 
 // Deletes the retained record rather than writing 0, which would be a standing
@@ -1467,119 +2900,243 @@ void flushProximityClears() {
 // Invalidating the cache matters as much as the delete: without it a cube
 // rebound to another slot whose closeness happens to match would publish
 // nothing, and the new topic would stay empty.
-void requestProximityClear(const String& topic) {
-  if (topic.isEmpty()) return;
-  flushProximityClears();
+//
+// The queue holds the topic by value, so the delete outlives the rebind that
+// asked for it, and it replaces any closeness still waiting for that topic.
+// Several can be outstanding at once: binding a slot deletes the topic being
+// left, and resolving as a reader deletes the one just bound.
+void requestProximityClear(const char* topic) {
+  if (topic[0] == '\0') return;
+  queuePublish(topic, "");
+}
+
+void clearRetainedProximity() {
+  requestProximityClear(topics.get(TOPIC_PROXIMITY));
+  topics.clear(TOPIC_PROXIMITY);
+  published_proximity = -1;
+}
+
+template <DisplayCommandType type>
+void postTopicCommand(const String& message) {
+  postDisplayCommand(type, message);
+}
+
+// For a topic outside the route table, which marks activity itself.
+template <MessageHandler handler>
+void countsAsActivity(const String& message) {
+  last_activity_time = millis();
+  handler(message);
+}
+
+void handleLetterTopic(const String& message) {
+  noteLetterArrival(message);
+  postDisplayCommand(DISPLAY_CMD_LETTER, message);
+}
+
+static uint16_t* consumeImagex(const String& /*topic*/, const String& message,
+                               String& /*missing*/) {
+  return fillIngestImage(reinterpret_cast<const uint8_t*>(message.c_str()),
+                         message.length(), false);
+}
+
+// Same picture as /imagex, in one of the encodings in image_codec.h.
+static uint16_t* consumeImagez(const String& /*topic*/, const String& message,
+                               String& /*missing*/) {
+  return fillIngestImage(reinterpret_cast<const uint8_t*>(message.c_str()),
+                         message.length(), true);
+}
+
+typedef TopicRoute<void (*)(const String&)> CubeTopicRoute;
+
+// cube/N/<suffix>, sorted by suffix.
+static constexpr CubeTopicRoute CUBE_TOPIC_ROUTES[] = {
+  {"border", postTopicCommand<DISPLAY_CMD_BORDER>, true},
+  {"border_frame", postTopicCommand<DISPLAY_CMD_BORDER_FRAME>, true},
+  {"border_hline_bottom", postTopicCommand<DISPLAY_CMD_BORDER_BOTTOM_BANNER>, true},
+  {"border_hline_top", postTopicCommand<DISPLAY_CMD_BORDER_TOP_BANNER>, true},
+  {"border_vline_height", postTopicCommand<DISPLAY_CMD_BORDER_VLINE_HEIGHT>, true},
+  {"border_vline_left", postTopicCommand<DISPLAY_CMD_BORDER_VLINE_LEFT>, true},
+  {"border_vline_right", postTopicCommand<DISPLAY_CMD_BORDER_VLINE_RIGHT>, true},
+  {"cmd", handleCommandFrame, true},
+  {"display_profile", postTopicCommand<DISPLAY_CMD_DISPLAY_PROFILE>, true},
+  {"flash", postTopicCommand<DISPLAY_CMD_FLASH>, true},
+  {"font_size", postTopicCommand<DISPLAY_CMD_FONT_SIZE>, true},
+  {"letter", handleLetterTopic, true},
+  {"lock", postTopicCommand<DISPLAY_CMD_LOCK>, true},
+  {"ping", handlePingCommand, true},
+#ifdef BOARD_V6
+  {"power_test", handlePowerTestCommand, true},
+#endif
+  {"reset", handleResetCommand, true},
+  {"rise_ms", postTopicCommand<DISPLAY_CMD_RISE_MS>, true},
+  // A retained setting, replayed on every subscribe, so not activity.
+  {"sleep_interval", handleSleepIntervalCommand, false},
+  {"sleep_interval_max", handleSleepIntervalMaxCommand, false},
+};
+static_assert(topicRoutesSorted(CUBE_TOPIC_ROUTES,
+                                sizeof(CUBE_TOPIC_ROUTES) / sizeof(CUBE_TOPIC_ROUTES[0])),
+              "CUBE_TOPIC_ROUTES must be sorted by suffix");
+
+typedef TopicRoute<uint16_t* (*)(const String& topic, const String& message, String& missing)>
+    CubePayloadRoute;
+
+// cube/N/<suffix> whose payload is consumed where the MQTT client runs rather
+// than copied to loop(); each returns the frame it filled, if any, and names
+// in `missing` a sprite it could not find, for handleClientImage(). Sorted by
+// suffix.
+static constexpr CubePayloadRoute CUBE_PAYLOAD_ROUTES[] = {
+  {"imagex", consumeImagex, true},
+  {"imagez", consumeImagez, true},
+  {"show", consumeShow, true},
+  {"sprite", consumeSprite, true},
+};
+static_assert(topicRoutesSorted(CUBE_PAYLOAD_ROUTES,
+                                sizeof(CUBE_PAYLOAD_ROUTES) / sizeof(CUBE_PAYLOAD_ROUTES[0])),
+              "CUBE_PAYLOAD_ROUTES must be sorted by suffix");
+
+// The network task's filter for cube/N/+. The wildcard also matches every
+// report the cube publishes under cube/N/ -- proximity, hall_presence, echo
+// and the like -- so the broker sends each straight back. Dropped here, on the
+// network task, they cost neither a copy onto net_inbound nor a loop() wake,
+// and are not taken for someone using the cube. A CUBE_PAYLOAD_ROUTES payload
+// is consumed here too, and loop() gets only the topic and the frame. Only the
+// suffix: the slot is loop()'s to check.
+bool cubeTopicForLoop(const String& topic, const String& message) {
+  const char* suffix = topicLastLevel(topic.c_str());
+  const CubePayloadRoute* consumer = findTopicRoute(
+      CUBE_PAYLOAD_ROUTES, sizeof(CUBE_PAYLOAD_ROUTES) / sizeof(CUBE_PAYLOAD_ROUTES[0]), suffix);
+  if (consumer == nullptr) {
+    return findTopicRoute(CUBE_TOPIC_ROUTES,
+                          sizeof(CUBE_TOPIC_ROUTES) / sizeof(CUBE_TOPIC_ROUTES[0]),
+                          suffix) != nullptr;
+  }
+  NetInbound item = {};
+  item.type = NET_IN_IMAGE;
+  item.topic = topic;
+  item.frame = consumer->handler(topic, message, item.payload);
+  deliverNetInbound(std::move(item));
+  return false;
+}
 
-  for (const String& pending : mqtt_topic_proximity_pending_clear) {
-    if (pending == topic) return;
+// The suffix of a cube/N/ topic for the slot this cube holds now, or null for
+// one it has since left.
+static const char* currentCubeTopicSuffix(const String& topic) {
+  const char* cube_topic = topics.get(TOPIC_CUBE);
+  const size_t prefix_length = strlen(cube_topic);
+  if (prefix_length == 0 || topic.length() <= prefix_length + 1 ||
+      strncmp(topic.c_str(), cube_topic, prefix_length) != 0 ||
+      topic[prefix_length] != '/') {
+    return nullptr;
   }
-  for (String& pending : mqtt_topic_proximity_pending_clear) {
-    if (pending.isEmpty()) {
-      pending = topic;
-      flushProximityClears();
-      return;
+  return topic.c_str() + prefix_length + 1;
+}
+
+// loop()'s half of a CUBE_PAYLOAD_ROUTES message. A picture for a slot this
+// cube has left gives its frame back unshown.
+void handleClientImage(const String& topic, uint16_t* frame, const String& missing) {
+  if (currentCubeTopicSuffix(topic) == nullptr) {
+    if (frame != nullptr) {
+      display_manager->releaseIngestImage(frame);
     }
+    return;
+  }
+  last_activity_time = millis();
+  if (frame != nullptr) {
+    postIngestImage(frame);
+  }
+  if (missing.length() > 0) {
+    netPublish(topics.get(TOPIC_SPRITE_MISSING), missing);
   }
+}
 
-  // Every slot taken means as many distinct topics have gone un-deleted as a
-  // cube has bindings to give, so the oldest is the one whose slot is least
-  // likely to be looked at again. Reaching here at all needs the broker to
-  // reject writes across that many rebindings.
-  for (size_t i = 1; i < PROXIMITY_PENDING_CLEARS; i++) {
-    mqtt_topic_proximity_pending_clear[i - 1] = mqtt_topic_proximity_pending_clear[i];
+// The one callback for cube/N/+. Messages for a slot this cube has since left
+// are dropped here.
+void dispatchCubeTopic(const String& topic, const String& message) {
+  const char* suffix = currentCubeTopicSuffix(topic);
+  if (suffix == nullptr) {
+    return;
+  }
+  const CubeTopicRoute* route = findTopicRoute(
+      CUBE_TOPIC_ROUTES, sizeof(CUBE_TOPIC_ROUTES) / sizeof(CUBE_TOPIC_ROUTES[0]), suffix);
+  if (route == nullptr) {
+    return;
   }
-  mqtt_topic_proximity_pending_clear[PROXIMITY_PENDING_CLEARS - 1] = topic;
-  flushProximityClears();
+  if (route->counts_as_activity) {
+    last_activity_time = millis();
+  }
+  route->handler(message);
 }
 
-void clearRetainedProximity() {
-  requestProximityClear(mqtt_topic_cube_proximity);
-  mqtt_topic_cube_proximity = "";
-  published_proximity = -1;
+// For slot topics this build no longer owns, so they have no TopicId.
+static void clearRetiredSlotTopic(const char* suffix) {
+  if (topics.slot()[0] == '\0') return;
+  char topic[PUBLISH_TOPIC_MAX];
+  snprintf(topic, sizeof(topic), "cube/%s/%s", topics.slot(), suffix);
+  queuePublish(topic, "");
 }
 
 void subscribeSlotTopics() {
   // Retained, so the value outlives the slot it described: it is cleared before
-  // the topic is rebound. This also runs on every MQTT reconnect with the slot
-  // unchanged, though, where deleting the cube's own live value and writing it
-  // straight back is pure churn.
+  // the topic is rebound. This also runs on every reconnect that walks the
+  // subscriptions with the slot unchanged, though, where deleting the cube's
+  // own live value and writing it straight back is pure churn.
   //
   // The publish cache is invalidated either way, because the broker runs with
   // persistence off -- a reconnect may be to a broker that has forgotten every
   // retained record, and publish-on-change alone would leave the topic empty
   // until the neighbour physically moved.
-  // Built from cube_identifier, not from mqtt_topic_cube, which still holds the
-  // slot being left at this point.
-  if (mqtt_topic_cube_proximity ==
-      String(MQTT_TOPIC_PREFIX_CUBE) + cube_identifier + "/proximity") {
+  // The registry still holds the slot being left at this point.
+  const bool slot_changed = strcmp(topics.slot(), cube_identifier.c_str()) != 0;
+  if (topics.has(TOPIC_PROXIMITY) && !slot_changed) {
     published_proximity = -1;
   } else {
     clearRetainedProximity();
   }
 
-  mqtt_topic_cube = MQTT_TOPIC_PREFIX_CUBE + cube_identifier;
-  mqtt_topic_cube_nfc = String(MQTT_TOPIC_PREFIX_CUBE) + MQTT_TOPIC_PREFIX_NFC + cube_identifier;
-  mqtt_topic_game_nfc = String(MQTT_TOPIC_PREFIX_GAME) + MQTT_TOPIC_PREFIX_NFC + cube_identifier;
-  mqtt_topic_echo = createMqttTopic(cube_identifier, MQTT_TOPIC_PREFIX_ECHO);
-  mqtt_topic_cube_right = String(MQTT_TOPIC_PREFIX_CUBE) + String("right/") + cube_identifier;
-  mqtt_topic_cube_proximity = mqtt_topic_cube + "/proximity";
+  topics.setSlot(cube_identifier.c_str());
 
-  // Only publish version on first boot, not on wake from sleep
+  // What follows is retained state, so it goes through the publish queue: a
+  // reconnect storm re-posts the same topics, and they coalesce there into one
+  // publish each once a session holds. Sensor mode and the probe report travel
+  // in the state snapshot instead; see publishStateSnapshot().
+
+  // Only publish version on first boot, not on wake from sleep. The flashing
+  // tools read it here.
   if (is_first_boot) {
-    mqtt_client.publish(createMqttTopic(cube_identifier, MQTT_TOPIC_PREFIX_VERSION), GIT_VERSION, true);  // retained
+    queuePublish(topics.get(TOPIC_VERSION), GIT_VERSION);
   }
 
-  // A cube waking from sleep still needs to report its mode, so this sits
-  // outside the is_first_boot guard above.
-  mqtt_client.publish(mqtt_topic_cube + "/sensor_mode",
-                      sensorModeIsMagnets() ? "magnets" : "nfc", true);
-  // Retained, so a report from a rejected probe outlives the cable swap that
-  // fixes it -- a cube reading "nfc" would still carry "I probed and found
-  // nothing" beside it. Publishing unconditionally clears the record when
-  // there is nothing to report.
-  mqtt_client.publish(mqtt_topic_cube + "/sensor_probe", sensor_probe_report,
-                      true);
+  // cube/N/sensor_mode and cube/N/sensor_probe were retained topics of their
+  // own before the snapshot took them over. Nothing writes them now, so the
+  // broker would replay the last values an older build left there to every
+  // tool that still subscribes, long after they stopped being true. Deleting
+  // them once per power session and once per slot bound covers every slot a
+  // cube has been through; the broker forgets them after that.
+  if (is_first_boot || slot_changed) {
+    clearRetiredSlotTopic("sensor_mode");
+    clearRetiredSlotTopic("sensor_probe");
+  }
 
   // cube/device/{MAC}/nfc is retained, so a tag read before a cable swap
   // outlives the swap. The game server resolves neighbours from that topic, so
   // the record would be applied as a live neighbour for a cube that no longer
   // has a reader. An empty payload is how a cleared observation is already
   // expressed, so publishing one retires the record.
-  if (sensorModeIsMagnets() && !mqtt_topic_device_nfc.isEmpty()) {
-    mqtt_client.publish(mqtt_topic_device_nfc, "", true);
-  }
-
-  auto resetActivityTimer = []() { last_activity_time = millis(); };
-
-  mqtt_client.subscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "border_bottom_banner", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderBottomBannerCommand(msg); });
-  mqtt_client.subscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "border_top_banner", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderTopBannerCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/sleep_interval", handleSleepIntervalCommand);
-  mqtt_client.subscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "string", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleStringCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleConsolidatedBorderCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border_hline_bottom", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderBottomBannerCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border_hline_top", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderTopBannerCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border_frame", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderFrameCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border_vline_height", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderLineHeightCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border_vline_left", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderVLineLeftCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/border_vline_right", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBorderVLineRightCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/font_size", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleFontSizeCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/flash", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleFlashCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/imagex", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleImageBinaryCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/letter", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleLetterCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/lock", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleLockCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/ping", [resetActivityTimer](const String& msg) { resetActivityTimer(); handlePingCommand(msg); });
-#ifdef BOARD_V6
-  mqtt_client.subscribe(mqtt_topic_cube + "/power_test", [resetActivityTimer](const String& msg) { resetActivityTimer(); handlePowerTestCommand(msg); });
-#endif
-  mqtt_client.subscribe(mqtt_topic_cube + "/reset", [resetActivityTimer](const String& msg) { resetActivityTimer(); handleResetCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_cube + "/rise_ms", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleRiseMsCommand(msg); });
-  mqtt_client.subscribe(mqtt_topic_game_nfc, [resetActivityTimer](const String& msg) { resetActivityTimer(); handleNfcCommand(msg); });
+  if (sensorModeIsMagnets() && topics.has(TOPIC_DEVICE_NFC)) {
+    queuePublish(topics.get(TOPIC_DEVICE_NFC), "");
+  }
+
+  // Broadcast to every cube, so outside cube/N/.
+  netSubscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "border_bottom_banner", countsAsActivity<postTopicCommand<DISPLAY_CMD_BORDER_BOTTOM_BANNER>>);
+  netSubscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "border_top_banner", countsAsActivity<postTopicCommand<DISPLAY_CMD_BORDER_TOP_BANNER>>);
+  netSubscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "string", countsAsActivity<postTopicCommand<DISPLAY_CMD_STRING>>);
+  netSubscribe(topics.get(TOPIC_CUBE_ALL), dispatchCubeTopic, cubeTopicForLoop);
+  netSubscribe(topics.get(TOPIC_GAME_NFC), countsAsActivity<handleNfcCommand>);
 
   // Publish initial "no neighbor" state so game server sees all cubes on startup
-  mqtt_client.publish(mqtt_topic_cube_nfc, "-", true);
+  queuePublish(topics.get(TOPIC_CUBE_NFC), "-");
   if (sensorModeIsMagnets()) {
-    mqtt_client.publish(mqtt_topic_cube_right, "-", true);
+    queuePublish(topics.get(TOPIC_CUBE_RIGHT), "-");
     strncpy(last_right_published, "-", sizeof(last_right_published) - 1);
     last_right_published[sizeof(last_right_published) - 1] = '\0';
   } else {
@@ -1595,11 +3152,11 @@ void subscribeSlotTopics() {
     // right after this -- last_observation_published is reset just before
     // subscribeSlotTopics() runs -- so clearing here cannot strand the edge
     // the observation path owns.
-    mqtt_client.publish(mqtt_topic_cube_right, "", true);
+    queuePublish(topics.get(TOPIC_CUBE_RIGHT), "");
     last_right_published[0] = '\0';
     // Nothing writes proximity outside the magnets loop, so a cube that reported
     // a docked neighbour and came back as a reader would keep asserting it.
-    requestProximityClear(mqtt_topic_cube_proximity);
+    requestProximityClear(topics.get(TOPIC_PROXIMITY));
   }
 }
 
@@ -1607,8 +3164,59 @@ bool slotIsResolved() {
   return slot_resolved && applied_slot > 0;
 }
 
+// Reconnect timing, for the snapshot and the diag report. outage_ms runs from
+// the network task seeing the session drop to the connect being handled here;
+// ready_ms from there until everything that connect queued has gone out.
+static uint32_t mqtt_connects = 0;
+static uint32_t last_outage_ms = 0;
+static uint32_t last_ready_ms = 0;
+static bool connect_ready_pending = false;
+static unsigned long connect_handled_at = 0;
+
+void publishStateSnapshot() {
+  if (!topics.has(TOPIC_DEVICE_STATE)) {
+    return;
+  }
+  StateSnapshot state = {
+    boot_id.c_str(), applied_slot, applied_generation, GIT_VERSION,
+    sensorModeIsMagnets() ? "magnets" : "nfc", sensor_probe_report,
+    mqtt_connects, last_outage_ms, last_ready_ms,
+  };
+  char payload[PUBLISH_PAYLOAD_MAX];
+  if (formatStateSnapshot(payload, sizeof(payload), state) < 0) {
+    Serial.println("state snapshot too long, not published");
+    return;
+  }
+  queuePublish(topics.get(TOPIC_DEVICE_STATE), payload);
+}
+
+// Once per boot, from the first connect: the records since the last full wake,
+// this one's included.
+void publishWakeTimeline() {
+  if (wake_timeline_published || !topics.has(TOPIC_DEVICE_WAKES)) {
+    return;
+  }
+  char payload[PUBLISH_PAYLOAD_MAX];
+  if (formatWakeTimeline(payload, sizeof(payload), wake_timeline) < 0) {
+    return;
+  }
+  wake_timeline_published = queuePublish(topics.get(TOPIC_DEVICE_WAKES), payload);
+}
+
+// Called from loop() once its queues have been given their turn.
+void checkConnectReady() {
+  if (!connect_ready_pending || publish_queue.count() != 0 || !net_outbound.empty()) {
+    return;
+  }
+  connect_ready_pending = false;
+  last_ready_ms = millis() - connect_handled_at;
+  Serial.printf("MQTT ready %lu ms after connect (outage %lu ms, connect %lu)\n",
+                (unsigned long)last_ready_ms, (unsigned long)last_outage_ms,
+                (unsigned long)mqtt_connects);
+}
+
 void publishPresence(const char* state) {
-  if (mqtt_topic_presence.isEmpty()) {
+  if (!topics.has(TOPIC_PRESENCE)) {
     return;
   }
   char payload[160];
@@ -1617,7 +3225,7 @@ void publishPresence(const char* state) {
            "\"applied_slot\":%d,\"applied_generation\":%lu}",
            state, boot_id.c_str(), applied_slot,
            static_cast<unsigned long>(applied_generation));
-  mqtt_client.publish(mqtt_topic_presence, payload, true);
+  netPublish(topics.get(TOPIC_PRESENCE), payload, true);
 }
 
 void applySlot(int slot) {
@@ -1626,22 +3234,27 @@ void applySlot(int slot) {
 
   if (slot <= 0) {
     cube_identifier = "";
-    mqtt_topic_cube = "";
-    display_manager->displayDebugMessage("NO SLOT");
+    topics.clear(TOPIC_CUBE);
+    postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, "NO SLOT");
     debugSend("unassigned: idle");
-    if (!mqtt_topic_device_nfc.isEmpty()) {
-      mqtt_client.publish(mqtt_topic_device_nfc, "", true);
+    if (topics.has(TOPIC_DEVICE_NFC)) {
+      netPublish(topics.get(TOPIC_DEVICE_NFC), "", true);
     }
     clearRetainedProximity();
     publishPresence("online");
+    publishStateSnapshot();
     return;
   }
 
   cube_identifier = String(slot);
-  display_manager->setSlotRotation(slot);
+  // The boot status lines have said what they had to; the game owns the panel
+  // from here.
+  postDisplayCommand(DISPLAY_CMD_CLEAR_DEBUG, "");
+  postDisplayCommand(DISPLAY_CMD_SLOT_ROTATION, String(slot));
   subscribeSlotTopics();
   debugSend((String("slot ") + cube_identifier).c_str());
   publishPresence("online");
+  publishStateSnapshot();
 }
 
 void handleAuthorityMarker(const String& message) {
@@ -1695,43 +3308,176 @@ void handleLivenessRequest(const String& nonce) {
            "\"generation\":%lu,\"applied_slot\":%d}",
            nonce.c_str(), boot_id.c_str(),
            static_cast<unsigned long>(applied_generation), applied_slot);
-  mqtt_client.publish(mqtt_topic_liveness_response, payload, false);
+  netPublish(topics.get(TOPIC_LIVENESS_RESPONSE), payload, false);
+}
+
+// ============= Fleet Commands =============
+static int fleet_commands_applied = 0;
+static int fleet_commands_dropped = 0;
+
+#ifdef FLEET_COMMAND_KEY
+static_assert(sizeof(FLEET_COMMAND_KEY) == FLEET_COMMAND_KEY_BYTES + 1,
+              "FLEET_COMMAND_KEY must be exactly 16 characters");
+
+// Indexed by FleetCommandType - 1: the handlers the same MQTT topics run.
+static const MessageHandler FLEET_COMMAND_HANDLERS[] = {
+  countsAsActivity<postTopicCommand<DISPLAY_CMD_BRIGHTNESS>>,
+  countsAsActivity<postTopicCommand<DISPLAY_CMD_STRING>>,
+  countsAsActivity<postTopicCommand<DISPLAY_CMD_BORDER_TOP_BANNER>>,
+  countsAsActivity<postTopicCommand<DISPLAY_CMD_BORDER_BOTTOM_BANNER>>,
+  countsAsActivity<postTopicCommand<DISPLAY_CMD_FLASH>>,
+  handleSleepNowCommand,
+  countsAsActivity<handleRebootCommand>,
+};
+static_assert(sizeof(FLEET_COMMAND_HANDLERS) / sizeof(FLEET_COMMAND_HANDLERS[0]) == FLEET_CMD_TYPE_LAST,
+              "every FleetCommandType needs a handler");
+
+// In NVS, as RTC memory is re-initialised by every reset that is not a
+// deep-sleep wake -- including the one a fleet reboot causes.
+class NvsFleetNonceStore : public FleetNonceStore {
+ public:
+  uint64_t load() override { return loadFleetNonce(); }
+  bool save(uint64_t nonce) override { return saveFleetNonce(nonce); }
+};
+static NvsFleetNonceStore fleet_nonce_store;
+static FleetNonceFloor fleet_nonce_floor(fleet_nonce_store);
+
+void handleFleetDatagram(const String& datagram) {
+  FleetCommand command;
+  if (!parseFleetCommand(reinterpret_cast<const uint8_t*>(datagram.c_str()), datagram.length(),
+                         reinterpret_cast<const uint8_t*>(FLEET_COMMAND_KEY), &command) ||
+      !fleet_nonce_floor.accept(command.nonce)) {
+    fleet_commands_dropped++;
+    return;
+  }
+  fleet_commands_applied++;
+  FLEET_COMMAND_HANDLERS[command.type - 1](
+      String(reinterpret_cast<const char*>(command.payload), command.payload_length));
+}
+
+// Network task side. The group is left with the WiFi link and joined again
+// when it is back, since a join does not outlive the interface.
+void receiveFleetDatagram() {
+  static bool joined = false;
+  const bool wifi_up = WiFi.status() == WL_CONNECTED;
+  if (wifi_up != joined) {
+    if (wifi_up) {
+      joined = fleet_udp.beginMulticast(fleet_group, FLEET_MULTICAST_PORT);
+    } else {
+      fleet_udp.stop();
+      joined = false;
+    }
+  }
+  if (!joined || !fleet_udp.parsePacket()) {
+    return;
+  }
+  char datagram[FLEET_DATAGRAM_MAX];
+  int len = fleet_udp.read(datagram, sizeof(datagram));
+  if (len <= 0) {
+    return;
+  }
+  NetInbound item = {};
+  item.type = NET_IN_MESSAGE;
+  item.handler = handleFleetDatagram;
+  item.payload = String(datagram, len);
+  deliverNetInbound(std::move(item));
+}
+#else
+void receiveFleetDatagram() {}
+#endif
+
+// Re-announce what we see now. Publish-on-change alone would leave a cleared
+// record unrestored until the neighbor physically moved.
+void handleResendRequest(const String& /*message*/) {
+  last_observation_published[0] = '\0';
 }
 
+// Called by the client from inside mqtt_client.loop(), so on the network task;
+// the work is loop()'s, in handleConnectionEstablished().
 void onConnectionEstablished() {
+  net_sessions++;
+  mqtt_session_lingering = true;
+  NetInbound item = {};
+  item.type = NET_IN_CONNECTED;
+  deliverNetInbound(std::move(item));
+}
+
+static MqttSessionTracker mqtt_session;
+// net_subscribes_lost as the last walk began; see MqttSessionTracker.
+static int walk_lost_mark = 0;
+
+void handleConnectionEstablished() {
   debugSend("MQTT connected");
+  subscribe_session = net_sessions.load();
+  mqtt_connects++;
+  connect_handled_at = millis();
+  const unsigned long lost_at = net_session_lost_at.load();
+  last_outage_ms = lost_at != 0 ? connect_handled_at - lost_at : 0;
+  connect_ready_pending = true;
+
+  const bool intact = net_subscribes_lost.load() == walk_lost_mark;
+  if (mqtt_session.beginConnect(connect_handled_at, boot_id.c_str(), intact)) {
+    // The rest of the connect waits on the answer: handleSessionProbe(), or
+    // checkSessionProbe() once it is overdue.
+    netPublish(topics.get(TOPIC_DEVICE_SESSION), mqtt_session.token());
+    return;
+  }
+  walkSubscriptions();
+}
 
-  mqtt_topic_assign = String("cube/assign/") + mac_nocolons;
-  mqtt_topic_device_nfc = String("cube/device/") + mac_nocolons + "/nfc";
-  mqtt_topic_liveness_response =
-      String("cube/device/") + mac_nocolons + "/liveness-response";
-
-  mqtt_client.subscribe("cube/roster/authoritative", handleAuthorityMarker);
-  mqtt_client.subscribe(mqtt_topic_assign, handleAssignmentRecord);
-  mqtt_client.subscribe(
-      String("cube/device/") + mac_nocolons + "/liveness-request",
-      handleLivenessRequest);
-
-  auto resetActivityTimer = []() { last_activity_time = millis(); };
-  mqtt_client.subscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "brightness", [resetActivityTimer](const String& msg) { resetActivityTimer(); display_manager->handleBrightnessCommand(msg); });
-  mqtt_client.subscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "reboot", [resetActivityTimer](const String& msg) { resetActivityTimer(); handleRebootCommand(msg); });
-  mqtt_client.subscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "sleep_now", handleSleepNowCommand);
-  mqtt_client.subscribe("cube/resend", [](const String&) {
-    // Re-announce what we see now. Publish-on-change alone would leave a
-    // cleared record unrestored until the neighbor physically moved.
-    last_observation_published[0] = '\0';
-  });
+// The broker kept the session, so every subscription is in place and what was
+// published to them while the cube was away has been queued for it. Only the
+// presence record needs saying again: an unclean drop fired the last will.
+void resumeSession() {
+  debugSend("MQTT session resumed");
+  if (slot_resolved) {
+    publishPresence("online");
+    publishStateSnapshot();
+  }
+}
+
+void handleSessionProbe(const String& message) {
+  if (mqtt_session.probeEchoed(message.c_str())) {
+    resumeSession();
+  }
+}
+
+// Called from loop().
+void checkSessionProbe() {
+  if (mqtt_session.probeExpired(millis())) {
+    debugSend("MQTT session not kept");
+    walkSubscriptions();
+  }
+}
+
+// Everything a session afresh needs: every subscription, and the retained
+// state that goes with them.
+void walkSubscriptions() {
+  walk_lost_mark = net_subscribes_lost.load();
+
+  netSubscribe("cube/roster/authoritative", handleAuthorityMarker);
+  netSubscribe(topics.get(TOPIC_ASSIGN), handleAssignmentRecord);
+  netSubscribe(topics.get(TOPIC_LIVENESS_REQUEST), handleLivenessRequest);
+
+  netSubscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "brightness", countsAsActivity<postTopicCommand<DISPLAY_CMD_BRIGHTNESS>>);
+  netSubscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "reboot", countsAsActivity<handleRebootCommand>);
+  netSubscribe(String(MQTT_TOPIC_PREFIX_CUBE) + "sleep_now", handleSleepNowCommand);
+  netSubscribe("cube/resend", handleResendRequest);
 
   last_observation_published[0] = '\0';
 
   if (slotIsResolved()) {
     subscribeSlotTopics();
     publishPresence("online");
+    publishStateSnapshot();
   } else if (!slot_resolved) {
     assignment_wait_started = millis();
   } else {
     publishPresence("online");
+    publishStateSnapshot();
   }
+  netSubscribe(topics.get(TOPIC_DEVICE_SESSION), handleSessionProbe);
+  publishWakeTimeline();
 
   if (last_activity_time == 0) {
     last_activity_time = millis();
@@ -1797,6 +3543,17 @@ static HallPresenceTracker hall_presence;
 #define PRESENCE_BASELINE_MAX   4000
 RTC_NOINIT_ATTR static uint32_t saved_presence_magic;
 RTC_NOINIT_ATTR static int32_t saved_presence_baseline;
+// Whether presence was asserted when the baseline was saved: 1 or 0, anything
+// else is uninitialised. What the docking watch waits for -- an assert or a
+// release -- depends on it.
+RTC_NOINIT_ATTR static uint8_t saved_presence_docked;
+
+static const HallPresenceConfig HALL_PRESENCE_CONFIG = {HALL_PRESENCE_DIRECTION,
+                                                        HALL_PRESENCE_ON_DELTA,
+                                                        HALL_PRESENCE_OFF_DELTA,
+                                                        HALL_PRESENCE_FAST_SHIFT,
+                                                        HALL_PRESENCE_BASE_SHIFT,
+                                                        HALL_PRESENCE_BASE_INTERVAL_MS};
 
 static bool plausiblePresenceBaseline(int baseline) {
   return baseline >= PRESENCE_BASELINE_MIN && baseline <= PRESENCE_BASELINE_MAX;
@@ -1819,13 +3576,7 @@ void setupHallSensors() {
     pinMode(HALL_ID_PINS[i], INPUT);
   }
   pinMode(HALL_PRESENCE_PIN, INPUT);
-  hall_presence.begin({HALL_PRESENCE_DIRECTION,
-                       HALL_PRESENCE_ON_DELTA,
-                       HALL_PRESENCE_OFF_DELTA,
-                       HALL_PRESENCE_FAST_SHIFT,
-                       HALL_PRESENCE_BASE_SHIFT,
-                       HALL_PRESENCE_BASE_INTERVAL_MS},
-                      restoredPresenceBaseline());
+  hall_presence.begin(HALL_PRESENCE_CONFIG, restoredPresenceBaseline());
 
   Serial.println(F("Hall neighbor sensors initialized"));
 }
@@ -1849,6 +3600,103 @@ uint8_t readHallNeighborId() {
   return hallCubeIdForMask(id_mask);  // 0 = invalid weight-2 pattern
 }
 
+// The ULP program and its data share the start of RTC slow memory, the 512
+// bytes the framework reserves for the coprocessor ahead of RTC_DATA_ATTR.
+// Data words first, at fixed offsets both sides agree on; the ULP reads and
+// writes their low 16 bits.
+enum HallDockUlpWord {
+  HALL_DOCK_ULP_WAKE_AT_OR_ABOVE,
+  HALL_DOCK_ULP_WAKE_BELOW,
+  HALL_DOCK_ULP_STREAK,   // consecutive crossings so far
+  HALL_DOCK_ULP_READING,  // last averaged reading, for the wake log
+  HALL_DOCK_ULP_PROGRAM,  // first word of the program
+};
+
+enum { HALL_DOCK_CHECK_BELOW, HALL_DOCK_CROSSED, HALL_DOCK_DONE };
+
+// One pass per HALL_DOCK_SAMPLE_MS. hallDockWatchCrossed() is the same test in
+// C: a SUB that borrows sets the overflow flag, which is how the ULP compares.
+static const ulp_insn_t hall_dock_ulp_program[] = {
+  I_MOVI(R3, 0),
+  I_MOVI(R0, 0),
+  I_ADC(R1, 0, HALL_PRESENCE_ADC_CHANNEL), I_ADDR(R0, R0, R1),
+  I_ADC(R1, 0, HALL_PRESENCE_ADC_CHANNEL), I_ADDR(R0, R0, R1),
+  I_ADC(R1, 0, HALL_PRESENCE_ADC_CHANNEL), I_ADDR(R0, R0, R1),
+  I_ADC(R1, 0, HALL_PRESENCE_ADC_CHANNEL), I_ADDR(R0, R0, R1),
+  I_RSHI(R0, R0, 2),
+  I_ST(R0, R3, HALL_DOCK_ULP_READING),
+  I_LD(R1, R3, HALL_DOCK_ULP_WAKE_AT_OR_ABOVE),
+  I_SUBR(R2, R0, R1),  // borrows when reading < wake_at_or_above
+  M_BXF(HALL_DOCK_CHECK_BELOW),
+  M_BX(HALL_DOCK_CROSSED),
+  M_LABEL(HALL_DOCK_CHECK_BELOW),
+  I_LD(R1, R3, HALL_DOCK_ULP_WAKE_BELOW),
+  I_SUBR(R2, R0, R1),  // borrows when reading < wake_below
+  M_BXF(HALL_DOCK_CROSSED),
+  I_MOVI(R2, 0),
+  I_ST(R2, R3, HALL_DOCK_ULP_STREAK),
+  I_HALT(),
+  M_LABEL(HALL_DOCK_CROSSED),
+  I_LD(R0, R3, HALL_DOCK_ULP_STREAK),
+  I_ADDI(R0, R0, 1),
+  I_ST(R0, R3, HALL_DOCK_ULP_STREAK),
+  M_BL(HALL_DOCK_DONE, HALL_DOCK_CONFIRM_SAMPLES),
+  I_WAKE(),
+  M_LABEL(HALL_DOCK_DONE),
+  I_HALT(),
+};
+
+// Called on the way into deep sleep. The watch needs the baseline the awake
+// cube was tracking, so it is only armed once the tracker has run since the
+// last cold boot; without one the cube sleeps on the timer as before.
+bool armHallDockWatch() {
+#if HALL_DOCK_WAKE
+  if (!sensorModeIsMagnets() || saved_presence_magic != PRESENCE_BASELINE_MAGIC ||
+      !plausiblePresenceBaseline(saved_presence_baseline) || saved_presence_docked > 1) {
+    return false;
+  }
+  const HallDockWatch watch = hallDockWatch(HALL_PRESENCE_CONFIG, saved_presence_baseline,
+                                            saved_presence_docked == 1);
+  size_t program_words = sizeof(hall_dock_ulp_program) / sizeof(ulp_insn_t);
+  if (ulp_process_macros_and_load(HALL_DOCK_ULP_PROGRAM, hall_dock_ulp_program,
+                                  &program_words) != ESP_OK) {
+    Serial.println("Docking watch: ULP program did not load");
+    return false;
+  }
+  RTC_SLOW_MEM[HALL_DOCK_ULP_WAKE_AT_OR_ABOVE] = watch.wake_at_or_above;
+  RTC_SLOW_MEM[HALL_DOCK_ULP_WAKE_BELOW] = watch.wake_below;
+  RTC_SLOW_MEM[HALL_DOCK_ULP_STREAK] = 0;
+  RTC_SLOW_MEM[HALL_DOCK_ULP_READING] = 0;
+
+  // The same width and attenuation analogRead() samples with, so the counts
+  // are the tracker's.
+  adc1_config_width(ADC_WIDTH_BIT_12);
+  adc1_config_channel_atten(HALL_PRESENCE_ADC_CHANNEL, ADC_ATTEN_DB_11);
+  adc1_ulp_enable();
+  ulp_set_wakeup_period(0, HALL_DOCK_SAMPLE_MS * 1000);
+  esp_sleep_enable_ulp_wakeup();
+  if (ulp_run(HALL_DOCK_ULP_PROGRAM) != ESP_OK) {
+    Serial.println("Docking watch: ULP did not start");
+    return false;
+  }
+  Serial.printf("Docking watch: baseline %ld, wake at >=%u or <%u\n",
+                (long)saved_presence_baseline, watch.wake_at_or_above, watch.wake_below);
+  return true;
+#else
+  return false;
+#endif
+}
+
+// First thing on every wake: the ULP timer keeps running after the cores are
+// up, and the program would go on sampling ADC1 under analogRead().
+void stopHallDockWatch() {
+  CLEAR_PERI_REG_MASK(RTC_CNTL_STATE0_REG, RTC_CNTL_ULP_CP_SLP_TIMER_EN);
+  if (esp_sleep_get_wakeup_cause() == ESP_SLEEP_WAKEUP_ULP) {
+    Serial.printf("Docking watch woke at reading %lu\n",
+                  (unsigned long)(RTC_SLOW_MEM[HALL_DOCK_ULP_READING] & 0xFFFF));
+  }
+}
+
 // ============= NFC Functions =============
 ISO15693ErrorCode readNfcCard(uint8_t* card_id) {
   // Clear the card_id buffer first
@@ -1892,6 +3740,7 @@ void nfcWorkerTask(void* /*parameter*/) {
     }
 
     xQueueOverwrite(nfc_result_queue, &worker_result);
+    wakeLoop();
 
     uint32_t delay_ms =
       worker_result.recovery_attempted && !worker_result.recovery_succeeded
@@ -1934,170 +3783,317 @@ void setupUDP() {
   Serial.printf("UDP server listening on port %d\n", UDP_PORT);
 }
 
-void handleUDP() {
+// Network task side. ping and rssi need nothing from the application and are
+// answered here, so a ping times the network path rather than loop(); every
+// other request is handed to loop() whole.
+void receiveUDP() {
   int packetSize = udp.parsePacket();
-  if (packetSize) {
-    // Serial.printf("packetSize: %d\n", packetSize);
-    int len = udp.read(udpBuffer, sizeof(udpBuffer)-1);
-    // Serial.printf("len: %d\n", len);
-    if (len > 0) {
-      udpBuffer[len] = 0; // Null terminate
-      
-      // Check if message is "ping"
-      if (strcmp(udpBuffer, "ping") == 0) {
-        // Send "pong" back to sender
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)"pong", 4);
-        udp.endPacket();
-        
-        // Serial.printf("Received ping from %s:%d\n", udp.remoteIP().toString().c_str(), udp.remotePort());
-      }
-      // Check if message is "rssi"
-      else if (strcmp(udpBuffer, "rssi") == 0) {
-        char rssiStr[32];
-        snprintf(rssiStr, sizeof(rssiStr), "%d", WiFi.RSSI());
-        
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)rssiStr, strlen(rssiStr));
-        udp.endPacket();
-        
-        // Serial.printf("Sent RSSI to %s:%d: %s\n", udp.remoteIP().toString().c_str(), udp.remotePort(), rssiStr);
-      }
-      else if (!slotIsResolved() &&
-               (strcmp(udpBuffer, "timing") == 0 ||
-                strcmp(udpBuffer, "diag") == 0 ||
-                strcmp(udpBuffer, "chip") == 0 ||
-                strcmp(udpBuffer, "temp") == 0)) {
-        const char* marker = slot_resolved ? "unassigned" : "unresolved";
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)marker, strlen(marker));
-        udp.endPacket();
-      }
-      // Check if message is "timing" - return cube_id:avg_loop_time_us
-      else if (slotIsResolved() && strcmp(udpBuffer, "timing") == 0) {
-        // Calculate average loop time over recent samples
-        unsigned long avg_loop_time_us = 0;
-
-        if (timing_samples_filled) {
-          // Use all samples for average
-          avg_loop_time_us = timing_accumulator / TIMING_SAMPLE_SIZE;
-        } else if (timing_sample_index > 0) {
-          // Use available samples
-          unsigned long sum = 0;
-          for (int i = 0; i < timing_sample_index; i++) {
-            sum += timing_samples[i];
-          }
-          avg_loop_time_us = sum / timing_sample_index;
-        } else {
-          // No samples yet, return current loop time
-          unsigned long loop_end_time = micros();
-          avg_loop_time_us = loop_end_time - loop_start_time;
-        }
+  if (!packetSize) {
+    return;
+  }
+  int len = udp.read(udpBuffer, sizeof(udpBuffer)-1);
+  if (len <= 0) {
+    return;
+  }
 
-        char timingStr[32];
-        snprintf(timingStr, sizeof(timingStr), "%s:%lu", cube_identifier.c_str(), avg_loop_time_us);
+  // Binary, so it is passed on by length before anything treats the buffer as
+  // text.
+  if (isUdpCommand(reinterpret_cast<const uint8_t*>(udpBuffer), len)) {
+    NetInbound item = {};
+    item.type = NET_IN_MESSAGE;
+    item.handler = handleUdpCommand;
+    item.payload = String(udpBuffer, len);
+    deliverNetInbound(std::move(item));
+    return;
+  }
+
+  udpBuffer[len] = 0; // Null terminate
+
+  // Check if message is "ping"
+  if (strcmp(udpBuffer, "ping") == 0) {
+    // Send "pong" back to sender
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write((const uint8_t*)"pong", 4);
+    udp.endPacket();
+  }
+  // Check if message is "rssi"
+  else if (strcmp(udpBuffer, "rssi") == 0) {
+    char rssiStr[32];
+    snprintf(rssiStr, sizeof(rssiStr), "%d", WiFi.RSSI());
 
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)timingStr, strlen(timingStr));
-        udp.endPacket();
+    udp.beginPacket(udp.remoteIP(), udp.remotePort());
+    udp.write((const uint8_t*)rssiStr, strlen(rssiStr));
+    udp.endPacket();
+  }
+  else {
+    NetInbound item = {};
+    item.type = NET_IN_UDP;
+    item.payload = udpBuffer;
+    item.remote_ip = udp.remoteIP();
+    item.remote_port = udp.remotePort();
+    deliverNetInbound(std::move(item));
+  }
+}
 
-        Serial.printf("Sent timing to %s:%d: %s (avg over %d samples)\n",
-                      udp.remoteIP().toString().c_str(), udp.remotePort(), timingStr,
-                      timing_samples_filled ? TIMING_SAMPLE_SIZE : timing_sample_index);
+void handleUdpRequest(const String& request_text, const IPAddress& remote_ip, uint16_t remote_port) {
+  const char* request = request_text.c_str();
+  if (!slotIsResolved() &&
+      (strcmp(request, "timing") == 0 ||
+       strcmp(request, "diag") == 0 ||
+       strcmp(request, "chip") == 0 ||
+       strcmp(request, "temp") == 0)) {
+    const char* marker = slot_resolved ? "unassigned" : "unresolved";
+    sendUdp(remote_ip, remote_port, marker);
+  }
+  // Check if message is "timing" - return cube_id:avg_loop_time_us
+  else if (slotIsResolved() && strcmp(request, "timing") == 0) {
+    // Calculate average loop time over recent samples
+    unsigned long avg_loop_time_us = 0;
+
+    if (timing_samples_filled) {
+      // Use all samples for average
+      avg_loop_time_us = timing_accumulator / TIMING_SAMPLE_SIZE;
+    } else if (timing_sample_index > 0) {
+      // Use available samples
+      unsigned long sum = 0;
+      for (int i = 0; i < timing_sample_index; i++) {
+        sum += timing_samples[i];
       }
-      // Check if message is "diag" - return detailed per-section timing breakdown
-      else if (slotIsResolved() && strcmp(udpBuffer, "diag") == 0) {
-        char diagStr[320];
-        unsigned long avg_mqtt = section_timing_count > 0 ? section_timing_accum.mqtt_us / section_timing_count : 0;
-        unsigned long avg_display = section_timing_count > 0 ? section_timing_accum.display_us / section_timing_count : 0;
-        unsigned long avg_udp = section_timing_count > 0 ? section_timing_accum.udp_us / section_timing_count : 0;
-        unsigned long avg_nfc = section_timing_count > 0 ? section_timing_accum.nfc_us / section_timing_count : 0;
-        unsigned long avg_total = timing_samples_filled ? timing_accumulator / TIMING_SAMPLE_SIZE :
-                                  (timing_sample_index > 0 ? timing_accumulator / timing_sample_index : 0);
-        unsigned long avg_letter_interval = letter_interval_count > 0 ? letter_interval_accum / letter_interval_count : 0;
-
-        const char* fw_board =
+      avg_loop_time_us = sum / timing_sample_index;
+    } else {
+      // No samples yet, return current loop time
+      unsigned long loop_end_time = micros();
+      avg_loop_time_us = loop_end_time - loop_start_time;
+    }
+
+    char timingStr[32];
+    snprintf(timingStr, sizeof(timingStr), "%s:%lu", cube_identifier.c_str(), avg_loop_time_us);
+
+    sendUdp(remote_ip, remote_port, timingStr);
+
+    Serial.printf("Sent timing to %s:%d: %s (avg over %d samples)\n",
+                  remote_ip.toString().c_str(), remote_port, timingStr,
+                  timing_samples_filled ? TIMING_SAMPLE_SIZE : timing_sample_index);
+  }
+  // Check if message is "diag" - return detailed per-section timing breakdown
+  else if (slotIsResolved() && strcmp(request, "diag") == 0) {
+    char diagStr[512];
+    // mqtt= and udp= are the network task's, per pass of its own.
+    portENTER_CRITICAL(&net_timing_mux);
+    NetTiming net = net_timing;
+    net_timing = {0, 0, 0};
+    portEXIT_CRITICAL(&net_timing_mux);
+    unsigned long avg_mqtt = net.passes > 0 ? net.mqtt_us / net.passes : 0;
+    portENTER_CRITICAL(&render_timing_mux);
+    RenderTiming render = render_timing;
+    render_timing = {0, 0, 0};
+    portEXIT_CRITICAL(&render_timing_mux);
+    unsigned long avg_display = render.frames > 0 ? render.frame_us / render.frames : 0;
+    unsigned long avg_udp = net.passes > 0 ? net.udp_us / net.passes : 0;
+    unsigned long avg_nfc = section_timing_count > 0 ? section_timing_accum.nfc_us / section_timing_count : 0;
+    unsigned long avg_total = timing_samples_filled ? timing_accumulator / TIMING_SAMPLE_SIZE :
+                              (timing_sample_index > 0 ? timing_accumulator / timing_sample_index : 0);
+    unsigned long avg_letter_interval = letter_interval_count > 0 ? letter_interval_accum / letter_interval_count : 0;
+    const unsigned long idle_window_us = micros() - idle_window_start_us;
+    unsigned long idle_pct = idle_window_us > 0
+        ? (unsigned long)(idle_governor.restedUs() * 100 / idle_window_us) : 0;
+
+    const char* fw_board =
 #ifdef BOARD_V6
-          "v6";
+      "v6";
 #else
-          "v1";
+      "v1";
 #endif
-        snprintf(diagStr, sizeof(diagStr),
-          "%s|fw=%s|mac=%s|loop=%lu|mqtt=%lu|disp=%lu|udp=%lu|nfc=%lu|nfc_max=%lu|nfc_resets=%d|letter_avg=%lu|letter_max=%lu|letter_n=%d|rssi=%d|samples=%d|uptime_ms=%lu",
-          cube_identifier.c_str(), fw_board, WiFi.macAddress().c_str(), avg_total, avg_mqtt, avg_display, avg_udp, avg_nfc,
-          nfc_read_max_us, nfc_reset_count, avg_letter_interval, max_letter_interval, letter_interval_count,
-          WiFi.RSSI(), section_timing_count, millis());
-
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)diagStr, strlen(diagStr));
-        udp.endPacket();
-
-        // Reset auto-sleep timer - active diagnostics should keep cube awake
-        last_activity_time = millis();
-
-        // Reset accumulators after reading
-        section_timing_accum = {0, 0, 0, 0, 0};
-        section_timing_count = 0;
-        letter_interval_accum = 0;
-        letter_interval_count = 0;
-        max_letter_interval = 0;
-        nfc_read_max_us = 0;
-      }
-      // Check if message is "chip" - return ESP32 chip info
-      else if (slotIsResolved() && strcmp(udpBuffer, "chip") == 0) {
-        esp_chip_info_t chip_info;
-        esp_chip_info(&chip_info);
-
-        char chipStr[128];
-        snprintf(chipStr, sizeof(chipStr),
-          "%s|model=%d|cores=%d|revision=%d|features=%lu",
-          cube_identifier.c_str(), chip_info.model, chip_info.cores,
-          chip_info.revision, chip_info.features);
-
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)chipStr, strlen(chipStr));
-        udp.endPacket();
-
-        Serial.printf("Sent chip info to %s:%d: %s\n",
-                      udp.remoteIP().toString().c_str(), udp.remotePort(), chipStr);
-      }
-      // Check if message is "temp" - return cube_id:temperature_celsius
-      else if (slotIsResolved() && strcmp(udpBuffer, "temp") == 0) {
-        // Read internal temperature sensor
-        float temperature_c = temperatureRead();
+    snprintf(diagStr, sizeof(diagStr),
+      "%s|fw=%s|mac=%s|loop=%lu|mqtt=%lu|disp=%lu|disp_max=%lu|frames=%d|disp_drop=%d|pubq=%d|pub_drop=%d|net_drop=%d|connects=%lu|outage_ms=%lu|ready_ms=%lu|walks=%lu|resumes=%lu|idle_pct=%lu|wake_avg_us=%lu|wake_max_us=%lu|wakes=%lu|doze=%d|udp_cmd=%d|udp_cmd_drop=%d|fleet_cmd=%d|fleet_cmd_drop=%d|refresh_hz=%lu|dma=%lu|profile=%s|udp=%lu|nfc=%lu|nfc_max=%lu|nfc_resets=%d|letter_avg=%lu|letter_max=%lu|letter_n=%d|rssi=%d|samples=%d|uptime_ms=%lu",
+      cube_identifier.c_str(), fw_board, WiFi.macAddress().c_str(), avg_total, avg_mqtt, avg_display,
+      render.frame_max_us, render.frames, display_commands_dropped.exchange(0),
+      publish_queue.count(), publishes_dropped, net_dropped.exchange(0),
+      (unsigned long)mqtt_connects, (unsigned long)last_outage_ms, (unsigned long)last_ready_ms,
+      (unsigned long)mqtt_session.walks(), (unsigned long)mqtt_session.resumes(),
+      idle_pct, (unsigned long)idle_governor.wakeLatencyAvgUs(),
+      (unsigned long)idle_governor.wakeLatencyMaxUs(), (unsigned long)idle_governor.wakes(),
+      (int)net_radio_doze.load(),
+      udp_commands_applied, udp_commands_dropped,
+      fleet_commands_applied, fleet_commands_dropped,
+      (unsigned long)display_manager->refreshHz(), (unsigned long)display_manager->dmaBytes(),
+      DISPLAY_PROFILES[saved_display_profile].name, avg_udp, avg_nfc,
+      nfc_read_max_us, nfc_reset_count, avg_letter_interval, max_letter_interval, letter_interval_count,
+      WiFi.RSSI(), section_timing_count, millis());
+
+    sendUdp(remote_ip, remote_port, diagStr);
+
+    // Reset auto-sleep timer - active diagnostics should keep cube awake
+    last_activity_time = millis();
 
-        char tempStr[32];
-        snprintf(tempStr, sizeof(tempStr), "%s:%.1f", cube_identifier.c_str(), temperature_c);
+    // Reset accumulators after reading
+    section_timing_accum = {0, 0};
+    section_timing_count = 0;
+    publishes_dropped = 0;
+    udp_commands_applied = 0;
+    udp_commands_dropped = 0;
+    fleet_commands_applied = 0;
+    fleet_commands_dropped = 0;
+    letter_interval_accum = 0;
+    letter_interval_count = 0;
+    max_letter_interval = 0;
+    nfc_read_max_us = 0;
+    idle_governor.resetStats();
+    idle_window_start_us = micros();
+  }
+  // Check if message is "chip" - return ESP32 chip info
+  else if (slotIsResolved() && strcmp(request, "chip") == 0) {
+    esp_chip_info_t chip_info;
+    esp_chip_info(&chip_info);
 
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)tempStr, strlen(tempStr));
-        udp.endPacket();
+    char chipStr[128];
+    snprintf(chipStr, sizeof(chipStr),
+      "%s|model=%d|cores=%d|revision=%d|features=%lu",
+      cube_identifier.c_str(), chip_info.model, chip_info.cores,
+      chip_info.revision, chip_info.features);
 
-        Serial.printf("Sent temperature to %s:%d: %s\n",
-                      udp.remoteIP().toString().c_str(), udp.remotePort(), tempStr);
-      }
-      // Check if message is "testdebug" - send test UDP debug packet
-      else if (strcmp(udpBuffer, "testdebug") == 0) {
-        const char* testMsg = "debug test: hello from cube";
-        debugSend(testMsg);
-        Serial.printf("Sent debug test\n");
-      }
-      // Check if message is "setdebugip" - set debug destination IP
-      else if (strncmp(udpBuffer, "setdebugip ", 11) == 0) {
-        debugIP = udp.remoteIP();  // Use requester's IP
-        char reply[64];
-        snprintf(reply, sizeof(reply), "debug IP set to %s", debugIP.toString().c_str());
-        udp.beginPacket(udp.remoteIP(), udp.remotePort());
-        udp.write((const uint8_t*)reply, strlen(reply));
-        udp.endPacket();
-        Serial.printf("Debug IP set to %s\n", debugIP.toString().c_str());
-      }
+    sendUdp(remote_ip, remote_port, chipStr);
+
+    Serial.printf("Sent chip info to %s:%d: %s\n",
+                  remote_ip.toString().c_str(), remote_port, chipStr);
+  }
+  // Check if message is "temp" - return cube_id:temperature_celsius
+  else if (slotIsResolved() && strcmp(request, "temp") == 0) {
+    // Read internal temperature sensor
+    float temperature_c = temperatureRead();
+
+    char tempStr[32];
+    snprintf(tempStr, sizeof(tempStr), "%s:%.1f", cube_identifier.c_str(), temperature_c);
+
+    sendUdp(remote_ip, remote_port, tempStr);
+
+    Serial.printf("Sent temperature to %s:%d: %s\n",
+                  remote_ip.toString().c_str(), remote_port, tempStr);
+  }
+  // "wakes" - the wake timeline, as published to cube/device/<mac>/wakes but
+  // with every record the ring holds
+  else if (strcmp(request, "wakes") == 0) {
+    char timeline[1000];
+    if (formatWakeTimeline(timeline, sizeof(timeline), wake_timeline) >= 0) {
+      sendUdp(remote_ip, remote_port, timeline);
+    }
+  }
+  // Check if message is "testdebug" - send test UDP debug packet
+  else if (strcmp(request, "testdebug") == 0) {
+    const char* testMsg = "debug test: hello from cube";
+    debugSend(testMsg);
+    Serial.printf("Sent debug test\n");
+  }
+  // Check if message is "setdebugip" - set debug destination IP
+  else if (strncmp(request, "setdebugip ", 11) == 0) {
+    debugIP = remote_ip;  // Use requester's IP
+    char reply[64];
+    snprintf(reply, sizeof(reply), "debug IP set to %s", debugIP.toString().c_str());
+    sendUdp(remote_ip, remote_port, reply);
+    Serial.printf("Debug IP set to %s\n", debugIP.toString().c_str());
+  }
+}
+
+// The network task's whole job, once per period.
+void networkPass() {
+  serviceWiFiConnection();
+  const bool doze = net_radio_doze.load();
+  if (doze != wifi_radio_dozing && WiFi.status() == WL_CONNECTED) {
+    WiFi.setSleep(doze ? WIFI_PS_MIN_MODEM : WIFI_PS_NONE);
+    wifi_radio_dozing = doze;
+  }
+
+  // A session the last sleep could not end is ended before the client's first
+  // connect can resume it and take delivery of everything queued since. Once:
+  // a broker that refuses the clean connect would refuse the client too.
+  static bool lingering_session_checked = false;
+  if (!lingering_session_checked && WiFi.status() == WL_CONNECTED) {
+    lingering_session_checked = true;
+    if (net_sessions.load() == 0 && mqtt_session_lingering && !mqtt_client.isConnected()) {
+      Serial.println(endMqttSession() ? "MQTT session ended" : "MQTT session end failed");
+    }
+  }
+
+  unsigned long mqtt_start = micros();
+  mqtt_client.loop();
+  const bool connected = mqtt_client.isConnected();
+  if (net_mqtt_connected.exchange(connected) && !connected) {
+    net_session_lost_at.store(millis());
+  }
+  sendNetOutbound(NET_OUTBOUND_BUDGET);
+  unsigned long udp_start = micros();
+  receiveUDP();
+  receiveFleetDatagram();
+  sendUdpOutbound();
+  unsigned long udp_end = micros();
+
+  portENTER_CRITICAL(&net_timing_mux);
+  net_timing.mqtt_us += udp_start - mqtt_start;
+  net_timing.udp_us += udp_end - udp_start;
+  net_timing.passes++;
+  portEXIT_CRITICAL(&net_timing_mux);
+}
+
+void networkTask(void* /*parameter*/) {
+  for (;;) {
+    TaskHandle_t waiter = net_stop_waiter.load();
+    if (waiter != nullptr) {
+      xTaskNotifyGive(waiter);
+      vTaskSuspend(nullptr);
     }
+    networkPass();
+    vTaskDelay(pdMS_TO_TICKS(NET_TASK_PERIOD_MS));
   }
 }
 
+bool startNetworkTask() {
+  net_task_active = true;
+  BaseType_t task_created = xTaskCreatePinnedToCore(
+    networkTask,
+    "network",
+    NET_TASK_STACK,
+    nullptr,
+    NET_TASK_PRIORITY,
+    &net_task_handle,
+    NET_TASK_CORE
+  );
+  if (task_created != pdPASS) {
+    net_task_active = false;
+    net_task_handle = nullptr;
+    Serial.println(F("ERROR: failed to create network task"));
+    return false;
+  }
+  return true;
+}
+
+// Hands the client back to the caller, for the sleep path. The task parks
+// between passes -- never inside mqtt_client.loop() -- and is deleted there.
+// Unlike the render stop, what is queued outbound is kept: the caller is now
+// the consumer of net_outbound, and sends it with sendNetOutbound().
+// True once the task has parked and is gone, and the client and the UDP socket
+// are the caller's. False if it did not park in time: it is then somewhere in
+// a client or lwIP call, possibly holding a socket or TCP lock, so it is left
+// to finish -- it parks when it does -- rather than deleted, and the caller
+// must not touch the client.
+bool stopNetworkTask() {
+  if (!net_task_active) {
+    return true;
+  }
+  net_stop_waiter.store(xTaskGetCurrentTaskHandle());
+  if (ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(NET_STOP_TIMEOUT_MS)) == 0) {
+    Serial.println(F("WARNING: network task did not park"));
+    return false;
+  }
+  vTaskDelete(net_task_handle);
+  net_task_handle = nullptr;
+  net_task_active = false;
+  net_stop_waiter.store(nullptr);
+  return true;
+}
+
 // ============= Main Functions =============
 void setup() {
+  setup_started_ms = millis();
   Serial.begin(115200);
   Serial.setTimeout(0);
 
@@ -2125,6 +4121,8 @@ void setup() {
   mqtt_client.enableDebuggingMessages(false);
   mqtt_client.setMqttConnectionTimeout(MQTT_CONNECTION_TIMEOUT_MS);
   mqtt_client.setMqttReconnectionAttemptDelay(MQTT_RECONNECT_DELAY_MS);
+  // Non-clean session under the stable client ID; see mqtt_session.h.
+  mqtt_client.enableMQTTPersistence();
   mqtt_client.enableOTA();
   
   esp_chip_info_t chip_info;
@@ -2145,6 +4143,7 @@ void setup() {
   // panel is powered later, in the full-wake path, once we commit to waking.
   gpio_deep_sleep_hold_dis();
   gpio_hold_dis(POWER_SWITCH_PIN);
+  stopHallDockWatch();
   pinMode(POWER_SWITCH_PIN, OUTPUT);
   digitalWrite(POWER_SWITCH_PIN, is_timer_wake ? LOW : HIGH);
 
@@ -2167,8 +4166,7 @@ void setup() {
   char boot_id_buf[9];
   snprintf(boot_id_buf, sizeof(boot_id_buf), "%08X", esp_random());
   boot_id = boot_id_buf;
-  mqtt_topic_presence =
-      String("cube/device/") + mac_nocolons + "/presence";
+  topics.setDevice(mac_nocolons.c_str());
   StoredSlot stored = loadStoredSlot();
   authority_latched = stored.authority_latched;
   static String last_will_payload =
@@ -2176,7 +4174,7 @@ void setup() {
       boot_id + "\",\"applied_slot\":" + String(stored.slot) +
       ",\"applied_generation\":" + String(stored.generation) + "}";
   mqtt_client.enableLastWillMessage(
-      mqtt_topic_presence.c_str(), last_will_payload.c_str(), true);
+      topics.get(TOPIC_PRESENCE), last_will_payload.c_str(), true);
 
   String cube_id = String(compiled_cube_id);
 
@@ -2198,9 +4196,7 @@ void setup() {
   // is already up and setupWiFiConnection() above gave it time to settle, so no
   // settle delay is needed.
   if (is_first_boot && esp_reset_reason() == ESP_RST_POWERON) {
-    display_manager = new DisplayManager(cube_id);
-    display_manager->clearDebugDisplay();
-    display_manager->displayDebugMessage(GIT_TIMESTAMP);
+    startDisplay(cube_id);
   }
 
   // Decide whether this wake is a keep-alive check-in or a real wake. On a
@@ -2227,12 +4223,10 @@ void setup() {
   // Already built above on a first boot; a timer or button wake arrives here
   // with nothing on the panel.
   if (display_manager == nullptr) {
-    display_manager = new DisplayManager(cube_id);
-    display_manager->clearDebugDisplay();
-    display_manager->displayDebugMessage(GIT_TIMESTAMP);
+    startDisplay(cube_id);
   }
   delay(DISPLAY_STARTUP_DELAY_MS);
-  display_manager->displayDebugMessage((String("wake:") + String(wakeup_reason)).c_str());
+  postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, String("wake:") + String(wakeup_reason));
   Serial.println(cube_id);
   static String client_name = makeMqttClientId(WiFi.macAddress(), "");
   Serial.println(client_name);
@@ -2240,14 +4234,14 @@ void setup() {
   char ipDisplay[64];
   snprintf(ipDisplay, sizeof(ipDisplay), "%d",
     WiFi.localIP()[3]);
-  display_manager->displayDebugMessage(ipDisplay);
+  postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, ipDisplay);
 
   debugPrintln(WiFi.macAddress().c_str());
 
   if (sensorModeIsMagnets()) {
     debugPrintln("setting up hall neighbor sensors...");
     setupHallSensors();
-    display_manager->displayDebugMessage("hall id");
+    postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, "hall id");
   } else {
     // Self-test: check BUSY pin state before init (should be LOW)
     pinMode(pn5180_busy_pin, INPUT);
@@ -2271,34 +4265,65 @@ void setup() {
     } else {
       snprintf(nfc_test_result, sizeof(nfc_test_result), "nfc %lums", (nfc_test_us + 500) / 1000);
     }
-    display_manager->displayDebugMessage(nfc_test_result);
+    postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, nfc_test_result);
 
     if (!startNfcWorker()) {
-      display_manager->displayDebugMessage("nfc task err");
+      postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, "nfc task err");
     }
   }
 
   debugPrintln("setting up udp...");
   setupUDP(); // Add UDP setup
 
+  loop_wake = xSemaphoreCreateBinary();
+  // Last: from here on the client and the UDP socket are the network task's.
+  if (!startNetworkTask()) {
+    postDisplayCommand(DISPLAY_CMD_DEBUG_MESSAGE, "net task err");
+  }
+
   debugPrintln(F("Setup Complete"));
 }
 
+// The end of each loop() pass: rests once the cube has gone quiet, until the
+// next event or the longest a deadline here may slip.
+static void idleWait() {
+  const unsigned long now = millis();
+  net_radio_doze.store(idle_governor.radioMayDoze(now));
+  // Without the render task loop() draws the frames, and cannot rest.
+  if (render_task_handle == nullptr || loop_wake == nullptr) {
+    return;
+  }
+  const uint32_t max_wait_ms =
+      sensorModeIsMagnets() && slotIsResolved() ? HALL_POLL_INTERVAL_MS : IDLE_MAX_WAIT_MS;
+  const uint32_t wait_ms = idle_governor.waitMs(now, max_wait_ms);
+  if (wait_ms == 0) {
+    return;
+  }
+  const unsigned long rest_start = micros();
+  const bool woken = xSemaphoreTake(loop_wake, pdMS_TO_TICKS(wait_ms)) == pdTRUE;
+  const unsigned long resumed = micros();
+  const unsigned long woken_at = loop_wake_at_us.exchange(0);
+  idle_governor.recordWait(resumed - rest_start, woken,
+                           woken && woken_at != 0 ? resumed - woken_at : 0);
+}
+
 void loop() {
   loop_start_time = micros();
 
   static bool last_hall_present = true;
 
-  serviceWiFiConnection();
-
-  unsigned long section_start = micros();
-  mqtt_client.loop();
-  unsigned long mqtt_end = micros();
-  unsigned long mqtt_us = mqtt_end - section_start;
+  // Without the network task, loop() does its pass itself.
+  if (!net_task_active) {
+    networkPass();
+  }
+  drainNetInbound();
 
-  // Outside the magnets branch: a cube that resolved as a reader is exactly the
-  // one whose stale proximity needs deleting, and it never enters that branch.
-  flushProximityClears();
+  // Outside the sensor branches: a cube that resolved as a reader is exactly the
+  // one whose stale proximity needs deleting, and it never enters the magnets
+  // branch.
+  flushPublishQueue(PUBLISH_FLUSH_BUDGET);
+  checkSessionProbe();
+  checkConnectReady();
 
   if (!slot_resolved && assignment_wait_started != 0 &&
       millis() - assignment_wait_started >= ASSIGNMENT_WAIT_MS) {
@@ -2321,22 +4346,17 @@ void loop() {
 
   esp_task_wdt_reset();  // Feed the watchdog timer
 
-  // Throttle display updates to 30 FPS for improved MQTT responsiveness
+  // Frames are the render task's. Drawn here only if it could not be started,
+  // or after power_test stopped it, at the rate it would have used.
   static unsigned long last_display_update = 0;
   unsigned long current_time = millis();
-  unsigned long display_us = 0;
-  if (current_time - last_display_update >= 33) { // ~30 FPS
-    unsigned long display_start = micros();
+  if (render_task_handle == nullptr &&
+      current_time - last_display_update >= RENDER_FRAME_MS) {
     display_manager->animate(current_time);
     display_manager->updateDisplay(current_time);
     last_display_update = current_time;
-    display_us = micros() - display_start;
   }
 
-  unsigned long udp_start = micros();
-  handleUDP();
-  unsigned long udp_us = micros() - udp_start;
-
   unsigned long nfc_us = 0;
   if (!sensorModeIsMagnets()) {
     NfcWorkerResult worker_result;
@@ -2365,12 +4385,10 @@ void loop() {
       if (read_result == ISO15693_EC_OK) {
         convertNfcIdToHexString(card_id, NFCID_LENGTH, neighbor_id);
         if (strcmp(neighbor_id, last_neighbor_id) != 0) {
+          idle_governor.noteGameActivity(millis());
           debugPrintln(F("New card"));
-          unsigned long publish_start = millis();
-          bool success = mqtt_client.publish(mqtt_topic_cube_nfc, neighbor_id, true);
-          unsigned long publish_end = millis();
-          Serial.printf("[%lu] MQTT publish took %lu ms - payload: %s - success: %d\n", publish_end, publish_end - publish_start, neighbor_id, success);
-          if (success) {
+          Serial.printf("[%lu] nfc -> %s\n", millis(), neighbor_id);
+          if (queuePublish(topics.get(TOPIC_CUBE_NFC), neighbor_id)) {
             strncpy(last_neighbor_id, neighbor_id, sizeof(last_neighbor_id) - 1);
             last_neighbor_id[sizeof(last_neighbor_id) - 1] = '\0';
           }
@@ -2379,11 +4397,7 @@ void loop() {
         // /nfc reflects raw NFC reads with no debouncing (debug-only topic).
         if (strcmp(last_neighbor_id, "-") != 0) {
           debugPrintln(F("No card detected"));
-          unsigned long publish_start = millis();
-          bool success = mqtt_client.publish(mqtt_topic_cube_nfc, "-", true);
-          unsigned long publish_end = millis();
-          Serial.printf("[%lu] MQTT publish took %lu ms - dash payload, success: %d\n", publish_end, publish_end - publish_start, success);
-          if (success) {
+          if (queuePublish(topics.get(TOPIC_CUBE_NFC), "-")) {
             strncpy(last_neighbor_id, "-", sizeof(last_neighbor_id) - 1);
             last_neighbor_id[sizeof(last_neighbor_id) - 1] = '\0';
           }
@@ -2405,7 +4419,7 @@ void loop() {
           const char* tag = (action == NFC_OBS_TAG) ? neighbor_id : "-";
           char payload[160];
           buildObservationPayload(boot_id.c_str(), tag, payload, sizeof(payload));
-          if (mqtt_client.publish(mqtt_topic_device_nfc, payload, true)) {
+          if (queuePublish(topics.get(TOPIC_DEVICE_NFC), payload)) {
             strncpy(last_observation_published, tag,
                     sizeof(last_observation_published) - 1);
             last_observation_published[sizeof(last_observation_published) - 1] = '\0';
@@ -2460,9 +4474,7 @@ void loop() {
             raw_buf[i] = (stable_raw & (1 << i)) ? '1' : '0';
           }
           raw_buf[6] = '\0';
-          if (mqtt_client.isConnected()) {
-            mqtt_client.publish(mqtt_topic_cube + "/hall_debug", raw_buf, true);
-          }
+          queuePublish(topics.get(TOPIC_HALL_DEBUG), raw_buf);
         }
 
         uint8_t id = readHallNeighborId();
@@ -2480,14 +4492,15 @@ void loop() {
             strcpy(buf, "-");  // no/invalid neighbor
           }
 
-          // stable_id may only advance once the broker holds this value, otherwise
-          // a change decided while MQTT is down is never sent: reconnecting
-          // republishes a retained "-" and resets last_right_published, and this
-          // block would no longer see a difference to publish.
+          // stable_id may only advance once this value is queued, otherwise a
+          // change that could not be queued is never sent. Queued is enough:
+          // a reconnect republishes a retained "-" and resets
+          // last_right_published, and this block then queues the value again
+          // behind it.
           if (strcmp(buf, last_right_published) == 0) {
             stable_id = candidate_id;
-          } else if (mqtt_client.isConnected() &&
-                     mqtt_client.publish(mqtt_topic_cube_right, buf, true)) {
+          } else if (queuePublish(topics.get(TOPIC_CUBE_RIGHT), buf)) {
+            idle_governor.noteGameActivity(millis());
             strncpy(last_right_published, buf, sizeof(last_right_published) - 1);
             last_right_published[sizeof(last_right_published) - 1] = '\0';
             stable_id = candidate_id;
@@ -2520,16 +4533,16 @@ void loop() {
                                                   : abs(proximity - published_proximity) >=
                                                         HALL_PROXIMITY_MIN_CHANGE);
         if (proximity_changed &&
-            current_time - last_proximity_publish >= HALL_PROXIMITY_INTERVAL_MS &&
-            mqtt_client.isConnected()) {
+            current_time - last_proximity_publish >= HALL_PROXIMITY_INTERVAL_MS) {
           char proximity_buf[8];
           snprintf(proximity_buf, sizeof(proximity_buf), "%d", proximity);
-          if (mqtt_client.publish(mqtt_topic_cube_proximity, proximity_buf, true)) {
+          if (queuePublish(topics.get(TOPIC_PROXIMITY), proximity_buf)) {
             last_proximity_publish = current_time;
             published_proximity = proximity;
           }
         }
         saved_presence_baseline = hall_presence.baseline();
+        saved_presence_docked = presence_state ? 1 : 0;
         saved_presence_magic = PRESENCE_BASELINE_MAGIC;
 
         static int nvs_presence_baseline = loadPresenceBaseline();
@@ -2555,8 +4568,7 @@ void loop() {
             abs(presence_delta - published_presence_delta) >= HALL_PRESENCE_PUBLISH_MIN_CHANGE;
 
         if (presence_changed &&
-            current_time - last_presence_publish >= HALL_PRESENCE_PUBLISH_INTERVAL_MS &&
-            mqtt_client.isConnected()) {
+            current_time - last_presence_publish >= HALL_PRESENCE_PUBLISH_INTERVAL_MS) {
           char presence_buf[96];
           snprintf(presence_buf, sizeof(presence_buf),
                    "delta=%d on=%d off=%d dist=%d drop=%d base=%d raw=%d active=%d",
@@ -2564,7 +4576,7 @@ void loop() {
                    hallPresenceDistance(presence_delta, HALL_PRESENCE_ON_DELTA),
                    hallPresenceDistance(HALL_PRESENCE_OFF_DELTA, HALL_PRESENCE_ON_DELTA),
                    hall_presence.baseline(), hall_presence.filtered(), presence_state);
-          if (mqtt_client.publish(mqtt_topic_cube + "/hall_presence", presence_buf, true)) {
+          if (queuePublish(topics.get(TOPIC_HALL_PRESENCE), presence_buf)) {
             last_presence_publish = current_time;
             published_presence_delta = presence_delta;
             published_presence_active = presence_state;
@@ -2586,7 +4598,7 @@ void loop() {
       if (hall_present != last_hall_present) {
         last_hall_present = hall_present;
         const char* status = hall_present ? HALL_SENSOR_STATUS_CONNECTED : HALL_SENSOR_STATUS_DISCONNECTED;
-        mqtt_client.publish(mqtt_topic_cube + "/hall_sensor", status, true);
+        queuePublish(topics.get(TOPIC_HALL_SENSOR), status);
         Serial.printf("Hall sensor %s\n", status);
 
         // On hall connect, if NFC still remembers a tag from before, force the
@@ -2614,7 +4626,7 @@ void loop() {
         last_hall_value = hall_value;
         char buf[8];
         snprintf(buf, sizeof(buf), "%d", hall_value);
-        mqtt_client.publish(mqtt_topic_cube + "/hall_analog", buf, true);
+        queuePublish(topics.get(TOPIC_HALL_ANALOG), buf);
         Serial.printf("Hall analog: %d\n", hall_value);
       }
     }
@@ -2622,9 +4634,6 @@ void loop() {
 #endif
 
   // Accumulate per-section timing
-  section_timing_accum.mqtt_us += mqtt_us;
-  section_timing_accum.display_us += display_us;
-  section_timing_accum.udp_us += udp_us;
   section_timing_accum.nfc_us += nfc_us;
   section_timing_count++;
 
@@ -2647,5 +4656,7 @@ void loop() {
   if (timing_sample_index == 0 && !timing_samples_filled) {
     timing_samples_filled = true;
   }
+
+  idleWait();
 }
 // force rebuild
@@ -0,0 +1,110 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Whether an MQTT reconnect can skip re-subscribing. No Arduino dependencies,
+// so it unit-tests natively.
+//
+// Every connect used to walk the whole subscription list again -- some thirty
+// SUBSCRIBE packets -- and the broker answered each with its retained message,
+// so a WiFi blip of a second cost the cube a full replay of every display
+// topic. The client now connects with a persistent (non-clean) session under
+// its stable client ID, and a broker that kept the session still holds every
+// subscription, and queues what was published to them while the cube was
+// away.
+//
+// Whether it did keep the session is CONNACK's session-present flag, which
+// the MQTT client does not expose. So the cube asks: it publishes a token on
+// its own session topic, which the last walk subscribed to. An echo means the
+// subscriptions are in place and the walk is skipped; silence past
+// SESSION_PROBE_TIMEOUT_MS means a fresh session -- a broker restart, or an
+// expired one -- and the walk runs as before.
+//
+// A walk that lost a subscribe on the way (the session dropped with it still
+// queued) cannot be trusted as a baseline, so the caller says whether every
+// subscribe since the last walk went out, and the next connect walks if not.
+// After a reboot or deep sleep there is nothing to resume from: the client's
+// handlers went with RAM, so the first connect always walks.
+static constexpr unsigned long SESSION_PROBE_TIMEOUT_MS = 1000;
+static constexpr size_t SESSION_TOKEN_BYTES = 24;
+
+class MqttSessionTracker {
+ public:
+  // At each connect. True if the probe should be published, with token();
+  // false if the caller must walk the subscriptions now.
+  bool beginConnect(unsigned long now, const char* boot_id, bool subscriptions_intact) {
+    probing_ = walked_ && subscriptions_intact;
+    if (!probing_) {
+      walked_ = true;
+      walks_++;
+      return false;
+    }
+    sent_at_ = now;
+    snprintf(token_, sizeof(token_), "%s-%lu", boot_id, (unsigned long)++probes_);
+    return true;
+  }
+
+  // True if payload is the outstanding probe coming back: the session held.
+  bool probeEchoed(const char* payload) {
+    if (!probing_ || strcmp(payload, token_) != 0) {
+      return false;
+    }
+    probing_ = false;
+    resumes_++;
+    return true;
+  }
+
+  // True once the probe has gone unanswered for too long; the caller walks.
+  bool probeExpired(unsigned long now) {
+    if (!probing_ || now - sent_at_ < SESSION_PROBE_TIMEOUT_MS) {
+      return false;
+    }
+    probing_ = false;
+    walks_++;
+    return true;
+  }
+
+  bool probing() const { return probing_; }
+  const char* token() const { return token_; }
+  uint32_t walks() const { return walks_; }
+  uint32_t resumes() const { return resumes_; }
+
+ private:
+  bool walked_ = false;
+  bool probing_ = false;
+  unsigned long sent_at_ = 0;
+  uint32_t probes_ = 0;
+  uint32_t walks_ = 0;
+  uint32_t resumes_ = 0;
+  char token_[SESSION_TOKEN_BYTES] = "";
+};
+
+// The persistent session is for link drops while the cube is awake. Left open
+// through deep sleep it makes the broker queue every cube/N/+ message for the
+// whole sleep -- letters, images, strings -- and deliver the lot on the next
+// wake, where whatever lands after the walk's subscribes is applied as a live
+// command. So the sleep path ends it: once the session's own connection is
+// closed, a clean-session connect under the same client ID makes the broker
+// discard the session and its queue, and that connection is closed in turn.
+// The session's connection goes first: a clean connect that took it over
+// instead would fire its last will.
+struct SessionEndPorts {
+  virtual ~SessionEndPorts() {}
+  virtual void disconnectSession() = 0;
+  virtual bool connectClean() = 0;
+  virtual void disconnectClean() = 0;
+};
+
+// True once the broker has dropped the session; false leaves it open, for
+// the next wake to end before it connects.
+inline bool endPersistentSession(SessionEndPorts& ports) {
+  ports.disconnectSession();
+  if (!ports.connectClean()) {
+    return false;
+  }
+  ports.disconnectClean();
+  return true;
+}
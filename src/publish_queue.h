@@ -0,0 +1,113 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Outbound MQTT state, queued and coalesced per topic. No Arduino
+// dependencies, so it unit-tests natively.
+//
+// What the loop publishes is retained state -- proximity, hall presence, the
+// neighbour on cube/right, the tag on cube/device/MAC/nfc -- where only the
+// newest value per topic matters. Publishing it inline put a slow socket
+// straight into loop(), and with it the 1 kHz hall poll; each call site also
+// carried its own retry, keeping its cache unadvanced until a publish went
+// through.
+//
+// post() instead overwrites whatever is still waiting for the same topic and
+// returns at once, and loop() flushes a few entries per pass. A publish that
+// fails goes to the back and is retried on a later pass, so an accepted post
+// always reaches the broker eventually -- the call site can move its cache on
+// as soon as post() returns true. False means the queue was full or the
+// message too long, and nothing was queued.
+//
+// An overwritten entry keeps its place, so a value that changes every poll is
+// not pushed back behind everything posted since.
+// A first-boot connect alone posts a dozen (subscribeSlotTopics() and the
+// snapshot) before the loop adds its own, so leave room past that.
+static constexpr int PUBLISH_QUEUE_SLOTS = 16;
+static constexpr size_t PUBLISH_TOPIC_MAX = 48;
+// Room for the connect snapshot (state_snapshot.h), the longest payload queued.
+static constexpr size_t PUBLISH_PAYLOAD_MAX = 320;
+
+class PublishQueue {
+ public:
+  bool post(const char* topic, const char* payload, bool retain) {
+    const size_t topic_length = strlen(topic);
+    const size_t payload_length = strlen(payload);
+    if (topic_length == 0 || topic_length >= PUBLISH_TOPIC_MAX ||
+        payload_length >= PUBLISH_PAYLOAD_MAX) {
+      return false;
+    }
+    Entry* entry = find(topic);
+    if (entry == nullptr) {
+      entry = find("");
+      if (entry == nullptr) return false;
+      memcpy(entry->topic, topic, topic_length + 1);
+      entry->order = next_order_++;
+      count_++;
+    }
+    memcpy(entry->payload, payload, payload_length + 1);
+    entry->retain = retain;
+    return true;
+  }
+
+  // Publishes up to budget entries, oldest first, through
+  // publish(topic, payload, retain) -> bool. Stops at the first failure, which
+  // almost always means the connection rather than the message.
+  template <typename Publish>
+  int flush(int budget, Publish&& publish) {
+    int sent = 0;
+    while (sent < budget) {
+      Entry* entry = oldest();
+      if (entry == nullptr) break;
+      if (!publish(static_cast<const char*>(entry->topic),
+                   static_cast<const char*>(entry->payload), entry->retain)) {
+        entry->order = next_order_++;
+        break;
+      }
+      entry->topic[0] = '\0';
+      count_--;
+      sent++;
+    }
+    return sent;
+  }
+
+  // The payload still waiting for topic, or null.
+  const char* pending(const char* topic) const {
+    for (const Entry& entry : entries_) {
+      if (entry.topic[0] != '\0' && strcmp(entry.topic, topic) == 0) return entry.payload;
+    }
+    return nullptr;
+  }
+
+  int count() const { return count_; }
+
+ private:
+  struct Entry {
+    char topic[PUBLISH_TOPIC_MAX];  // "" for a free slot
+    char payload[PUBLISH_PAYLOAD_MAX];
+    bool retain;
+    uint32_t order;
+  };
+
+  Entry* find(const char* topic) {
+    for (Entry& entry : entries_) {
+      if (strcmp(entry.topic, topic) == 0) return &entry;
+    }
+    return nullptr;
+  }
+
+  Entry* oldest() {
+    Entry* found = nullptr;
+    for (Entry& entry : entries_) {
+      if (entry.topic[0] == '\0') continue;
+      if (found == nullptr || (int32_t)(entry.order - found->order) < 0) found = &entry;
+    }
+    return found;
+  }
+
+  Entry entries_[PUBLISH_QUEUE_SLOTS] = {};
+  uint32_t next_order_ = 0;
+  int count_ = 0;
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+// Images the server uploads once and then shows by id. No Arduino
+// dependencies, so it unit-tests natively.
+//
+// Sprites are kept as they arrived -- encoded as in image_codec.h -- rather
+// than as 8 KB frames: tile art encodes to a few hundred bytes, so a small
+// arena holds every tile a game uses, and decoding into the ingest frame on
+// cube/N/show costs no more than an /imagez would.
+//
+// RAM only. A cube that reboots or wakes from deep sleep comes back empty, and
+// says so the first time it is asked to show a sprite it does not have.
+static constexpr size_t SPRITE_ARENA_BYTES = 16384;
+static constexpr int SPRITE_SLOTS = 32;
+
+class SpriteStore {
+ public:
+  // Replaces whatever id held. False when id is out of range, the payload is
+  // empty, or it does not fit alongside everything else -- in which case id no
+  // longer holds its old image either, so a stale sprite is never shown in
+  // place of the one the server meant.
+  bool put(int id, const uint8_t* data, size_t length) {
+    if (id < 0 || id >= SPRITE_SLOTS || length == 0) return false;
+    remove(id);
+    if (length > SPRITE_ARENA_BYTES - used_) return false;
+    memcpy(&arena_[used_], data, length);
+    entries_[id] = Entry{true, (uint16_t)used_, (uint16_t)length};
+    used_ += length;
+    return true;
+  }
+
+  // Compacts behind the removed sprite, so free space is always one block at
+  // the end and put() never fails for fragmentation.
+  void remove(int id) {
+    if (id < 0 || id >= SPRITE_SLOTS || !entries_[id].used) return;
+    const size_t offset = entries_[id].offset;
+    const size_t length = entries_[id].length;
+    memmove(&arena_[offset], &arena_[offset + length], used_ - offset - length);
+    used_ -= length;
+    entries_[id].used = false;
+    for (int i = 0; i < SPRITE_SLOTS; i++) {
+      if (entries_[i].used && entries_[i].offset > offset) {
+        entries_[i].offset = (uint16_t)(entries_[i].offset - length);
+      }
+    }
+  }
+
+  // The pointer is good until the next put() or remove().
+  bool get(int id, const uint8_t** data, size_t* length) const {
+    if (id < 0 || id >= SPRITE_SLOTS || !entries_[id].used) return false;
+    *data = &arena_[entries_[id].offset];
+    *length = entries_[id].length;
+    return true;
+  }
+
+  size_t bytesUsed() const { return used_; }
+
+  int count() const {
+    int n = 0;
+    for (int i = 0; i < SPRITE_SLOTS; i++) {
+      if (entries_[i].used) n++;
+    }
+    return n;
+  }
+
+ private:
+  struct Entry {
+    bool used;
+    uint16_t offset;
+    uint16_t length;
+  };
+
+  Entry entries_[SPRITE_SLOTS] = {};
+  uint8_t arena_[SPRITE_ARENA_BYTES] = {};
+  size_t used_ = 0;
+};
+
+// The id in a cube/N/show payload: decimal digits only, naming a slot the store
+// has. toInt() read "abc" as 0 and "3x" as 3, so a garbled payload showed
+// sprite 0 -- or reported it missing and had the server upload it again.
+inline bool parseSpriteId(const char* text, int* id) {
+  if (text[0] == '\0') return false;
+  int value = 0;
+  for (const char* p = text; *p != '\0'; p++) {
+    if (*p < '0' || *p > '9') return false;
+    value = value * 10 + (*p - '0');
+    if (value >= SPRITE_SLOTS) return false;
+  }
+  *id = value;
+  return true;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <atomic>
+#include <utility>
+
+// Fixed-size single-producer, single-consumer ring. No Arduino dependencies,
+// so it unit-tests natively.
+//
+// One task pushes and one other task pops, and neither ever blocks the other:
+// head_ is written only by the producer and tail_ only by the consumer. The
+// release store of an index publishes the slot it moved past, and the acquire
+// load on the other side is what makes that slot's contents visible -- which
+// holds across the ESP32's two cores, where a FreeRTOS queue would take a
+// spinlock on every send and receive.
+//
+// The indices run free and are masked on use, so every slot is usable and full
+// and empty are told apart by the difference alone. That needs N to be a power
+// of two.
+//
+// Items are moved in and out where they can be, so a ring of Strings hands
+// each buffer across rather than copying it, and a popped slot keeps nothing
+// allocated behind it.
+template <typename T, size_t N>
+class SpscRing {
+  static_assert(N > 0 && (N & (N - 1)) == 0, "SpscRing size must be a power of two");
+
+ public:
+  // Producer side. False when full; the item is not taken, and an rvalue is
+  // left as it was.
+  template <typename U>
+  bool push(U&& item) {
+    const uint32_t head = head_.load(std::memory_order_relaxed);
+    if (head - tail_.load(std::memory_order_acquire) >= N) {
+      return false;
+    }
+    slots_[head & (N - 1)] = std::forward<U>(item);
+    head_.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Consumer side. False when empty; *out is untouched.
+  bool pop(T* out) {
+    const uint32_t tail = tail_.load(std::memory_order_relaxed);
+    if (head_.load(std::memory_order_acquire) == tail) {
+      return false;
+    }
+    *out = std::move(slots_[tail & (N - 1)]);
+    tail_.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Either side may ask, but the answer is only a snapshot: the other side can
+  // move it by the time it is read.
+  size_t size() const {
+    return head_.load(std::memory_order_acquire) - tail_.load(std::memory_order_acquire);
+  }
+
+  bool empty() const { return size() == 0; }
+
+  static constexpr size_t capacity() { return N; }
+
+ private:
+  T slots_[N] = {};
+  std::atomic<uint32_t> head_{0};
+  std::atomic<uint32_t> tail_{0};
+};
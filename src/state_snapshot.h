@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+// The cube's state as one retained message, published on every MQTT connect.
+// No Arduino dependencies, so it unit-tests natively.
+//
+// A connect used to publish each piece of state to its own retained topic --
+// version, sensor_mode, sensor_probe, the NFC and neighbour records, presence
+// -- and an AP blip that bounces every cube a few times turned that into
+// dozens of packets per cube, all at once. The slot-scoped diagnostics now
+// travel together in this one record, on cube/device/<mac>/state; only the
+// topics something still reads on their own keep being published there.
+//
+// It also carries how the previous connect went: how long the session had
+// been down (outage_ms) and how long from the session coming up until
+// everything the connect queued had been sent (ready_ms).
+struct StateSnapshot {
+  const char* boot_id;
+  int slot;
+  uint32_t generation;
+  const char* version;
+  const char* sensor_mode;
+  const char* sensor_probe;
+  uint32_t connects;
+  uint32_t outage_ms;
+  uint32_t ready_ms;
+};
+
+// Copies text into out as the body of a JSON string, escaping what JSON
+// requires. Returns the length written, or -1 if it does not fit.
+inline int appendJsonText(char* out, size_t size, const char* text) {
+  size_t length = 0;
+  for (const char* p = text; *p != '\0'; p++) {
+    const unsigned char c = (unsigned char)*p;
+    const bool escaped = c == '"' || c == '\\';
+    if (c < 0x20) continue;  // Nothing here should carry control characters.
+    if (length + (escaped ? 2 : 1) >= size) return -1;
+    if (escaped) out[length++] = '\\';
+    out[length++] = (char)c;
+  }
+  out[length] = '\0';
+  return (int)length;
+}
+
+// Returns the length written, or -1 if the snapshot does not fit in size.
+inline int formatStateSnapshot(char* out, size_t size, const StateSnapshot& state) {
+  char probe[80];
+  if (appendJsonText(probe, sizeof(probe), state.sensor_probe) < 0) return -1;
+  const int length = snprintf(
+      out, size,
+      "{\"protocol\":1,\"boot_id\":\"%s\",\"slot\":%d,\"generation\":%lu,"
+      "\"version\":\"%s\",\"sensor_mode\":\"%s\",\"sensor_probe\":\"%s\","
+      "\"connects\":%lu,\"outage_ms\":%lu,\"ready_ms\":%lu}",
+      state.boot_id, state.slot, (unsigned long)state.generation, state.version,
+      state.sensor_mode, probe, (unsigned long)state.connects,
+      (unsigned long)state.outage_ms, (unsigned long)state.ready_ms);
+  return (length < 0 || (size_t)length >= size) ? -1 : length;
+}
@@ -0,0 +1,139 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+#include "display_region.h"
+
+// Status text drawn over whatever else is on the panel. No Arduino
+// dependencies, so it unit-tests natively.
+//
+// displayDebugMessage() used to print straight into the DMA buffers, once into
+// each with a flip in between so the text survived the next swap. Every boot
+// line cost a forced flip, and the compositor knew nothing about the text, so
+// the first real frame either wiped it or had to repaint the whole panel. As a
+// layer of its own the text is just one more footprint in updateDisplay(): a
+// line costs a band of the next frame, and it stays up alongside a letter or
+// an image until it is cleared or expires.
+//
+// Laid out exactly as the old direct prints were: the built-in 6x8 font, one
+// line per 8px row starting a row down, and a line longer than a row wraps
+// onto the next.
+//
+// Once the panel is full, a new line pushes the oldest one out and the rest
+// move up a row: the newest status is the one worth reading, and dropping it
+// left the panel stuck on whatever filled it first. A line can also be given a
+// lifetime, after which expire() takes it down. Boot lines have none -- they
+// stay until the slot is applied and clears them -- but a status that turns
+// up mid-game would otherwise sit over the letters until the next reboot.
+static constexpr int OVERLAY_MAX_LINES = 7;
+static constexpr int OVERLAY_LINE_CHARS = 20;
+static constexpr int16_t OVERLAY_ROW_HEIGHT = 8;
+static constexpr int16_t OVERLAY_CHAR_WIDTH = 6;
+static constexpr int16_t OVERLAY_TEXT_X = 1;
+
+class StatusOverlay {
+ public:
+  struct Line {
+    int16_t y;
+    int16_t rows;
+    bool expires;
+    uint32_t expires_at_ms;
+    char text[OVERLAY_LINE_CHARS + 1];
+  };
+
+  // Appends text below the last line, truncated to two rows, evicting the
+  // oldest lines until it fits. lifetime_ms 0 keeps it until clear(). Returns
+  // the band to repaint: the new line's, or everything the lines covered
+  // before and after when some moved up.
+  DisplayRect add(const char* text, int16_t panel_width, int16_t panel_height,
+                  uint32_t now_ms = 0, uint32_t lifetime_ms = 0) {
+    char truncated[OVERLAY_LINE_CHARS + 1];
+    strncpy(truncated, text, OVERLAY_LINE_CHARS);
+    truncated[OVERLAY_LINE_CHARS] = '\0';
+    const int16_t rows = rowsFor(truncated, panel_width);
+    if (OVERLAY_ROW_HEIGHT >= panel_height) {
+      return DisplayRect{0, 0, 0, 0};
+    }
+
+    const DisplayRect before = bounds(panel_width, panel_height);
+    bool moved = false;
+    // Room for all of the new line's rows, not just its first: a wrapped line
+    // on the last free row would lose its second row off the bottom.
+    while (count_ > 0 && (count_ >= OVERLAY_MAX_LINES ||
+                          OVERLAY_ROW_HEIGHT * (next_row_ + rows) >= panel_height)) {
+      remove(0);
+      moved = true;
+    }
+
+    Line& line = lines_[count_++];
+    line.y = (int16_t)(OVERLAY_ROW_HEIGHT * (next_row_ + 1));
+    line.rows = rows;
+    line.expires = lifetime_ms != 0;
+    line.expires_at_ms = now_ms + lifetime_ms;
+    memcpy(line.text, truncated, sizeof(line.text));
+    next_row_ = (int16_t)(next_row_ + rows);
+    if (moved) {
+      return rectUnion(before, bounds(panel_width, panel_height));
+    }
+    return rectClip(DisplayRect{0, line.y, panel_width, (int16_t)(rows * OVERLAY_ROW_HEIGHT)},
+                    panel_width, panel_height);
+  }
+
+  // Takes down every line whose lifetime has run out. Returns what the lines
+  // covered before, which holds everything that changed; empty when none had.
+  DisplayRect expire(uint32_t now_ms, int16_t panel_width, int16_t panel_height) {
+    const DisplayRect before = bounds(panel_width, panel_height);
+    bool removed = false;
+    for (int i = count_ - 1; i >= 0; i--) {
+      if (lines_[i].expires && (int32_t)(now_ms - lines_[i].expires_at_ms) >= 0) {
+        remove(i);
+        removed = true;
+      }
+    }
+    return removed ? before : DisplayRect{0, 0, 0, 0};
+  }
+
+  // Everything the lines cover, for the caller to repaint before forgetting
+  // them.
+  DisplayRect bounds(int16_t panel_width, int16_t panel_height) const {
+    if (count_ == 0) {
+      return DisplayRect{0, 0, 0, 0};
+    }
+    const int16_t top = lines_[0].y;
+    const int16_t bottom = (int16_t)(OVERLAY_ROW_HEIGHT * (next_row_ + 1));
+    return rectClip(DisplayRect{0, top, panel_width, (int16_t)(bottom - top)},
+                    panel_width, panel_height);
+  }
+
+  void clear() {
+    count_ = 0;
+    next_row_ = 0;
+  }
+
+  int count() const { return count_; }
+  const Line& operator[](int i) const { return lines_[i]; }
+
+ private:
+  static int16_t rowsFor(const char* text, int16_t panel_width) {
+    const int16_t pixels = (int16_t)(OVERLAY_TEXT_X + OVERLAY_CHAR_WIDTH * (int16_t)strlen(text));
+    return pixels > panel_width ? 2 : 1;
+  }
+
+  // Drops line i and moves the ones below it up into its rows.
+  void remove(int i) {
+    for (int j = i; j + 1 < count_; j++) {
+      lines_[j] = lines_[j + 1];
+    }
+    count_--;
+    next_row_ = 0;
+    for (int j = 0; j < count_; j++) {
+      lines_[j].y = (int16_t)(OVERLAY_ROW_HEIGHT * (next_row_ + 1));
+      next_row_ = (int16_t)(next_row_ + lines_[j].rows);
+    }
+  }
+
+  Line lines_[OVERLAY_MAX_LINES] = {};
+  int count_ = 0;
+  int16_t next_row_ = 0;
+};
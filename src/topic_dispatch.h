@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stddef.h>
+#include <string.h>
+
+// Routing for the per-cube MQTT topics. No Arduino dependencies, so it
+// unit-tests natively.
+//
+// Every cube/N/<suffix> topic used to be its own subscription with its own
+// std::function, each a heap-allocated closure, and the MQTT client walked
+// that whole list comparing full topic strings for each message that came in.
+// Instead the cube takes one cube/N/+ subscription and looks the suffix up in
+// a fixed table: a binary search over string constants, nothing allocated,
+// and a reconnect re-subscribes one topic rather than twenty.
+//
+// The table has to be sorted by suffix for the search to work, which
+// topicRoutesSorted() lets a static_assert check where the table is written.
+// Written as single-return recursion so that it is constexpr under C++11.
+template <typename Handler>
+struct TopicRoute {
+  const char* suffix;
+  Handler handler;
+  // Whether a message here counts as someone using the cube, for auto-sleep.
+  bool counts_as_activity;
+};
+
+constexpr int topicCompare(const char* a, const char* b) {
+  return (*a != *b || *a == '\0')
+      ? (int)(unsigned char)*a - (int)(unsigned char)*b
+      : topicCompare(a + 1, b + 1);
+}
+
+template <typename Handler>
+constexpr bool topicRoutesSorted(const TopicRoute<Handler>* routes, size_t count) {
+  return count < 2 ||
+         (topicCompare(routes[0].suffix, routes[1].suffix) < 0 &&
+          topicRoutesSorted(routes + 1, count - 1));
+}
+
+// The route for suffix, or null for a topic the table does not handle.
+template <typename Handler>
+inline const TopicRoute<Handler>* findTopicRoute(const TopicRoute<Handler>* routes,
+                                                 size_t count, const char* suffix) {
+  size_t low = 0;
+  size_t high = count;
+  while (low < high) {
+    const size_t mid = low + (high - low) / 2;
+    const int order = strcmp(suffix, routes[mid].suffix);
+    if (order == 0) return &routes[mid];
+    if (order < 0) {
+      high = mid;
+    } else {
+      low = mid + 1;
+    }
+  }
+  return nullptr;
+}
+
+// The last level of a topic, which is the suffix for a cube/N/+ message: the
+// single-level wildcard guarantees there is nothing after it. Slot-independent,
+// so the network task can use it to drop what no route wants -- the cube's own
+// reports under cube/N/ come straight back on the wildcard -- before a message
+// is copied to loop() or counted as activity there.
+inline const char* topicLastLevel(const char* topic) {
+  const char* slash = strrchr(topic, '/');
+  return slash != nullptr ? slash + 1 : topic;
+}
@@ -0,0 +1,158 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Every MQTT topic the cube publishes or subscribes to under its own names,
+// built once into a fixed arena. No Arduino dependencies, so it unit-tests
+// natively.
+//
+// Topics were concatenated where they were used -- mqtt_topic_cube +
+// "/hall_presence" is a fresh heap String on each publish, and the magnets
+// path polls at 1 kHz -- or held in a String apiece. Here a topic is a
+// TopicId and get() hands back a plain const char*, with nothing allocated
+// after setup.
+//
+// Device topics come first in the arena and are built once from the MAC, so
+// their pointers never move; the MQTT last will keeps the presence topic's.
+// Slot topics follow and are rebuilt together when the slot changes, which
+// invalidates pointers to them -- call get() at the point of use rather than
+// holding on to one.
+enum TopicId : uint8_t {
+  // Device: cube/device/<mac>/..., cube/assign/<mac>
+  TOPIC_ASSIGN,
+  TOPIC_DEVICE_NFC,
+  TOPIC_DEVICE_AUTO_SLEEP,
+  TOPIC_DEVICE_STATUS,
+  TOPIC_DEVICE_STATE,
+  TOPIC_DEVICE_SESSION,
+  TOPIC_DEVICE_WAKES,
+  TOPIC_PRESENCE,
+  TOPIC_LIVENESS_REQUEST,
+  TOPIC_LIVENESS_RESPONSE,
+  // Slot: cube/<slot>/...
+  TOPIC_CUBE,
+  TOPIC_CUBE_ALL,
+  TOPIC_AUTO_SLEEP,
+  TOPIC_ECHO,
+  TOPIC_VERSION,
+  TOPIC_SPRITE_MISSING,
+  TOPIC_PROXIMITY,
+  TOPIC_HALL_DEBUG,
+  TOPIC_HALL_PRESENCE,
+  TOPIC_HALL_SENSOR,
+  TOPIC_HALL_ANALOG,
+  // Slot, outside cube/<slot>/
+  TOPIC_CUBE_NFC,
+  TOPIC_GAME_NFC,
+  TOPIC_CUBE_RIGHT,
+  TOPIC_COUNT
+};
+static constexpr int TOPIC_FIRST_SLOT = TOPIC_CUBE;
+
+// %s is the device or slot id.
+static const char* const TOPIC_FORMATS[TOPIC_COUNT] = {
+  "cube/assign/%s",
+  "cube/device/%s/nfc",
+  "cube/device/%s/auto_sleep",
+  "cube/device/%s/status",
+  "cube/device/%s/state",
+  "cube/device/%s/session",
+  "cube/device/%s/wakes",
+  "cube/device/%s/presence",
+  "cube/device/%s/liveness-request",
+  "cube/device/%s/liveness-response",
+  "cube/%s",
+  "cube/%s/+",
+  "cube/%s/auto_sleep",
+  "cube/%s/echo",
+  "cube/%s/version",
+  "cube/%s/sprite_missing",
+  "cube/%s/proximity",
+  "cube/%s/hall_debug",
+  "cube/%s/hall_presence",
+  "cube/%s/hall_sensor",
+  "cube/%s/hall_analog",
+  "cube/nfc/%s",
+  "game/nfc/%s",
+  "cube/right/%s",
+};
+
+static constexpr size_t TOPIC_ARENA_BYTES = 1024;
+static constexpr size_t TOPIC_ID_MAX = 16;
+
+class TopicRegistry {
+ public:
+  TopicRegistry() {
+    for (int id = 0; id < TOPIC_COUNT; id++) offsets_[id] = EMPTY;
+  }
+
+  // Builds the device topics. Once, before any slot: it is what fixes where
+  // the slot topics start. False, with nothing built, if they do not fit.
+  bool setDevice(const char* device_id) {
+    used_ = 0;
+    slot_[0] = '\0';
+    for (int id = 0; id < TOPIC_COUNT; id++) offsets_[id] = EMPTY;
+    if (!build(0, TOPIC_FIRST_SLOT, device_id)) {
+      for (int id = 0; id < TOPIC_COUNT; id++) offsets_[id] = EMPTY;
+      used_ = 0;
+      return false;
+    }
+    device_end_ = used_;
+    return true;
+  }
+
+  // Rebuilds every slot topic for slot_id. False, with every slot topic empty,
+  // if they do not fit.
+  bool setSlot(const char* slot_id) {
+    used_ = device_end_;
+    for (int id = TOPIC_FIRST_SLOT; id < TOPIC_COUNT; id++) offsets_[id] = EMPTY;
+    slot_[0] = '\0';
+    if (strlen(slot_id) >= TOPIC_ID_MAX || !build(TOPIC_FIRST_SLOT, TOPIC_COUNT, slot_id)) {
+      for (int id = TOPIC_FIRST_SLOT; id < TOPIC_COUNT; id++) offsets_[id] = EMPTY;
+      used_ = device_end_;
+      return false;
+    }
+    strncpy(slot_, slot_id, TOPIC_ID_MAX - 1);
+    slot_[TOPIC_ID_MAX - 1] = '\0';
+    return true;
+  }
+
+  // Empties one topic until the next rebuild, the way a String topic was set
+  // to "" to mean there is nothing to publish to.
+  void clear(TopicId id) { offsets_[id] = EMPTY; }
+
+  // Never null; "" for a topic not built or cleared.
+  const char* get(TopicId id) const {
+    return offsets_[id] == EMPTY ? "" : &arena_[offsets_[id]];
+  }
+
+  bool has(TopicId id) const { return offsets_[id] != EMPTY; }
+
+  // The slot id the slot topics were last built for, or "".
+  const char* slot() const { return slot_; }
+
+  size_t bytesUsed() const { return used_; }
+
+ private:
+  static constexpr uint16_t EMPTY = 0xFFFF;
+
+  bool build(int first, int last, const char* id_text) {
+    for (int id = first; id < last; id++) {
+      const size_t room = TOPIC_ARENA_BYTES - used_;
+      const int length = snprintf(&arena_[used_], room, TOPIC_FORMATS[id], id_text);
+      if (length < 0 || (size_t)length >= room) return false;
+      offsets_[id] = (uint16_t)used_;
+      used_ += (size_t)length + 1;
+    }
+    return true;
+  }
+
+  char arena_[TOPIC_ARENA_BYTES] = {};
+  uint16_t offsets_[TOPIC_COUNT] = {};
+  size_t used_ = 0;
+  size_t device_end_ = 0;
+  char slot_[TOPIC_ID_MAX] = {};
+};
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Display commands over UDP, for the ones where latency matters most. No
+// Arduino dependencies, so it unit-tests natively.
+//
+// A /letter goes server -> broker -> cube over two TCP connections, and one
+// lost segment holds up everything behind it on either. The same commands can
+// instead be sent straight to the cube's UDP_PORT, framed exactly as for
+// cube/N/cmd (command_frame.h) behind a short header:
+//
+//   [0xCB][version][slot][epoch, 2 bytes][sequence, 4 bytes][frame ...]
+//
+// Multi-byte fields are big-endian. The first byte is outside ASCII, so a
+// command is never mistaken for one of the text requests (ping, diag, ...)
+// that share the port.
+//
+// UDP may drop, duplicate or reorder, so each datagram carries a sequence
+// number the sender increments per cube, and one not newer than the last
+// accepted is dropped: a letter that arrives after its successor must not
+// overwrite it. Dropping is safe because retained state still goes over MQTT,
+// which remains the fallback for anything that has to arrive. The epoch is
+// the sender's run: a restarted server starts its sequence again under a new
+// epoch rather than being ignored until it catches up.
+//
+// Epochs are ordered too, as 16-bit serial numbers (RFC 1982), so only a newer
+// one restarts the sequence. Taking any change as a restart let a straggler
+// from the previous run, still in flight when the new one began, reset the
+// filter and open the way for every reordered datagram behind it. The sender
+// numbers its runs from the clock in 100 ms ticks (tools/udp_command.py), so a
+// restart is always newer -- unless it comes more than half the epoch space
+// (about 109 minutes) after the last run the cube heard, when it would compare
+// as older. So the filter forgets its sender after UDP_SENDER_IDLE_MS without
+// an accepted datagram: a straggler arrives within moments of its successor,
+// not minutes.
+//
+// slot is the slot the sender meant, so a datagram for a cube's previous slot,
+// or one sent to an address that has since changed hands, is dropped too.
+static constexpr uint8_t UDP_COMMAND_MAGIC = 0xCB;
+static constexpr uint8_t UDP_COMMAND_VERSION = 1;
+static constexpr size_t UDP_COMMAND_HEADER_BYTES = 9;
+static constexpr uint32_t UDP_SENDER_IDLE_MS = 60000;
+
+struct UdpCommandHeader {
+  uint8_t slot;
+  uint16_t epoch;
+  uint32_t sequence;
+};
+
+inline bool isUdpCommand(const uint8_t* data, size_t length) {
+  return length >= 1 && data[0] == UDP_COMMAND_MAGIC;
+}
+
+// False for a datagram too short, or from a version this firmware does not
+// speak. The frame follows the header, at data + UDP_COMMAND_HEADER_BYTES.
+inline bool parseUdpCommandHeader(const uint8_t* data, size_t length,
+                                  UdpCommandHeader* out) {
+  if (length < UDP_COMMAND_HEADER_BYTES || data[0] != UDP_COMMAND_MAGIC ||
+      data[1] != UDP_COMMAND_VERSION) {
+    return false;
+  }
+  out->slot = data[2];
+  out->epoch = (uint16_t)((data[3] << 8) | data[4]);
+  out->sequence = ((uint32_t)data[5] << 24) | ((uint32_t)data[6] << 16) |
+                  ((uint32_t)data[7] << 8) | (uint32_t)data[8];
+  return true;
+}
+
+// Newest-wins over one sender's epoch, then its sequence. Both are compared as
+// a signed difference, so either may wrap.
+class UdpSequenceFilter {
+ public:
+  bool accept(uint16_t epoch, uint32_t sequence, uint32_t now_ms) {
+    if (started_ && now_ms - accepted_at_ms_ < UDP_SENDER_IDLE_MS) {
+      const int16_t epoch_delta = (int16_t)(uint16_t)(epoch - epoch_);
+      if (epoch_delta < 0 ||
+          (epoch_delta == 0 && (int32_t)(sequence - last_) <= 0)) {
+        return false;
+      }
+    }
+    started_ = true;
+    epoch_ = epoch;
+    last_ = sequence;
+    accepted_at_ms_ = now_ms;
+    return true;
+  }
+
+ private:
+  bool started_ = false;
+  uint16_t epoch_ = 0;
+  uint32_t last_ = 0;
+  uint32_t accepted_at_ms_ = 0;
+};
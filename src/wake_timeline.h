@@ -0,0 +1,103 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+// Where the time goes in each wake, kept across deep sleep. No Arduino
+// dependencies, so it unit-tests natively.
+//
+// A keep-alive pulse left nothing behind but a couple of debug lines, which
+// only reach a listener that happened to be running, so there was no way to
+// say how long the radio is up per pulse, or whether a check-in change made
+// that shorter. Each wake now fills one record with the millis() at which
+// each phase of the check-in ended, and the records ring in RTC memory until
+// a full wake publishes them (cube/device/<mac>/wakes) or a UDP "wakes" query
+// asks.
+//
+// Plain data so it stays in RTC memory: a constructor would run on every wake
+// and wipe it. The bootloader zeroes it on a cold boot, which is an empty
+// ring.
+enum WakePhase : uint8_t {
+  WAKE_PHASE_BOOT,   // setup() started
+  WAKE_PHASE_WIFI,   // associated, or gave up
+  WAKE_PHASE_MQTT,   // check-in connect done; never reached over the datagram
+  WAKE_PHASE_FLAGS,  // sleep flags read, confirmed or not
+  WAKE_PHASE_SLEEP,  // about to enter deep sleep
+  WAKE_PHASE_COUNT
+};
+
+// WakeRecord::flags
+static constexpr uint8_t WAKE_FLAG_CACHED_WIFI = 0x01;  // directed association
+static constexpr uint8_t WAKE_FLAG_DATAGRAM = 0x02;     // flags read over UDP
+static constexpr uint8_t WAKE_FLAG_CONFIRMED = 0x04;    // flags read was confirmed
+static constexpr uint8_t WAKE_FLAG_WOKE = 0x08;         // went on to a full wake
+
+// Milliseconds since boot, saturating; 0 is a phase the wake never reached.
+// A full wake's sleep phase saturates, which is fine: it is the pulses this
+// is for.
+struct WakeRecord {
+  uint32_t seq;
+  uint8_t reason;  // WakeReason
+  uint8_t flags;
+  uint16_t phase_ms[WAKE_PHASE_COUNT];
+};
+
+static constexpr size_t WAKE_TIMELINE_RECORDS = 16;
+
+struct WakeTimeline {
+  uint32_t next_seq;  // also the number of wakes recorded since a cold boot
+  WakeRecord records[WAKE_TIMELINE_RECORDS];
+};
+
+// Starts the record for this wake, overwriting the oldest.
+inline WakeRecord* beginWakeRecord(WakeTimeline* timeline, uint8_t reason) {
+  WakeRecord* record = &timeline->records[timeline->next_seq % WAKE_TIMELINE_RECORDS];
+  memset(record, 0, sizeof(*record));
+  record->seq = timeline->next_seq++;
+  record->reason = reason;
+  return record;
+}
+
+inline void markWakePhase(WakeRecord* record, WakePhase phase, uint32_t now_ms) {
+  if (record == nullptr) return;
+  record->phase_ms[phase] = now_ms >= 0xFFFF ? 0xFFFF : now_ms == 0 ? 1 : (uint16_t)now_ms;
+}
+
+// The newest `count` records, oldest first, as
+//   {"protocol":1,"last":<seq>,"wakes":[[reason,flags,boot,wifi,mqtt,flags,sleep],...]}
+// with the phases in WakePhase order. "last" is the newest record's seq, so a
+// reader can tell a repeat from new wakes. Returns the length, or -1 if it
+// does not fit.
+inline int formatWakeTimelineRecords(char* out, size_t size, const WakeTimeline& timeline,
+                                     size_t count) {
+  const uint32_t recorded = timeline.next_seq;
+  const size_t held = recorded < WAKE_TIMELINE_RECORDS ? recorded : WAKE_TIMELINE_RECORDS;
+  if (count > held) count = held;
+  int length = snprintf(out, size, "{\"protocol\":1,\"last\":%ld,\"wakes\":[",
+                        recorded == 0 ? -1L : (long)(recorded - 1));
+  for (size_t i = 0; i < count && length >= 0 && (size_t)length < size; i++) {
+    const WakeRecord& record =
+        timeline.records[(recorded - count + i) % WAKE_TIMELINE_RECORDS];
+    const int added = snprintf(
+        out + length, size - length, "%s[%u,%u,%u,%u,%u,%u,%u]", i == 0 ? "" : ",",
+        record.reason, record.flags, record.phase_ms[WAKE_PHASE_BOOT],
+        record.phase_ms[WAKE_PHASE_WIFI], record.phase_ms[WAKE_PHASE_MQTT],
+        record.phase_ms[WAKE_PHASE_FLAGS], record.phase_ms[WAKE_PHASE_SLEEP]);
+    length = added < 0 ? -1 : length + added;
+  }
+  if (length < 0 || (size_t)length >= size) return -1;
+  const int closed = snprintf(out + length, size - length, "]}");
+  length += closed;
+  return (closed < 0 || (size_t)length >= size) ? -1 : length;
+}
+
+// As many of the newest records as fit in size; fewer is better than none
+// when the destination is a fixed-size publish.
+inline int formatWakeTimeline(char* out, size_t size, const WakeTimeline& timeline) {
+  for (size_t count = WAKE_TIMELINE_RECORDS;; count--) {
+    const int length = formatWakeTimelineRecords(out, size, timeline, count);
+    if (length >= 0 || count == 0) return length;
+  }
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdint.h>
+#include <string.h>
+
+// Where the cube last associated, so the next wake can go straight back to it.
+// No Arduino dependencies, so it unit-tests natively.
+//
+// A plain WiFi.begin() scans every channel for the SSID before it associates,
+// and on a timer wake that scan is most of the radio-on time of the keep-alive
+// pulse. Given the AP's BSSID and channel, begin() skips it. The AP can move
+// channel or be replaced, so a directed attempt that does not associate
+// promptly is abandoned for a full scan and the cached AP forgotten; the next
+// success caches whatever the scan found.
+//
+// Kept in RTC memory by the caller, and plain data so it stays there: a
+// constructor would run on every wake and wipe it.
+struct WifiAssociation {
+  uint8_t bssid[6];
+  int32_t channel;  // 0 when nothing is cached.
+};
+
+inline bool wifiAssociationKnown(const WifiAssociation& cached) {
+  return cached.channel > 0;
+}
+
+// Returns true if the cache changed.
+inline bool rememberWifiAssociation(WifiAssociation* cached, const uint8_t* bssid,
+                                    int32_t channel) {
+  if (bssid == nullptr || channel <= 0) {
+    return false;
+  }
+  if (cached->channel == channel && memcmp(cached->bssid, bssid, sizeof(cached->bssid)) == 0) {
+    return false;
+  }
+  memcpy(cached->bssid, bssid, sizeof(cached->bssid));
+  cached->channel = channel;
+  return true;
+}
+
+inline void forgetWifiAssociation(WifiAssociation* cached) {
+  cached->channel = 0;
+}
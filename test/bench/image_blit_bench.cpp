@@ -0,0 +1,207 @@
+// Host benchmark for DisplayManager::drawImage(): the image slide animation
+// drawn the old way, through drawRGBBitmap(), and the new way, as row runs
+// from forEachImageRun() with black runs left to the clear, as drawImage()
+// does. Not a unit test and not built by `pio test`:
+//
+//   g++ -O2 -std=c++14 test/bench/image_blit_bench.cpp -o /tmp/image_blit_bench
+//   /tmp/image_blit_bench
+//
+// The panel is a stand-in for MatrixPanel_I2S_DMA with the same shape of work:
+// drawPixel() is virtual, bounds-checks, rotates, converts RGB565 to the
+// panel's colour depth and rewrites one bit in every bit plane of the DMA
+// buffer; drawFastHLine() clips and converts once and then does the bit-plane
+// writes for the whole line. Absolute numbers mean nothing on a laptop; the
+// ratio between the two paths is the point, and disp=/disp_max= in the UDP
+// diag report are what to check it against on a cube.
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+#include "../../src/image_blit.h"
+#include "../../src/landing_curve.h"
+
+namespace {
+
+const int16_t W = 64;
+const int16_t H = 64;
+const int COLOR_DEPTH = 8;
+const int ROWS_PER_SCAN = H / 2;
+
+// Virtual, and always called through a pointer the compiler cannot see
+// through, as GFX calls the panel.
+class Panel {
+ public:
+  virtual ~Panel() {}
+  virtual void drawPixel(int16_t x, int16_t y, uint16_t color) = 0;
+  virtual void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) = 0;
+
+  // Adafruit_GFX::drawRGBBitmap(): one virtual writePixel per bitmap pixel,
+  // off-panel ones included.
+  void drawRGBBitmap(int16_t x, int16_t y, const uint16_t* bitmap, int16_t w, int16_t h) {
+    for (int16_t j = 0; j < h; j++, y++) {
+      for (int16_t i = 0; i < w; i++) {
+        drawPixel(x + i, y, bitmap[j * w + i]);
+      }
+    }
+  }
+};
+
+class FakeDmaPanel : public Panel {
+ public:
+  FakeDmaPanel() {
+    for (int i = 0; i < 256; i++) gamma_[i] = (uint8_t)((i * i) / 255);
+  }
+
+  void setRotation(uint8_t r) { rotation_ = r; }
+
+  // updateMatrixDMABuffer(): bounds, rotation and colour conversion for every
+  // pixel, then a read-modify-write of that pixel in each bit plane.
+  void drawPixel(int16_t x, int16_t y, uint16_t color) override {
+    if (x < 0 || x >= W || y < 0 || y >= H) return;
+    if (rotation_ == 2) {
+      x = W - 1 - x;
+      y = H - 1 - y;
+    }
+    uint8_t r, g, b;
+    toRgb888(color, &r, &g, &b);
+    const bool lower = y >= ROWS_PER_SCAN;
+    const int shift = lower ? 3 : 0;
+    uint16_t* cell = &dma_[0][(y % ROWS_PER_SCAN) * W + x];
+    for (int plane = 0; plane < COLOR_DEPTH; plane++, cell += ROWS_PER_SCAN * W) {
+      const uint8_t mask = (uint8_t)(1 << plane);
+      uint16_t v = *cell & ~(uint16_t)(0x7 << shift);
+      if (r & mask) v |= 1 << shift;
+      if (g & mask) v |= 2 << shift;
+      if (b & mask) v |= 4 << shift;
+      *cell = v;
+    }
+  }
+
+  // hlineDMA(): clipped, rotated and converted once for the line; each bit
+  // plane's pattern is worked out once and stamped along it.
+  void drawFastHLine(int16_t x, int16_t y, int16_t w, uint16_t color) override {
+    if (y < 0 || y >= H) return;
+    if (x < 0) { w += x; x = 0; }
+    if (x + w > W) w = W - x;
+    if (w <= 0) return;
+    if (rotation_ == 2) {
+      x = W - x - w;
+      y = H - 1 - y;
+    }
+    uint8_t r, g, b;
+    toRgb888(color, &r, &g, &b);
+    const int shift = y >= ROWS_PER_SCAN ? 3 : 0;
+    const uint16_t keep = ~(uint16_t)(0x7 << shift);
+    uint16_t* row = &dma_[0][(y % ROWS_PER_SCAN) * W + x];
+    for (int plane = 0; plane < COLOR_DEPTH; plane++, row += ROWS_PER_SCAN * W) {
+      const uint8_t mask = (uint8_t)(1 << plane);
+      const uint16_t bits = (uint16_t)((((r & mask) ? 1 : 0) | ((g & mask) ? 2 : 0) |
+                                        ((b & mask) ? 4 : 0)) << shift);
+      for (int16_t i = 0; i < w; i++) row[i] = (row[i] & keep) | bits;
+    }
+  }
+
+  // updateDisplay()'s fillRect(BLACK) over the panel, the same for both paths.
+  void clear() { memset(dma_, 0, sizeof(dma_)); }
+
+  uint32_t checksum() const {
+    uint32_t sum = 0;
+    for (int p = 0; p < COLOR_DEPTH; p++)
+      for (int i = 0; i < ROWS_PER_SCAN * W; i++) sum = sum * 31 + dma_[p][i];
+    return sum;
+  }
+
+ private:
+  // The library's brightness/gamma table is applied per channel.
+  void toRgb888(uint16_t color, uint8_t* r, uint8_t* g, uint8_t* b) const {
+    *r = gamma_[((color >> 11) & 0x1F) << 3];
+    *g = gamma_[((color >> 5) & 0x3F) << 2];
+    *b = gamma_[(color & 0x1F) << 3];
+  }
+
+  uint8_t rotation_ = 0;
+  uint8_t gamma_[256];
+  uint16_t dma_[COLOR_DEPTH][ROWS_PER_SCAN * W] = {};
+};
+
+// A bordered tile with a block letter: the shape of real tile art.
+void makeTile(uint16_t* image) {
+  for (int y = 0; y < H; y++) {
+    for (int x = 0; x < W; x++) {
+      uint16_t c = 0x0000;
+      if (x < 2 || x >= W - 2 || y < 2 || y >= H - 2) c = 0xFDCC;
+      else if (x >= 16 && x < 48 && y >= 12 && y < 52 && (x < 24 || y < 20 || (y >= 28 && y < 36)))
+        c = 0x07E0;
+      image[y * W + x] = c;
+    }
+  }
+}
+
+// Every pixel different from its neighbour: the worst case for runs.
+void makeNoise(uint16_t* image) {
+  uint32_t seed = 12345;
+  for (int i = 0; i < W * H; i++) {
+    seed = seed * 1103515245u + 12345u;
+    image[i] = (uint16_t)((seed >> 16) | 1);
+  }
+}
+
+// The slide as updateDisplay() draws it: the outgoing image at -percent, the
+// incoming one at 100 - percent, for each ~33 ms frame of one landing.
+template <typename Draw>
+double framesPerSecond(const uint16_t* outgoing, const uint16_t* incoming, Draw draw,
+                       uint32_t* checksum) {
+  static LandingCurve curve;
+  curve.bake(364);
+  static FakeDmaPanel fake;
+  fake.setRotation(2);
+  Panel* volatile opaque = &fake;
+  Panel& panel = *opaque;
+  const int landings = 400;
+  int frames = 0;
+  auto start = std::chrono::steady_clock::now();
+  for (int landing = 0; landing < landings; landing++) {
+    for (unsigned long t = 0; t <= ANIMATION_DURATION_MS; t += 33, frames++) {
+      const int percent = curve.at(t);
+      fake.clear();
+      draw(panel, (int16_t)((H * -percent) / 100), outgoing);
+      draw(panel, (int16_t)((H * (100 - percent)) / 100), incoming);
+    }
+  }
+  auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  *checksum = fake.checksum();
+  return frames / elapsed;
+}
+
+void report(const char* name, const uint16_t* outgoing, const uint16_t* incoming) {
+  uint32_t old_sum = 0, new_sum = 0;
+  const double old_fps = framesPerSecond(
+      outgoing, incoming,
+      [](Panel& panel, int16_t row, const uint16_t* image) {
+        panel.drawRGBBitmap(0, row, image, W, H);
+      },
+      &old_sum);
+  const double new_fps = framesPerSecond(
+      outgoing, incoming,
+      [](Panel& panel, int16_t row, const uint16_t* image) {
+        forEachImageRun(image, W, H, 0, row, W, H,
+                        [&panel](int16_t x, int16_t y, int16_t length, uint16_t color) {
+                          if (color != 0x0000) panel.drawFastHLine(x, y, length, color);
+                        });
+      },
+      &new_sum);
+  printf("%-6s drawRGBBitmap %9.0f fps   row runs %9.0f fps   x%.1f%s\n", name, old_fps,
+         new_fps, new_fps / old_fps, old_sum == new_sum ? "" : "   OUTPUT DIFFERS");
+}
+
+}  // namespace
+
+int main() {
+  static uint16_t tile[W * H], blank[W * H], noise[W * H];
+  makeTile(tile);
+  makeNoise(noise);
+  report("tile", blank, tile);
+  report("noise", blank, noise);
+  return 0;
+}
@@ -228,6 +228,45 @@ void test_presence_delta_is_monotonic_with_approach() {
     TEST_ASSERT_TRUE(near_mid < near_close);
 }
 
+// The deep-sleep docking watch is the tracker's decision flattened to raw bounds, so
+// it has to land exactly where the tracker asserts and releases.
+void test_dock_watch_bounds_are_the_tracker_thresholds() {
+    const HallPresenceConfig cfg = test_presence_config();
+    const HallDockWatch asleep_undocked = hallDockWatch(cfg, 2035, false);
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(asleep_undocked, 2035 + 59));
+    TEST_ASSERT_TRUE(hallDockWatchCrossed(asleep_undocked, 2035 + 60));
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(asleep_undocked, 0));
+
+    HallPresenceTracker t; t.begin(cfg, 2035);
+    uint32_t now = 0;
+    settle(t, 2035 + 60, now, 200);
+    TEST_ASSERT_TRUE(t.active());
+
+    // Docked, only the release wakes it, at off_delta rather than on_delta.
+    const HallDockWatch asleep_docked = hallDockWatch(cfg, 2035, true);
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(asleep_docked, 2035 + 30));
+    TEST_ASSERT_TRUE(hallDockWatchCrossed(asleep_docked, 2035 + 29));
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(asleep_docked, 4095));
+    settle(t, 2035 + 29, now, 200);
+    TEST_ASSERT_FALSE(t.active());
+}
+
+void test_dock_watch_follows_direction_and_stays_in_adc_range() {
+    HallPresenceConfig cfg = test_presence_config();
+    cfg.direction = -1;
+    const HallDockWatch undocked = hallDockWatch(cfg, 2035, false);
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(undocked, 2035 - 59));
+    TEST_ASSERT_TRUE(hallDockWatchCrossed(undocked, 2035 - 60));
+    const HallDockWatch docked = hallDockWatch(cfg, 2035, true);
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(docked, 2035 - 30));
+    TEST_ASSERT_TRUE(hallDockWatchCrossed(docked, 2035 - 29));
+
+    // A bound past the ADC's range clamps to one no reading can reach.
+    const HallDockWatch near_top = hallDockWatch(test_presence_config(), 4080, false);
+    TEST_ASSERT_EQUAL(HALL_DOCK_ADC_LIMIT, near_top.wake_at_or_above);
+    TEST_ASSERT_FALSE(hallDockWatchCrossed(near_top, 4095));
+}
+
 // ---------------------------------------------------------------------------
 // Sensor-mode discriminator
 // ---------------------------------------------------------------------------
@@ -342,6 +381,1407 @@ void test_the_active_probe_runs_when_every_line_floats(void) {
 }
 
 // Test functions
+// ---------------------------------------------------------------------------
+// Display dirty regions
+// ---------------------------------------------------------------------------
+
+#include "../../src/display_region.h"
+
+void test_region_merges_overlapping_rects(void) {
+    DirtyRegion r;
+    r.add(DisplayRect{0, 0, 10, 10});
+    r.add(DisplayRect{5, 5, 10, 10});
+    TEST_ASSERT_EQUAL(1, r.count());
+    TEST_ASSERT_EQUAL(0, r[0].x);
+    TEST_ASSERT_EQUAL(15, r[0].w);
+    TEST_ASSERT_EQUAL(15, r[0].h);
+}
+
+void test_region_keeps_opposite_borders_apart(void) {
+    // A north and a south border changing together must not become the whole
+    // panel, which is what a single bounding box would make of them.
+    DirtyRegion r;
+    r.add(DisplayRect{0, 0, 64, 2});
+    r.add(DisplayRect{0, 62, 64, 2});
+    TEST_ASSERT_EQUAL(2, r.count());
+    TEST_ASSERT_FALSE(r.intersects(DisplayRect{10, 10, 40, 40}));
+}
+
+void test_region_ignores_empty_rects(void) {
+    DirtyRegion r;
+    r.add(DisplayRect{5, 5, 0, 10});
+    r.add(rectClip(DisplayRect{0, 70, 64, 10}, 64, 64));
+    TEST_ASSERT_TRUE(r.empty());
+}
+
+void test_region_chains_merges_through_a_bridging_rect(void) {
+    DirtyRegion r;
+    r.add(DisplayRect{0, 0, 4, 4});
+    r.add(DisplayRect{10, 0, 4, 4});
+    TEST_ASSERT_EQUAL(2, r.count());
+    r.add(DisplayRect{2, 0, 10, 2});
+    TEST_ASSERT_EQUAL(1, r.count());
+    TEST_ASSERT_EQUAL(14, r[0].w);
+}
+
+void test_region_folds_into_the_least_growth_when_full(void) {
+    DirtyRegion r;
+    for (int i = 0; i < DirtyRegion::MAX_RECTS; i++) {
+        r.add(DisplayRect{(int16_t)(i * 10), 0, 2, 2});
+    }
+    TEST_ASSERT_EQUAL(DirtyRegion::MAX_RECTS, r.count());
+    r.add(DisplayRect{53, 0, 2, 2});
+    TEST_ASSERT_EQUAL(DirtyRegion::MAX_RECTS, r.count());
+    // Nothing is lost, and the fold went to the neighbour at x=50.
+    TEST_ASSERT_TRUE(r.covers(DisplayRect{50, 0, 5, 2}));
+    TEST_ASSERT_TRUE(r.covers(DisplayRect{0, 0, 2, 2}));
+}
+
+void test_clip_trims_a_glyph_rising_from_below(void) {
+    DisplayRect c = rectClip(DisplayRect{10, 40, 44, 56}, 64, 64);
+    TEST_ASSERT_EQUAL(40, c.y);
+    TEST_ASSERT_EQUAL(24, c.h);
+    TEST_ASSERT_EQUAL(44, c.w);
+}
+
+void test_closure_pulls_in_every_layer_it_touches(void) {
+    // A border change that clips the edge of a glyph has to repaint the whole
+    // glyph, and the glyph then drags in whatever it overlaps in turn.
+    DisplayRect layers[] = {
+        {1, 10, 20, 20},   // glyph overlapping the left border
+        {15, 28, 30, 5},   // text overlapping the glyph but not the border
+        {60, 60, 2, 2},    // orientation dot, touched by nothing
+    };
+    DirtyRegion r;
+    r.add(DisplayRect{0, 0, 2, 64});
+    r.closeOver(layers, 3);
+    TEST_ASSERT_TRUE(r.covers(layers[0]));
+    TEST_ASSERT_TRUE(r.covers(layers[1]));
+    TEST_ASSERT_FALSE(r.intersects(layers[2]));
+}
+
+void test_closure_leaves_untouched_layers_alone(void) {
+    DisplayRect layers[] = {
+        {14, 8, 36, 52},   // glyph at rest
+        {0, 0, 2, 64},     // left border
+    };
+    DirtyRegion r;
+    r.add(DisplayRect{62, 0, 2, 64});  // right border only
+    r.closeOver(layers, 2);
+    TEST_ASSERT_EQUAL(1, r.count());
+    TEST_ASSERT_FALSE(r.intersects(layers[0]));
+    TEST_ASSERT_FALSE(r.intersects(layers[1]));
+}
+
+// ---------------------------------------------------------------------------
+// Glyph span cache
+// ---------------------------------------------------------------------------
+
+#include "../../src/glyph_spans.h"
+
+// genfont.h is plain data behind the Adafruit GFX font types; these match the
+// layout in gfxfont.h, so the real letter font can be checked natively.
+#ifndef PROGMEM
+#define PROGMEM
+#endif
+typedef struct {
+    uint16_t bitmapOffset;
+    uint8_t width;
+    uint8_t height;
+    uint8_t xAdvance;
+    int8_t xOffset;
+    int8_t yOffset;
+} GFXglyph;
+typedef struct {
+    uint8_t* bitmap;
+    GFXglyph* glyph;
+    uint16_t first;
+    uint16_t last;
+    uint8_t yAdvance;
+} GFXfont;
+#include "../../src/genfont.h"
+
+static bool glyphBit(const uint8_t* bits, int width, int x, int y) {
+    int bit = y * width + x;
+    return (bits[bit >> 3] >> (7 - (bit & 7))) & 1;
+}
+
+void test_spans_cover_a_row_in_runs(void) {
+    // 10 wide, 2 rows: 1100111000 / 0000000001 -- the second row starts mid-byte.
+    const uint8_t bits[] = {0xCE, 0x00, 0x10};
+    GlyphSpan spans[8];
+    TEST_ASSERT_EQUAL(3, rasterizeGlyphSpans(bits, 10, 2, spans, 8));
+    TEST_ASSERT_EQUAL(0, spans[0].x); TEST_ASSERT_EQUAL(2, spans[0].len);
+    TEST_ASSERT_EQUAL(4, spans[1].x); TEST_ASSERT_EQUAL(3, spans[1].len);
+    TEST_ASSERT_EQUAL(9, spans[2].x); TEST_ASSERT_EQUAL(1, spans[2].y);
+    TEST_ASSERT_EQUAL(1, spans[2].len);
+}
+
+void test_spans_refuse_a_glyph_that_does_not_fit(void) {
+    const uint8_t bits[] = {0xAA};  // four single-pixel runs
+    GlyphSpan spans[3];
+    TEST_ASSERT_EQUAL(-1, rasterizeGlyphSpans(bits, 8, 1, spans, 3));
+}
+
+void test_spans_reproduce_every_letter_font_glyph_exactly(void) {
+    static GlyphSpan spans[GLYPH_SPAN_CAPACITY];
+    static uint8_t lit[80][64];
+    // By table size, not first..last: the header claims '~' but has no entry
+    // for it.
+    const size_t glyph_count = sizeof(Roboto_Mono_Bold_78Glyphs) / sizeof(GFXglyph);
+    for (size_t c = 0; c < glyph_count; c++) {
+        const GFXglyph& g = Roboto_Mono_Bold_78Glyphs[c];
+        const uint8_t* bits = &Roboto_Mono_Bold_78Bitmaps[g.bitmapOffset];
+        int count = rasterizeGlyphSpans(bits, g.width, g.height, spans, GLYPH_SPAN_CAPACITY);
+        TEST_ASSERT_TRUE_MESSAGE(count >= 0, "glyph exceeds GLYPH_SPAN_CAPACITY");
+        memset(lit, 0, sizeof(lit));
+        for (int i = 0; i < count; i++) {
+            for (int x = spans[i].x; x < spans[i].x + spans[i].len; x++) lit[spans[i].y][x] = 1;
+        }
+        for (int y = 0; y < g.height; y++) {
+            for (int x = 0; x < g.width; x++) {
+                TEST_ASSERT_EQUAL(glyphBit(bits, g.width, x, y), lit[y][x]);
+            }
+        }
+    }
+}
+
+void test_cache_keeps_the_glyph_still_on_screen(void) {
+    static GlyphSpanCache cache;
+    const uint8_t bits[] = {0xFF};
+    TEST_ASSERT_NOT_NULL(cache.insert('A', ' ', bits, 8, 1));
+    TEST_ASSERT_NOT_NULL(cache.insert('B', 'A', bits, 8, 1));
+    // 'C' lands while 'B' is still on screen, so 'A' is the one to go.
+    TEST_ASSERT_NOT_NULL(cache.insert('C', 'B', bits, 8, 1));
+    TEST_ASSERT_NOT_NULL(cache.find('B'));
+    TEST_ASSERT_NOT_NULL(cache.find('C'));
+    TEST_ASSERT_NULL(cache.find('A'));
+}
+
+void test_cache_hit_does_not_rasterize_again(void) {
+    static GlyphSpanCache cache;
+    const uint8_t bits[] = {0xF0};
+    const GlyphSpanCache::Entry* first = cache.insert('A', ' ', bits, 8, 1);
+    const uint8_t other[] = {0x0F};
+    const GlyphSpanCache::Entry* again = cache.insert('A', ' ', other, 8, 1);
+    TEST_ASSERT_TRUE(first == again);
+    TEST_ASSERT_EQUAL(0, again->spans[0].x);
+}
+
+// ---------------------------------------------------------------------------
+// Landing curve
+// ---------------------------------------------------------------------------
+
+#include "../../src/landing_curve.h"
+
+void test_fixed_curve_matches_the_float_reference_for_every_rise(void) {
+    // Every rise the server can send, at every millisecond of the landing. One
+    // ANIMATION_SCALE step of slack covers float rounding at the .5 boundaries;
+    // the fixed-point side is exact.
+    for (uint16_t rise = 1; rise <= ANIMATION_DURATION_MS; rise++) {
+        for (unsigned long t = 0; t <= ANIMATION_DURATION_MS + 10; t++) {
+            TEST_ASSERT_INT_WITHIN(1, bounceOutReference(t, rise), bounceOutFixed(t, rise));
+        }
+    }
+}
+
+void test_fixed_curve_is_continuous_at_the_seam(void) {
+    // At t == rise the travel parabola has arrived and the tail starts at 1.0.
+    TEST_ASSERT_EQUAL(ANIMATION_SCALE, bounceOutFixed(250, 250));
+    TEST_ASSERT_EQUAL(ANIMATION_SCALE, bounceOutFixed(700, 700));
+    TEST_ASSERT_INT_WITHIN(1, ANIMATION_SCALE, bounceOutFixed(249, 250));
+}
+
+void test_fixed_curve_travels_monotonically_until_rise(void) {
+    uint8_t last = 0;
+    for (unsigned long t = 0; t < 600; t++) {
+        uint8_t v = bounceOutFixed(t, 600);
+        TEST_ASSERT_TRUE(v >= last);
+        last = v;
+    }
+    TEST_ASSERT_EQUAL(0, bounceOutFixed(0, 600));
+}
+
+void test_fixed_curve_clamps_an_out_of_range_rise(void) {
+    // rise == duration travels the whole time and never rebounds.
+    TEST_ASSERT_EQUAL(25, bounceOutFixed(500, ANIMATION_DURATION_MS));
+    TEST_ASSERT_EQUAL(bounceOutFixed(500, ANIMATION_DURATION_MS), bounceOutFixed(500, 5000));
+    TEST_ASSERT_EQUAL(bounceOutFixed(10, 1), bounceOutFixed(10, 0));
+}
+
+void test_baked_curve_is_the_fixed_curve(void) {
+    static LandingCurve curve;
+    curve.bake(364);
+    TEST_ASSERT_EQUAL(364, curve.riseMs());
+    for (unsigned long t = 0; t < ANIMATION_DURATION_MS; t++) {
+        TEST_ASSERT_EQUAL(bounceOutFixed(t, 364), curve.at(t));
+    }
+    TEST_ASSERT_EQUAL(ANIMATION_SCALE, curve.at(ANIMATION_DURATION_MS));
+    TEST_ASSERT_EQUAL(ANIMATION_SCALE, curve.at(60000));
+}
+
+void test_rebaking_reshapes_the_curve(void) {
+    static LandingCurve curve;
+    curve.bake(100);
+    uint8_t early = curve.at(90);
+    curve.bake(900);
+    TEST_ASSERT_TRUE(curve.at(90) < early);
+    TEST_ASSERT_EQUAL(bounceOutFixed(90, 900), curve.at(90));
+}
+
+// ---------------------------------------------------------------------------
+// SPSC ring
+// ---------------------------------------------------------------------------
+
+#include <memory>
+#include "../../src/spsc_ring.h"
+
+void test_ring_pops_in_push_order(void) {
+    SpscRing<int, 4> ring;
+    TEST_ASSERT_TRUE(ring.empty());
+    TEST_ASSERT_TRUE(ring.push(1));
+    TEST_ASSERT_TRUE(ring.push(2));
+    TEST_ASSERT_EQUAL(2, ring.size());
+    int out = 0;
+    TEST_ASSERT_TRUE(ring.pop(&out));
+    TEST_ASSERT_EQUAL(1, out);
+    TEST_ASSERT_TRUE(ring.pop(&out));
+    TEST_ASSERT_EQUAL(2, out);
+    TEST_ASSERT_TRUE(ring.empty());
+}
+
+void test_ring_uses_every_slot_and_refuses_when_full(void) {
+    SpscRing<int, 4> ring;
+    for (int i = 0; i < 4; i++) {
+        TEST_ASSERT_TRUE(ring.push(i));
+    }
+    TEST_ASSERT_FALSE(ring.push(99));
+    TEST_ASSERT_EQUAL(4, ring.size());
+    int out = -1;
+    TEST_ASSERT_TRUE(ring.pop(&out));
+    TEST_ASSERT_EQUAL(0, out);
+    TEST_ASSERT_TRUE(ring.push(4));
+}
+
+void test_ring_pop_from_empty_leaves_output_alone(void) {
+    SpscRing<int, 2> ring;
+    int out = 7;
+    TEST_ASSERT_FALSE(ring.pop(&out));
+    TEST_ASSERT_EQUAL(7, out);
+}
+
+void test_ring_wraps_many_times_without_losing_order(void) {
+    SpscRing<uint32_t, 8> ring;
+    uint32_t next_in = 0;
+    uint32_t next_out = 0;
+    // Uneven push and pop batches walk the indices round the ring repeatedly.
+    for (int round = 0; round < 1000; round++) {
+        for (int i = 0; i < (round % 5) + 1; i++) {
+            if (ring.push(next_in)) next_in++;
+        }
+        uint32_t out;
+        for (int i = 0; i < (round % 3) + 1 && ring.pop(&out); i++) {
+            TEST_ASSERT_EQUAL_UINT32(next_out, out);
+            next_out++;
+        }
+    }
+    TEST_ASSERT_EQUAL(next_in - next_out, ring.size());
+}
+
+void test_ring_moves_items_through(void) {
+    SpscRing<std::unique_ptr<int>, 2> ring;
+    std::unique_ptr<int> first(new int(1));
+    std::unique_ptr<int> second(new int(2));
+    std::unique_ptr<int> third(new int(3));
+    TEST_ASSERT_TRUE(ring.push(std::move(first)));
+    TEST_ASSERT_TRUE(first == nullptr);
+    TEST_ASSERT_TRUE(ring.push(std::move(second)));
+    // Refused, so the caller still owns it.
+    TEST_ASSERT_FALSE(ring.push(std::move(third)));
+    TEST_ASSERT_TRUE(third != nullptr);
+
+    std::unique_ptr<int> out;
+    TEST_ASSERT_TRUE(ring.pop(&out));
+    TEST_ASSERT_EQUAL(1, *out);
+    TEST_ASSERT_TRUE(ring.pop(&out));
+    TEST_ASSERT_EQUAL(2, *out);
+}
+
+// ---------------------------------------------------------------------------
+// Compressed images
+// ---------------------------------------------------------------------------
+
+#include "../../src/image_codec.h"
+
+static const size_t TEST_FRAME = 64 * 64;
+
+void test_rle_image_fills_the_frame(void) {
+    // 4096 pixels: sixteen runs of 256, alternating two colours.
+    uint8_t payload[1 + 16 * 3];
+    payload[0] = IMAGE_FORMAT_RLE;
+    for (int i = 0; i < 16; i++) {
+        payload[1 + i * 3] = 255;
+        payload[2 + i * 3] = (i & 1) ? 0x00 : 0xE0;
+        payload[3 + i * 3] = (i & 1) ? 0xF8 : 0x07;
+    }
+    static uint16_t frame[TEST_FRAME];
+    TEST_ASSERT_TRUE(decodeImagePayload(payload, sizeof(payload), frame, TEST_FRAME));
+    TEST_ASSERT_EQUAL_HEX16(0x07E0, frame[0]);
+    TEST_ASSERT_EQUAL_HEX16(0x07E0, frame[255]);
+    TEST_ASSERT_EQUAL_HEX16(0xF800, frame[256]);
+    TEST_ASSERT_EQUAL_HEX16(0xF800, frame[TEST_FRAME - 1]);
+}
+
+void test_rle_image_must_cover_the_frame_exactly(void) {
+    uint8_t payload[1 + 17 * 3];
+    payload[0] = IMAGE_FORMAT_RLE;
+    for (int i = 0; i < 17; i++) {
+        payload[1 + i * 3] = 255;
+        payload[2 + i * 3] = 0x12;
+        payload[3 + i * 3] = 0x34;
+    }
+    static uint16_t frame[TEST_FRAME];
+    frame[0] = 0xBEEF;
+    // One run over, one run short, and a run cut off mid-colour.
+    TEST_ASSERT_FALSE(decodeImagePayload(payload, sizeof(payload), frame, TEST_FRAME));
+    TEST_ASSERT_FALSE(decodeImagePayload(payload, 1 + 15 * 3, frame, TEST_FRAME));
+    TEST_ASSERT_FALSE(decodeImagePayload(payload, 1 + 16 * 3 - 1, frame, TEST_FRAME));
+    // A rejected payload leaves the destination alone.
+    TEST_ASSERT_EQUAL_HEX16(0xBEEF, frame[0]);
+    TEST_ASSERT_TRUE(decodeImagePayload(payload, 1 + 16 * 3, frame, TEST_FRAME));
+    TEST_ASSERT_EQUAL_HEX16(0x3412, frame[0]);
+}
+
+void test_palette_image_packs_indices_at_the_narrowest_width(void) {
+    // Three entries need two bits an index: 4096 pixels in 1024 bytes.
+    static uint8_t payload[1 + 1 + 3 * 2 + TEST_FRAME / 4];
+    payload[0] = IMAGE_FORMAT_PALETTE;
+    payload[1] = 2;
+    const uint8_t palette[] = {0x00, 0x00, 0x1F, 0x00, 0xFF, 0xFF};
+    memcpy(&payload[2], palette, sizeof(palette));
+    uint8_t* indices = &payload[8];
+    memset(indices, 0, TEST_FRAME / 4);
+    indices[0] = 0x1B;  // 00 01 10 11 -> black, blue, white, then index 3
+    static uint16_t frame[TEST_FRAME];
+    // Index 3 is outside a three-entry palette.
+    TEST_ASSERT_FALSE(decodeImagePayload(payload, sizeof(payload), frame, TEST_FRAME));
+    indices[0] = 0x18;  // 00 01 10 00
+    TEST_ASSERT_TRUE(decodeImagePayload(payload, sizeof(payload), frame, TEST_FRAME));
+    TEST_ASSERT_EQUAL_HEX16(0x0000, frame[0]);
+    TEST_ASSERT_EQUAL_HEX16(0x001F, frame[1]);
+    TEST_ASSERT_EQUAL_HEX16(0xFFFF, frame[2]);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, frame[3]);
+    TEST_ASSERT_FALSE(decodeImagePayload(payload, sizeof(payload) - 1, frame, TEST_FRAME));
+}
+
+void test_palette_image_at_eight_bits(void) {
+    static uint8_t payload[1 + 1 + 256 * 2 + TEST_FRAME];
+    payload[0] = IMAGE_FORMAT_PALETTE;
+    payload[1] = 255;
+    for (int i = 0; i < 256; i++) {
+        payload[2 + i * 2] = (uint8_t)i;
+        payload[3 + i * 2] = 0xA0;
+    }
+    for (size_t p = 0; p < TEST_FRAME; p++) {
+        payload[2 + 512 + p] = (uint8_t)(p * 7);
+    }
+    static uint16_t frame[TEST_FRAME];
+    TEST_ASSERT_TRUE(decodeImagePayload(payload, sizeof(payload), frame, TEST_FRAME));
+    for (size_t p = 0; p < TEST_FRAME; p++) {
+        TEST_ASSERT_EQUAL_HEX16(0xA000 | (uint8_t)(p * 7), frame[p]);
+    }
+}
+
+void test_palette_rle_image_is_an_order_of_magnitude_smaller(void) {
+    // A bordered tile: a 2-pixel frame in one colour round a flat interior,
+    // the shape of most tile art. Encoded row by row.
+    uint8_t payload[1024];
+    size_t n = 0;
+    payload[n++] = IMAGE_FORMAT_PALETTE_RLE;
+    payload[n++] = 1;
+    payload[n++] = 0xCC; payload[n++] = 0xFD;  // LETTER_COLOR
+    payload[n++] = 0x00; payload[n++] = 0x00;
+    for (int y = 0; y < 64; y++) {
+        if (y < 2 || y >= 62) {
+            payload[n++] = 63; payload[n++] = 0;
+        } else {
+            payload[n++] = 1; payload[n++] = 0;
+            payload[n++] = 59; payload[n++] = 1;
+            payload[n++] = 1; payload[n++] = 0;
+        }
+    }
+    TEST_ASSERT_TRUE(n * 10 < TEST_FRAME * 2);
+    static uint16_t frame[TEST_FRAME];
+    TEST_ASSERT_TRUE(decodeImagePayload(payload, n, frame, TEST_FRAME));
+    TEST_ASSERT_EQUAL_HEX16(0xFDCC, frame[0]);
+    TEST_ASSERT_EQUAL_HEX16(0xFDCC, frame[64 * 10 + 1]);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, frame[64 * 10 + 2]);
+    TEST_ASSERT_EQUAL_HEX16(0x0000, frame[64 * 10 + 61]);
+    TEST_ASSERT_EQUAL_HEX16(0xFDCC, frame[64 * 10 + 62]);
+
+    payload[7] = 2;  // a run naming an entry the palette does not have
+    TEST_ASSERT_FALSE(decodeImagePayload(payload, n, frame, TEST_FRAME));
+}
+
+void test_unknown_or_empty_image_format_is_rejected(void) {
+    static uint16_t frame[TEST_FRAME];
+    const uint8_t unknown[] = {0x7F, 0x00, 0x00, 0x00};
+    TEST_ASSERT_FALSE(decodeImagePayload(unknown, sizeof(unknown), frame, TEST_FRAME));
+    TEST_ASSERT_FALSE(decodeImagePayload(unknown, 0, frame, TEST_FRAME));
+    const uint8_t header_only[] = {IMAGE_FORMAT_PALETTE, 3, 0x00};
+    TEST_ASSERT_FALSE(decodeImagePayload(header_only, sizeof(header_only), frame, TEST_FRAME));
+}
+
+// ---------------------------------------------------------------------------
+// Image row blitting
+// ---------------------------------------------------------------------------
+
+#include "../../src/image_blit.h"
+
+struct TestCanvas {
+    uint16_t pixels[64 * 64];
+    int runs;
+};
+
+static void blitToCanvas(const uint16_t* image, int16_t x, int16_t y, TestCanvas* canvas) {
+    for (int i = 0; i < 64 * 64; i++) canvas->pixels[i] = 0xDEAD;
+    canvas->runs = 0;
+    forEachImageRun(image, 64, 64, x, y, 64, 64,
+                    [canvas](int16_t rx, int16_t ry, int16_t length, uint16_t color) {
+                        TEST_ASSERT_TRUE(rx >= 0 && rx + length <= 64);
+                        TEST_ASSERT_TRUE(ry >= 0 && ry < 64);
+                        TEST_ASSERT_TRUE(length > 0);
+                        for (int16_t i = 0; i < length; i++) canvas->pixels[ry * 64 + rx + i] = color;
+                        canvas->runs++;
+                    });
+}
+
+void test_row_runs_reproduce_the_bitmap_at_every_slide_offset(void) {
+    static uint16_t image[64 * 64];
+    for (int i = 0; i < 64 * 64; i++) image[i] = (uint16_t)((i / 7) * 0x0841);
+    static TestCanvas canvas;
+    for (int16_t offset = -64; offset <= 64; offset += 5) {
+        blitToCanvas(image, 0, offset, &canvas);
+        // What drawRGBBitmap() would have left: the on-panel part of the image
+        // and nothing else.
+        for (int y = 0; y < 64; y++) {
+            for (int x = 0; x < 64; x++) {
+                const int src = y - offset;
+                const uint16_t expected = (src >= 0 && src < 64) ? image[src * 64 + x] : 0xDEAD;
+                TEST_ASSERT_EQUAL_HEX16(expected, canvas.pixels[y * 64 + x]);
+            }
+        }
+    }
+}
+
+void test_flat_rows_are_one_run_each(void) {
+    static uint16_t image[64 * 64];
+    for (int y = 0; y < 64; y++)
+        for (int x = 0; x < 64; x++) image[y * 64 + x] = y < 32 ? 0xF800 : 0x001F;
+    static TestCanvas canvas;
+    blitToCanvas(image, 0, 0, &canvas);
+    TEST_ASSERT_EQUAL(64, canvas.runs);
+    // Half slid off: only the rows still on the panel are visited.
+    blitToCanvas(image, 0, 48, &canvas);
+    TEST_ASSERT_EQUAL(16, canvas.runs);
+    blitToCanvas(image, 0, -64, &canvas);
+    TEST_ASSERT_EQUAL(0, canvas.runs);
+}
+
+void test_row_runs_clip_horizontally(void) {
+    static uint16_t image[64 * 64];
+    for (int i = 0; i < 64 * 64; i++) image[i] = (uint16_t)(i % 64);
+    static TestCanvas canvas;
+    blitToCanvas(image, -10, 0, &canvas);
+    TEST_ASSERT_EQUAL_HEX16(10, canvas.pixels[0]);
+    TEST_ASSERT_EQUAL_HEX16(63, canvas.pixels[53]);
+    TEST_ASSERT_EQUAL_HEX16(0xDEAD, canvas.pixels[54]);
+    blitToCanvas(image, 70, 0, &canvas);
+    TEST_ASSERT_EQUAL(0, canvas.runs);
+}
+
+// ---------------------------------------------------------------------------
+// Sprite store
+// ---------------------------------------------------------------------------
+
+#include "../../src/sprite_store.h"
+
+void test_sprite_store_returns_what_was_put(void) {
+    static SpriteStore store;
+    const uint8_t a[] = {1, 2, 3};
+    const uint8_t b[] = {9, 8};
+    TEST_ASSERT_TRUE(store.put(4, a, sizeof(a)));
+    TEST_ASSERT_TRUE(store.put(31, b, sizeof(b)));
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    TEST_ASSERT_TRUE(store.get(4, &data, &length));
+    TEST_ASSERT_EQUAL(3, length);
+    TEST_ASSERT_EQUAL_MEMORY(a, data, sizeof(a));
+    TEST_ASSERT_TRUE(store.get(31, &data, &length));
+    TEST_ASSERT_EQUAL_MEMORY(b, data, sizeof(b));
+    TEST_ASSERT_FALSE(store.get(5, &data, &length));
+    TEST_ASSERT_FALSE(store.put(SPRITE_SLOTS, a, sizeof(a)));
+    TEST_ASSERT_FALSE(store.put(-1, a, sizeof(a)));
+    TEST_ASSERT_EQUAL(2, store.count());
+}
+
+void test_sprite_store_compacts_on_replace_and_remove(void) {
+    static SpriteStore store;
+    static uint8_t big[SPRITE_ARENA_BYTES / 4];
+    for (size_t i = 0; i < sizeof(big); i++) big[i] = (uint8_t)i;
+    for (int id = 0; id < 4; id++) {
+        big[0] = (uint8_t)id;
+        TEST_ASSERT_TRUE(store.put(id, big, sizeof(big)));
+    }
+    TEST_ASSERT_EQUAL(SPRITE_ARENA_BYTES, store.bytesUsed());
+    const uint8_t one = 0x55;
+    TEST_ASSERT_FALSE(store.put(10, &one, 1));
+
+    // Freeing a sprite from the middle leaves one block at the end.
+    store.remove(1);
+    TEST_ASSERT_TRUE(store.put(10, big, sizeof(big)));
+    const uint8_t* data = nullptr;
+    size_t length = 0;
+    const int kept[] = {0, 2, 3};
+    for (int id : kept) {
+        TEST_ASSERT_TRUE(store.get(id, &data, &length));
+        TEST_ASSERT_EQUAL(id, data[0]);
+        TEST_ASSERT_EQUAL_MEMORY(big + 1, data + 1, sizeof(big) - 1);
+    }
+
+    // Replacing a sprite frees its old bytes first.
+    TEST_ASSERT_TRUE(store.put(2, &one, 1));
+    TEST_ASSERT_TRUE(store.get(2, &data, &length));
+    TEST_ASSERT_EQUAL(1, length);
+    TEST_ASSERT_EQUAL(0x55, data[0]);
+    TEST_ASSERT_EQUAL(3 * sizeof(big) + 1, store.bytesUsed());
+}
+
+void test_sprite_that_does_not_fit_drops_the_old_one(void) {
+    static SpriteStore store;
+    const uint8_t small[] = {1};
+    static uint8_t huge[SPRITE_ARENA_BYTES + 1];
+    TEST_ASSERT_TRUE(store.put(7, small, sizeof(small)));
+    TEST_ASSERT_FALSE(store.put(7, huge, sizeof(huge)));
+    const uint8_t* data;
+    size_t length;
+    TEST_ASSERT_FALSE(store.get(7, &data, &length));
+    TEST_ASSERT_EQUAL(0, store.bytesUsed());
+}
+
+void test_sprite_id_parses_only_digits_in_range(void) {
+    int id = -1;
+    TEST_ASSERT_TRUE(parseSpriteId("0", &id));
+    TEST_ASSERT_EQUAL(0, id);
+    TEST_ASSERT_TRUE(parseSpriteId("31", &id));
+    TEST_ASSERT_EQUAL(31, id);
+
+    id = -1;
+    TEST_ASSERT_FALSE(parseSpriteId("", &id));
+    TEST_ASSERT_FALSE(parseSpriteId("abc", &id));
+    TEST_ASSERT_FALSE(parseSpriteId("3x", &id));
+    TEST_ASSERT_FALSE(parseSpriteId("-1", &id));
+    TEST_ASSERT_FALSE(parseSpriteId(" 3", &id));
+    TEST_ASSERT_FALSE(parseSpriteId("32", &id));
+    TEST_ASSERT_FALSE(parseSpriteId("99999999999", &id));
+    TEST_ASSERT_EQUAL(-1, id);
+}
+
+// ---------------------------------------------------------------------------
+// Status overlay
+// ---------------------------------------------------------------------------
+
+#include "../../src/status_overlay.h"
+
+void test_status_overlay_lays_lines_out_by_row(void) {
+    StatusOverlay overlay;
+    DisplayRect band = overlay.add("t", 64, 64);
+    TEST_ASSERT_EQUAL(8, band.y);
+    TEST_ASSERT_EQUAL(8, band.h);
+    TEST_ASSERT_EQUAL(64, band.w);
+
+    // Eleven characters no longer fit a row and wrap onto the next.
+    band = overlay.add("wake:timer!", 64, 64);
+    TEST_ASSERT_EQUAL(16, band.y);
+    TEST_ASSERT_EQUAL(16, band.h);
+    band = overlay.add("10", 64, 64);
+    TEST_ASSERT_EQUAL(32, band.y);
+
+    const DisplayRect all = overlay.bounds(64, 64);
+    TEST_ASSERT_EQUAL(8, all.y);
+    TEST_ASSERT_EQUAL(32, all.h);
+    TEST_ASSERT_EQUAL(3, overlay.count());
+    TEST_ASSERT_EQUAL_STRING("wake:timer!", overlay[1].text);
+}
+
+void test_status_overlay_evicts_oldest_when_full(void) {
+    StatusOverlay overlay;
+    overlay.add("0123456789abcdefghijKLMN", 64, 64);
+    TEST_ASSERT_EQUAL_STRING("0123456789abcdefghij", overlay[0].text);
+    for (int i = 0; i < 5; i++) {
+        overlay.add(i == 4 ? "last" : "x", 64, 64);
+    }
+    // Rows 1-7 are taken, so the next line pushes the two-row one out and
+    // everything below it moves up; the repaint covers both layouts.
+    const DisplayRect band = overlay.add("new", 64, 64);
+    TEST_ASSERT_EQUAL(8, band.y);
+    TEST_ASSERT_EQUAL(56, band.h);
+    TEST_ASSERT_EQUAL(6, overlay.count());
+    TEST_ASSERT_EQUAL_STRING("x", overlay[0].text);
+    TEST_ASSERT_EQUAL(8, overlay[0].y);
+    TEST_ASSERT_EQUAL_STRING("last", overlay[4].text);
+    TEST_ASSERT_EQUAL_STRING("new", overlay[5].text);
+    TEST_ASSERT_EQUAL(48, overlay[5].y);
+
+    overlay.clear();
+    TEST_ASSERT_TRUE(rectEmpty(overlay.bounds(64, 64)));
+    TEST_ASSERT_EQUAL(8, overlay.add("x", 64, 64).y);
+}
+
+void test_status_overlay_evicts_for_a_wrapped_line_on_the_last_row(void) {
+    StatusOverlay overlay;
+    const char* filler[] = {"0", "1", "2", "3", "4", "5"};
+    for (int i = 0; i < 6; i++) {
+        overlay.add(filler[i], 64, 64);
+    }
+    // Only row 7 is free, and the line needs two: the oldest goes so that it
+    // lands whole on rows 6-7 rather than half off the panel.
+    overlay.add("wake:timer!", 64, 64);
+    TEST_ASSERT_EQUAL(6, overlay.count());
+    TEST_ASSERT_EQUAL_STRING("1", overlay[0].text);
+    TEST_ASSERT_EQUAL_STRING("wake:timer!", overlay[5].text);
+    TEST_ASSERT_EQUAL(48, overlay[5].y);
+    TEST_ASSERT_EQUAL(2, overlay[5].rows);
+    const DisplayRect all = overlay.bounds(64, 64);
+    TEST_ASSERT_EQUAL(64, all.y + all.h);
+
+    // A one-row line still takes row 7.
+    overlay.clear();
+    for (int i = 0; i < 6; i++) {
+        overlay.add(filler[i], 64, 64);
+    }
+    overlay.add("x", 64, 64);
+    TEST_ASSERT_EQUAL(7, overlay.count());
+    TEST_ASSERT_EQUAL(56, overlay[6].y);
+}
+
+void test_status_overlay_expires_timed_lines(void) {
+    StatusOverlay overlay;
+    overlay.add("boot", 64, 64);
+    overlay.add("late", 64, 64, 1000, 500);
+    overlay.add("later", 64, 64, 1200, 500);
+
+    TEST_ASSERT_TRUE(rectEmpty(overlay.expire(1499, 64, 64)));
+    const DisplayRect band = overlay.expire(1500, 64, 64);
+    TEST_ASSERT_EQUAL(8, band.y);
+    TEST_ASSERT_EQUAL(24, band.h);
+    TEST_ASSERT_EQUAL(2, overlay.count());
+    TEST_ASSERT_EQUAL_STRING("later", overlay[1].text);
+    TEST_ASSERT_EQUAL(16, overlay[1].y);
+
+    // A line without a lifetime stays until clear(), across a millis() wrap too.
+    overlay.expire(1700, 64, 64);
+    TEST_ASSERT_EQUAL(1, overlay.count());
+    overlay.add("wrap", 64, 64, 0xFFFFFF00UL, 0x200);
+    TEST_ASSERT_TRUE(rectEmpty(overlay.expire(0x50, 64, 64)));
+    TEST_ASSERT_FALSE(rectEmpty(overlay.expire(0x100, 64, 64)));
+    TEST_ASSERT_EQUAL(1, overlay.count());
+    TEST_ASSERT_EQUAL_STRING("boot", overlay[0].text);
+}
+
+// ---------------------------------------------------------------------------
+// Display profiles
+// ---------------------------------------------------------------------------
+
+#include "../../src/display_profile.h"
+
+void test_display_profiles_are_found_by_name(void) {
+    TEST_ASSERT_EQUAL(0, findDisplayProfile("image"));
+    TEST_ASSERT_EQUAL(8, DISPLAY_PROFILES[0].color_depth_bits);
+    const int letter = findDisplayProfile("letter");
+    TEST_ASSERT_TRUE(letter > 0);
+    TEST_ASSERT_TRUE(DISPLAY_PROFILES[letter].color_depth_bits < 8);
+    TEST_ASSERT_EQUAL(-1, findDisplayProfile("Letter"));
+    TEST_ASSERT_EQUAL(-1, findDisplayProfile(""));
+}
+
+// ---------------------------------------------------------------------------
+// Command frames
+// ---------------------------------------------------------------------------
+
+#include "../../src/command_frame.h"
+
+void test_command_frame_splits_into_records(void) {
+    const uint8_t frame[] = {
+        CMD_FRAME_LETTER, 1, 'Q',
+        CMD_FRAME_BORDER, 9, 'N', 'S', ':', '0', 'x', 'F', '8', '0', '0',
+        CMD_FRAME_FLASH, 0,
+    };
+    CommandRecord records[CMD_FRAME_MAX_RECORDS];
+    TEST_ASSERT_EQUAL(3, parseCommandFrame(frame, sizeof(frame), records,
+                                           CMD_FRAME_MAX_RECORDS, 63));
+    TEST_ASSERT_EQUAL(CMD_FRAME_LETTER, records[0].type);
+    TEST_ASSERT_EQUAL(1, records[0].length);
+    TEST_ASSERT_EQUAL('Q', records[0].value[0]);
+    TEST_ASSERT_EQUAL(CMD_FRAME_BORDER, records[1].type);
+    TEST_ASSERT_EQUAL_MEMORY("NS:0xF800", records[1].value, 9);
+    TEST_ASSERT_EQUAL(CMD_FRAME_FLASH, records[2].type);
+    TEST_ASSERT_EQUAL(0, records[2].length);
+}
+
+void test_command_frame_is_refused_whole(void) {
+    CommandRecord records[CMD_FRAME_MAX_RECORDS];
+    const uint8_t truncated[] = {CMD_FRAME_LETTER, 1, 'Q', CMD_FRAME_LOCK, 2, '1'};
+    TEST_ASSERT_EQUAL(-1, parseCommandFrame(truncated, sizeof(truncated), records, 16, 63));
+    const uint8_t unknown[] = {CMD_FRAME_LETTER, 1, 'Q', 0x7F, 0};
+    TEST_ASSERT_EQUAL(-1, parseCommandFrame(unknown, sizeof(unknown), records, 16, 63));
+    const uint8_t type_zero[] = {0, 0};
+    TEST_ASSERT_EQUAL(-1, parseCommandFrame(type_zero, sizeof(type_zero), records, 16, 63));
+    const uint8_t too_long[] = {CMD_FRAME_STRING, 4, 'a', 'b', 'c', 'd'};
+    TEST_ASSERT_EQUAL(-1, parseCommandFrame(too_long, sizeof(too_long), records, 16, 3));
+    const uint8_t two[] = {CMD_FRAME_FLASH, 0, CMD_FRAME_FLASH, 0};
+    TEST_ASSERT_EQUAL(-1, parseCommandFrame(two, sizeof(two), records, 1, 63));
+    TEST_ASSERT_EQUAL(-1, parseCommandFrame(two, 0, records, 16, 63));
+}
+
+// ---------------------------------------------------------------------------
+// Topic dispatch
+// ---------------------------------------------------------------------------
+
+#include "../../src/topic_dispatch.h"
+
+static constexpr TopicRoute<int> TEST_ROUTES[] = {
+    {"border", 1, true},
+    {"border_frame", 2, true},
+    {"imagex", 3, true},
+    {"letter", 4, true},
+    {"sleep_interval", 5, false},
+};
+static_assert(topicRoutesSorted(TEST_ROUTES, 5), "test table is sorted");
+
+void test_topic_routes_find_exact_suffixes_only(void) {
+    const char* suffixes[] = {"border", "border_frame", "imagex", "letter", "sleep_interval"};
+    for (int i = 0; i < 5; i++) {
+        const TopicRoute<int>* route = findTopicRoute(TEST_ROUTES, 5, suffixes[i]);
+        TEST_ASSERT_NOT_NULL(route);
+        TEST_ASSERT_EQUAL(i + 1, route->handler);
+    }
+    TEST_ASSERT_FALSE(findTopicRoute(TEST_ROUTES, 5, "sleep_interval")->counts_as_activity);
+    TEST_ASSERT_NULL(findTopicRoute(TEST_ROUTES, 5, "borde"));
+    TEST_ASSERT_NULL(findTopicRoute(TEST_ROUTES, 5, "border_"));
+    TEST_ASSERT_NULL(findTopicRoute(TEST_ROUTES, 5, "proximity"));
+    TEST_ASSERT_NULL(findTopicRoute(TEST_ROUTES, 5, ""));
+    TEST_ASSERT_NULL(findTopicRoute(TEST_ROUTES, 0, "border"));
+}
+
+void test_topic_last_level_is_the_wildcard_suffix(void) {
+    TEST_ASSERT_EQUAL_STRING("letter", topicLastLevel("cube/3/letter"));
+    TEST_ASSERT_EQUAL_STRING("proximity", topicLastLevel("cube/12/proximity"));
+    TEST_ASSERT_EQUAL_STRING("", topicLastLevel("cube/3/"));
+    TEST_ASSERT_EQUAL_STRING("letter", topicLastLevel("letter"));
+    // A cube's own report finds no route, so it is dropped before loop().
+    TEST_ASSERT_NULL(findTopicRoute(TEST_ROUTES, 5, topicLastLevel("cube/3/proximity")));
+    TEST_ASSERT_NOT_NULL(findTopicRoute(TEST_ROUTES, 5, topicLastLevel("cube/3/imagex")));
+}
+
+void test_topic_routes_out_of_order_are_caught(void) {
+    const TopicRoute<int> unsorted[] = {{"letter", 1, true}, {"border", 2, true}};
+    TEST_ASSERT_FALSE(topicRoutesSorted(unsorted, 2));
+    const TopicRoute<int> duplicate[] = {{"lock", 1, true}, {"lock", 2, true}};
+    TEST_ASSERT_FALSE(topicRoutesSorted(duplicate, 2));
+    TEST_ASSERT_TRUE(topicRoutesSorted(TEST_ROUTES, 5));
+}
+
+// ---------------------------------------------------------------------------
+// Topic registry
+// ---------------------------------------------------------------------------
+
+#include "../../src/topic_registry.h"
+
+void test_topic_registry_builds_device_and_slot_topics(void) {
+    static TopicRegistry registry;
+    TEST_ASSERT_EQUAL_STRING("", registry.get(TOPIC_PRESENCE));
+    TEST_ASSERT_TRUE(registry.setDevice("AABBCCDDEEFF"));
+    TEST_ASSERT_EQUAL_STRING("cube/device/AABBCCDDEEFF/presence", registry.get(TOPIC_PRESENCE));
+    TEST_ASSERT_EQUAL_STRING("cube/assign/AABBCCDDEEFF", registry.get(TOPIC_ASSIGN));
+    TEST_ASSERT_FALSE(registry.has(TOPIC_CUBE));
+
+    TEST_ASSERT_TRUE(registry.setSlot("3"));
+    TEST_ASSERT_EQUAL_STRING("cube/3", registry.get(TOPIC_CUBE));
+    TEST_ASSERT_EQUAL_STRING("cube/3/+", registry.get(TOPIC_CUBE_ALL));
+    TEST_ASSERT_EQUAL_STRING("cube/3/hall_presence", registry.get(TOPIC_HALL_PRESENCE));
+    TEST_ASSERT_EQUAL_STRING("cube/nfc/3", registry.get(TOPIC_CUBE_NFC));
+    TEST_ASSERT_EQUAL_STRING("game/nfc/3", registry.get(TOPIC_GAME_NFC));
+    TEST_ASSERT_EQUAL_STRING("cube/right/3", registry.get(TOPIC_CUBE_RIGHT));
+    TEST_ASSERT_EQUAL_STRING("3", registry.slot());
+}
+
+void test_topic_registry_rebinds_slots_in_place(void) {
+    static TopicRegistry registry;
+    registry.setDevice("AABBCCDDEEFF");
+    const char* presence = registry.get(TOPIC_PRESENCE);
+    registry.setSlot("3");
+    const size_t used = registry.bytesUsed();
+
+    // A rebind reuses the slot section, and device topics never move.
+    for (int i = 0; i < 100; i++) {
+        TEST_ASSERT_TRUE(registry.setSlot(i % 2 ? "12" : "3"));
+    }
+    registry.setSlot("3");
+    TEST_ASSERT_EQUAL(used, registry.bytesUsed());
+    TEST_ASSERT_TRUE(presence == registry.get(TOPIC_PRESENCE));
+    TEST_ASSERT_EQUAL_STRING("cube/device/AABBCCDDEEFF/presence", presence);
+
+    registry.clear(TOPIC_PROXIMITY);
+    TEST_ASSERT_EQUAL_STRING("", registry.get(TOPIC_PROXIMITY));
+    registry.setSlot("3");
+    TEST_ASSERT_EQUAL_STRING("cube/3/proximity", registry.get(TOPIC_PROXIMITY));
+
+    // An id too long to hold leaves no half-built slot behind.
+    TEST_ASSERT_FALSE(registry.setSlot("0123456789abcdefXYZ"));
+    TEST_ASSERT_FALSE(registry.has(TOPIC_CUBE));
+    TEST_ASSERT_EQUAL_STRING("", registry.slot());
+    TEST_ASSERT_TRUE(presence == registry.get(TOPIC_PRESENCE));
+}
+
+// ---------------------------------------------------------------------------
+// Publish queue
+// ---------------------------------------------------------------------------
+
+#include "../../src/publish_queue.h"
+
+struct RecordedPublish {
+    char topic[PUBLISH_TOPIC_MAX];
+    char payload[PUBLISH_PAYLOAD_MAX];
+};
+static RecordedPublish recorded_publishes[PUBLISH_QUEUE_SLOTS];
+static int recorded_publish_count = 0;
+static bool publish_accepts = true;
+
+static bool recordPublish(const char* topic, const char* payload, bool) {
+    if (!publish_accepts) return false;
+    RecordedPublish& record = recorded_publishes[recorded_publish_count++];
+    strncpy(record.topic, topic, sizeof(record.topic) - 1);
+    record.topic[sizeof(record.topic) - 1] = '\0';
+    strncpy(record.payload, payload, sizeof(record.payload) - 1);
+    record.payload[sizeof(record.payload) - 1] = '\0';
+    return true;
+}
+
+void test_publish_queue_coalesces_in_place(void) {
+    static PublishQueue queue;
+    recorded_publish_count = 0;
+    publish_accepts = true;
+    TEST_ASSERT_TRUE(queue.post("cube/1/proximity", "10", true));
+    TEST_ASSERT_TRUE(queue.post("cube/right/1", "2", true));
+    TEST_ASSERT_TRUE(queue.post("cube/1/proximity", "55", true));
+    TEST_ASSERT_EQUAL(2, queue.count());
+    TEST_ASSERT_EQUAL_STRING("55", queue.pending("cube/1/proximity"));
+
+    // Only the newest proximity goes out, and still ahead of cube/right.
+    TEST_ASSERT_EQUAL(2, queue.flush(10, recordPublish));
+    TEST_ASSERT_EQUAL(2, recorded_publish_count);
+    TEST_ASSERT_EQUAL_STRING("cube/1/proximity", recorded_publishes[0].topic);
+    TEST_ASSERT_EQUAL_STRING("55", recorded_publishes[0].payload);
+    TEST_ASSERT_EQUAL_STRING("cube/right/1", recorded_publishes[1].topic);
+    TEST_ASSERT_EQUAL(0, queue.count());
+    TEST_ASSERT_TRUE(queue.pending("cube/1/proximity") == nullptr);
+}
+
+void test_publish_queue_retries_and_rejects(void) {
+    static PublishQueue queue;
+    recorded_publish_count = 0;
+    publish_accepts = false;
+    queue.post("a", "1", true);
+    queue.post("b", "2", true);
+    queue.post("c", "3", true);
+
+    // A failure stops the flush and sends the entry to the back.
+    TEST_ASSERT_EQUAL(0, queue.flush(3, recordPublish));
+    TEST_ASSERT_EQUAL(3, queue.count());
+    publish_accepts = true;
+    TEST_ASSERT_EQUAL(1, queue.flush(1, recordPublish));
+    TEST_ASSERT_EQUAL_STRING("b", recorded_publishes[0].topic);
+    TEST_ASSERT_EQUAL(2, queue.flush(5, recordPublish));
+    TEST_ASSERT_EQUAL_STRING("c", recorded_publishes[1].topic);
+    TEST_ASSERT_EQUAL_STRING("a", recorded_publishes[2].topic);
+
+    // Full, or too long to hold: nothing is queued.
+    char topic[8];
+    for (int i = 0; i < PUBLISH_QUEUE_SLOTS; i++) {
+        snprintf(topic, sizeof(topic), "t%d", i);
+        TEST_ASSERT_TRUE(queue.post(topic, "x", true));
+    }
+    TEST_ASSERT_FALSE(queue.post("one more", "x", true));
+    TEST_ASSERT_TRUE(queue.post("t0", "y", true));
+    char long_payload[PUBLISH_PAYLOAD_MAX + 1];
+    memset(long_payload, 'p', PUBLISH_PAYLOAD_MAX);
+    long_payload[PUBLISH_PAYLOAD_MAX] = '\0';
+    TEST_ASSERT_FALSE(queue.post("t1", long_payload, true));
+    TEST_ASSERT_EQUAL_STRING("x", queue.pending("t1"));
+    TEST_ASSERT_EQUAL(PUBLISH_QUEUE_SLOTS, queue.count());
+}
+
+// ---------------------------------------------------------------------------
+// UDP commands
+// ---------------------------------------------------------------------------
+
+#include "../../src/udp_command.h"
+
+void test_udp_command_header_parses(void) {
+    const uint8_t datagram[] = {0xCB, 1, 3, 0x12, 0x34, 0x00, 0x00, 0x01, 0x02,
+                                0x01, 0x01, 'A'};
+    UdpCommandHeader header;
+    TEST_ASSERT_TRUE(isUdpCommand(datagram, sizeof(datagram)));
+    TEST_ASSERT_TRUE(parseUdpCommandHeader(datagram, sizeof(datagram), &header));
+    TEST_ASSERT_EQUAL(3, header.slot);
+    TEST_ASSERT_EQUAL_HEX16(0x1234, header.epoch);
+    TEST_ASSERT_EQUAL_UINT32(0x102, header.sequence);
+
+    const uint8_t* ping = reinterpret_cast<const uint8_t*>("ping");
+    TEST_ASSERT_FALSE(isUdpCommand(ping, 4));
+    TEST_ASSERT_FALSE(parseUdpCommandHeader(datagram, UDP_COMMAND_HEADER_BYTES - 1, &header));
+    const uint8_t future[] = {0xCB, 2, 3, 0, 0, 0, 0, 0, 1};
+    TEST_ASSERT_FALSE(parseUdpCommandHeader(future, sizeof(future), &header));
+}
+
+void test_udp_sequence_filter_drops_stale(void) {
+    UdpSequenceFilter filter;
+    TEST_ASSERT_TRUE(filter.accept(7, 100, 0));
+    TEST_ASSERT_TRUE(filter.accept(7, 102, 10));
+    // Reordered behind 102, and a duplicate.
+    TEST_ASSERT_FALSE(filter.accept(7, 101, 20));
+    TEST_ASSERT_FALSE(filter.accept(7, 102, 30));
+    TEST_ASSERT_TRUE(filter.accept(7, 103, 40));
+
+    // A restarted sender starts over under a new epoch.
+    TEST_ASSERT_TRUE(filter.accept(8, 1, 50));
+    TEST_ASSERT_FALSE(filter.accept(8, 1, 60));
+
+    // The counter may wrap.
+    TEST_ASSERT_TRUE(filter.accept(9, 0xFFFFFFFF, 70));
+    TEST_ASSERT_TRUE(filter.accept(9, 0, 80));
+    TEST_ASSERT_FALSE(filter.accept(9, 0xFFFFFFFE, 90));
+}
+
+void test_udp_sequence_filter_drops_old_epoch_straggler(void) {
+    UdpSequenceFilter filter;
+    TEST_ASSERT_TRUE(filter.accept(7, 500, 0));
+    TEST_ASSERT_TRUE(filter.accept(8, 1, 10));
+    // Sent by the previous run before it stopped, delivered after the restart.
+    TEST_ASSERT_FALSE(filter.accept(7, 501, 20));
+    TEST_ASSERT_TRUE(filter.accept(8, 2, 30));
+
+    // The epoch wraps like the sequence does.
+    UdpSequenceFilter wrapping;
+    TEST_ASSERT_TRUE(wrapping.accept(0xFFFF, 1, 40));
+    TEST_ASSERT_TRUE(wrapping.accept(0, 1, 50));
+    TEST_ASSERT_FALSE(wrapping.accept(0xFFFF, 2, 60));
+
+    // A sender silent for longer than UDP_SENDER_IDLE_MS is heard afresh, even
+    // under an epoch that compares as older.
+    TEST_ASSERT_FALSE(wrapping.accept(0x9000, 1, 50 + UDP_SENDER_IDLE_MS - 1));
+    TEST_ASSERT_TRUE(wrapping.accept(0x9000, 1, 50 + UDP_SENDER_IDLE_MS));
+}
+
+// ---------------------------------------------------------------------------
+// Fleet commands
+// ---------------------------------------------------------------------------
+
+#include "../../src/fleet_command.h"
+
+static const uint8_t TEST_FLEET_KEY[FLEET_COMMAND_KEY_BYTES] = {
+    0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15};
+
+void test_siphash_reference_vectors(void) {
+    uint8_t message[15];
+    for (int i = 0; i < 15; i++) message[i] = (uint8_t)i;
+    TEST_ASSERT_TRUE(sipHash24(TEST_FLEET_KEY, message, 0) == 0x726fdb47dd0e0e31ULL);
+    TEST_ASSERT_TRUE(sipHash24(TEST_FLEET_KEY, message, 15) == 0xa129ca6149be45e5ULL);
+}
+
+static size_t signFleetDatagram(uint8_t* out, uint8_t type, uint64_t nonce, const char* payload) {
+    out[0] = FLEET_COMMAND_MAGIC;
+    out[1] = FLEET_COMMAND_VERSION;
+    out[2] = type;
+    for (int i = 0; i < 8; i++) out[3 + i] = (uint8_t)(nonce >> (56 - 8 * i));
+    const size_t payload_length = strlen(payload);
+    memcpy(out + FLEET_COMMAND_HEADER_BYTES, payload, payload_length);
+    const size_t signed_length = FLEET_COMMAND_HEADER_BYTES + payload_length;
+    const uint64_t tag = sipHash24(TEST_FLEET_KEY, out, signed_length);
+    for (int i = 0; i < 8; i++) out[signed_length + i] = (uint8_t)(tag >> (8 * i));
+    return signed_length + FLEET_COMMAND_TAG_BYTES;
+}
+
+void test_fleet_command_checks_tag(void) {
+    uint8_t datagram[64];
+    const size_t length = signFleetDatagram(datagram, FLEET_CMD_BRIGHTNESS, 1700000000123ULL, "40");
+    FleetCommand command;
+    TEST_ASSERT_TRUE(parseFleetCommand(datagram, length, TEST_FLEET_KEY, &command));
+    TEST_ASSERT_EQUAL(FLEET_CMD_BRIGHTNESS, command.type);
+    TEST_ASSERT_TRUE(command.nonce == 1700000000123ULL);
+    TEST_ASSERT_EQUAL(2, command.payload_length);
+    TEST_ASSERT_EQUAL_MEMORY("40", command.payload, 2);
+
+    // Any byte changed, a different key, or a cut datagram is refused.
+    datagram[FLEET_COMMAND_HEADER_BYTES] = '9';
+    TEST_ASSERT_FALSE(parseFleetCommand(datagram, length, TEST_FLEET_KEY, &command));
+    datagram[FLEET_COMMAND_HEADER_BYTES] = '4';
+    uint8_t other_key[FLEET_COMMAND_KEY_BYTES] = {};
+    TEST_ASSERT_FALSE(parseFleetCommand(datagram, length, other_key, &command));
+    TEST_ASSERT_FALSE(parseFleetCommand(datagram, length - 1, TEST_FLEET_KEY, &command));
+    TEST_ASSERT_FALSE(parseFleetCommand(datagram, FLEET_COMMAND_HEADER_BYTES, TEST_FLEET_KEY, &command));
+
+    // Signed, but not a command this firmware knows.
+    const size_t unknown = signFleetDatagram(datagram, FLEET_CMD_TYPE_LAST + 1, 1, "");
+    TEST_ASSERT_FALSE(parseFleetCommand(datagram, unknown, TEST_FLEET_KEY, &command));
+}
+
+struct MemoryFleetNonceStore : public FleetNonceStore {
+    uint64_t stored = 0;
+    bool writable = true;
+    uint64_t load() override { return stored; }
+    bool save(uint64_t nonce) override {
+        if (!writable) return false;
+        stored = nonce;
+        return true;
+    }
+};
+
+// A restart builds a new floor from the store, and a captured datagram -- a
+// reboot command above all -- must still be refused after it.
+void test_fleet_nonce_floor_survives_a_restart(void) {
+    MemoryFleetNonceStore store;
+    {
+        FleetNonceFloor floor(store);
+        TEST_ASSERT_TRUE(floor.accept(1700000000123ULL));
+        TEST_ASSERT_FALSE(floor.accept(1700000000123ULL));
+    }
+    FleetNonceFloor restarted(store);
+    TEST_ASSERT_FALSE(restarted.accept(1700000000123ULL));
+    TEST_ASSERT_FALSE(restarted.accept(1700000000100ULL));
+    TEST_ASSERT_TRUE(restarted.accept(1700000000124ULL));
+
+    // Not acted on unless it is stored first.
+    store.writable = false;
+    TEST_ASSERT_FALSE(restarted.accept(1700000000200ULL));
+    TEST_ASSERT_TRUE(store.stored == 1700000000124ULL);
+}
+
+// ---------------------------------------------------------------------------
+// State snapshot
+// ---------------------------------------------------------------------------
+
+#include "../../src/state_snapshot.h"
+
+void test_state_snapshot_formats_one_record(void) {
+    StateSnapshot state = {"a1b2", 3, 7, "v1.2", "nfc", "no \"reader\"", 4, 1200, 85};
+    char out[PUBLISH_PAYLOAD_MAX];
+    const int length = formatStateSnapshot(out, sizeof(out), state);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"protocol\":1,\"boot_id\":\"a1b2\",\"slot\":3,\"generation\":7,"
+        "\"version\":\"v1.2\",\"sensor_mode\":\"nfc\",\"sensor_probe\":\"no \\\"reader\\\"\","
+        "\"connects\":4,\"outage_ms\":1200,\"ready_ms\":85}",
+        out);
+    TEST_ASSERT_EQUAL((int)strlen(out), length);
+}
+
+void test_state_snapshot_refuses_what_does_not_fit(void) {
+    StateSnapshot state = {"a1b2", 3, 7, "v1.2", "magnets", "", 1, 0, 0};
+    char small[32];
+    TEST_ASSERT_EQUAL(-1, formatStateSnapshot(small, sizeof(small), state));
+
+    char text[4];
+    TEST_ASSERT_EQUAL(-1, appendJsonText(text, sizeof(text), "a\"b"));
+    TEST_ASSERT_EQUAL(3, appendJsonText(text, sizeof(text), "a\nbc"));
+    TEST_ASSERT_EQUAL_STRING("abc", text);
+}
+
+// ---------------------------------------------------------------------------
+// MQTT session
+// ---------------------------------------------------------------------------
+
+#include "../../src/mqtt_session.h"
+
+void test_mqtt_session_probes_after_a_walk(void) {
+    MqttSessionTracker session;
+    // Nothing to resume on the first connect.
+    TEST_ASSERT_FALSE(session.beginConnect(100, "A1B2C3D4", true));
+    TEST_ASSERT_EQUAL(1, session.walks());
+
+    TEST_ASSERT_TRUE(session.beginConnect(5000, "A1B2C3D4", true));
+    TEST_ASSERT_EQUAL_STRING("A1B2C3D4-1", session.token());
+    TEST_ASSERT_FALSE(session.probeEchoed("A1B2C3D4-0"));
+    TEST_ASSERT_FALSE(session.probeExpired(5000 + SESSION_PROBE_TIMEOUT_MS - 1));
+    TEST_ASSERT_TRUE(session.probeEchoed("A1B2C3D4-1"));
+    TEST_ASSERT_FALSE(session.probing());
+    TEST_ASSERT_EQUAL(1, session.resumes());
+    // Answered once only.
+    TEST_ASSERT_FALSE(session.probeEchoed("A1B2C3D4-1"));
+}
+
+void test_mqtt_session_walks_when_not_kept(void) {
+    MqttSessionTracker session;
+    session.beginConnect(0, "A1B2C3D4", true);
+
+    // Unanswered: a new session, walked once the probe is overdue.
+    TEST_ASSERT_TRUE(session.beginConnect(1000, "A1B2C3D4", true));
+    TEST_ASSERT_TRUE(session.probeExpired(1000 + SESSION_PROBE_TIMEOUT_MS));
+    TEST_ASSERT_FALSE(session.probeExpired(1000 + 2 * SESSION_PROBE_TIMEOUT_MS));
+    TEST_ASSERT_EQUAL(2, session.walks());
+    TEST_ASSERT_FALSE(session.probeEchoed("A1B2C3D4-1"));
+
+    // A subscribe lost since the walk: no probe, walk straight away.
+    TEST_ASSERT_FALSE(session.beginConnect(9000, "A1B2C3D4", false));
+    TEST_ASSERT_EQUAL(3, session.walks());
+    TEST_ASSERT_EQUAL(0, session.resumes());
+}
+
+struct FakeSessionEndPorts : public SessionEndPorts {
+    bool clean_result = true;
+    char calls[96] = "";
+    void record(const char* name) {
+        strncat(calls, name, sizeof(calls) - strlen(calls) - 1);
+        strncat(calls, ",", sizeof(calls) - strlen(calls) - 1);
+    }
+    void disconnectSession() override { record("disconnectSession"); }
+    bool connectClean() override { record("connectClean"); return clean_result; }
+    void disconnectClean() override { record("disconnectClean"); }
+};
+
+// Deep sleep must not leave the broker queueing a sleep's worth of commands
+// for the session, and the session's own connection goes before the clean
+// connect, which would otherwise take it over and fire its last will.
+void test_mqtt_session_ends_before_sleep(void) {
+    FakeSessionEndPorts ports;
+    TEST_ASSERT_TRUE(endPersistentSession(ports));
+    TEST_ASSERT_EQUAL_STRING("disconnectSession,connectClean,disconnectClean,", ports.calls);
+
+    FakeSessionEndPorts refused;
+    refused.clean_result = false;
+    TEST_ASSERT_FALSE(endPersistentSession(refused));
+    TEST_ASSERT_EQUAL_STRING("disconnectSession,connectClean,", refused.calls);
+}
+
+// ---------------------------------------------------------------------------
+// WiFi association cache
+// ---------------------------------------------------------------------------
+
+#include "../../src/wifi_association.h"
+
+void test_wifi_association_remembers_changes_only(void) {
+    WifiAssociation cached = {};
+    TEST_ASSERT_FALSE(wifiAssociationKnown(cached));
+
+    const uint8_t ap[6] = {0x94, 0x83, 0xC4, 0x01, 0x02, 0x03};
+    TEST_ASSERT_TRUE(rememberWifiAssociation(&cached, ap, 6));
+    TEST_ASSERT_TRUE(wifiAssociationKnown(cached));
+    TEST_ASSERT_EQUAL(6, cached.channel);
+    TEST_ASSERT_EQUAL_MEMORY(ap, cached.bssid, 6);
+    TEST_ASSERT_FALSE(rememberWifiAssociation(&cached, ap, 6));
+
+    // Same AP on a new channel is a change.
+    TEST_ASSERT_TRUE(rememberWifiAssociation(&cached, ap, 11));
+    TEST_ASSERT_EQUAL(11, cached.channel);
+}
+
+void test_wifi_association_ignores_unknown_and_forgets(void) {
+    WifiAssociation cached = {};
+    const uint8_t ap[6] = {1, 2, 3, 4, 5, 6};
+    TEST_ASSERT_FALSE(rememberWifiAssociation(&cached, nullptr, 6));
+    TEST_ASSERT_FALSE(rememberWifiAssociation(&cached, ap, 0));
+    TEST_ASSERT_FALSE(wifiAssociationKnown(cached));
+
+    rememberWifiAssociation(&cached, ap, 1);
+    forgetWifiAssociation(&cached);
+    TEST_ASSERT_FALSE(wifiAssociationKnown(cached));
+    // Forgotten means a full scan next, and its result is cached afresh.
+    TEST_ASSERT_TRUE(rememberWifiAssociation(&cached, ap, 1));
+}
+
+// ---------------------------------------------------------------------------
+// Keep-alive interval
+// ---------------------------------------------------------------------------
+
+void test_keepalive_interval_backs_off_to_ceiling(void) {
+    const KeepAliveLimits limits = {20, 300, 0};
+    uint32_t interval = 20;
+    const uint32_t expected[] = {40, 80, 160, 300, 300};
+    for (uint32_t next : expected) {
+        interval = nextKeepAliveInterval(interval, KEEPALIVE_CONFIRMED_ASLEEP, limits);
+        TEST_ASSERT_EQUAL_UINT32(next, interval);
+    }
+    // A failed check-in holds; a wake starts over.
+    TEST_ASSERT_EQUAL_UINT32(300, nextKeepAliveInterval(interval, KEEPALIVE_UNCONFIRMED, limits));
+    TEST_ASSERT_EQUAL_UINT32(20, nextKeepAliveInterval(interval, KEEPALIVE_WOKE, limits));
+}
+
+void test_keepalive_interval_respects_power_bank_and_ceiling(void) {
+    // On a bank the cap is the bank's, below the ceiling.
+    const KeepAliveLimits bank = {20, 300, 40};
+    TEST_ASSERT_EQUAL_UINT32(40, nextKeepAliveInterval(20, KEEPALIVE_CONFIRMED_ASLEEP, bank));
+    TEST_ASSERT_EQUAL_UINT32(40, nextKeepAliveInterval(40, KEEPALIVE_CONFIRMED_ASLEEP, bank));
+
+    // A ceiling lowered below the current interval pulls it straight back.
+    const KeepAliveLimits lowered = {20, 60, 0};
+    TEST_ASSERT_EQUAL_UINT32(60, nextKeepAliveInterval(300, KEEPALIVE_UNCONFIRMED, lowered));
+    // Never below the base, even from an interval set before the base rose.
+    const KeepAliveLimits raised = {30, 300, 0};
+    TEST_ASSERT_EQUAL_UINT32(30, nextKeepAliveInterval(10, KEEPALIVE_UNCONFIRMED, raised));
+}
+
+void test_keepalive_interval_base_wins_over_caps(void) {
+    // A sleep_interval set above the bank cap is kept, not clamped to it.
+    const KeepAliveLimits bank = {120, 300, 40};
+    TEST_ASSERT_EQUAL_UINT32(120, nextKeepAliveInterval(120, KEEPALIVE_WOKE, bank));
+    TEST_ASSERT_EQUAL_UINT32(120, nextKeepAliveInterval(120, KEEPALIVE_UNCONFIRMED, bank));
+    TEST_ASSERT_EQUAL_UINT32(120, nextKeepAliveInterval(120, KEEPALIVE_CONFIRMED_ASLEEP, bank));
+
+    // Likewise above sleep_interval_max.
+    const KeepAliveLimits ceiling = {200, 100, 0};
+    TEST_ASSERT_EQUAL_UINT32(200, nextKeepAliveInterval(200, KEEPALIVE_CONFIRMED_ASLEEP, ceiling));
+}
+
+// ---------------------------------------------------------------------------
+// Check-in datagram
+// ---------------------------------------------------------------------------
+
+#include "../../src/checkin_datagram.h"
+
+void test_checkin_request_layout(void) {
+    uint8_t request[CHECKIN_REQUEST_BYTES];
+    TEST_ASSERT_EQUAL(CHECKIN_REQUEST_BYTES,
+                      buildCheckInRequest(request, 0x01020304u, 7, "AABBCCDDEEFF"));
+    const uint8_t header[] = {CHECKIN_MAGIC, CHECKIN_VERSION, 1, 2, 3, 4, 7};
+    TEST_ASSERT_EQUAL_MEMORY(header, request, sizeof(header));
+    TEST_ASSERT_EQUAL_MEMORY("AABBCCDDEEFF", request + 7, CHECKIN_DEVICE_ID_BYTES);
+    TEST_ASSERT_EQUAL(0, buildCheckInRequest(request, 1, 7, "AABBCC"));
+}
+
+void test_checkin_response_needs_the_nonce(void) {
+    const uint8_t response[] = {CHECKIN_MAGIC, CHECKIN_VERSION, 0xDE, 0xAD, 0xBE, 0xEF,
+                                CHECKIN_FLAG_SLOT_SLEEP};
+    bool device = true;
+    bool slot = false;
+    TEST_ASSERT_TRUE(parseCheckInResponse(response, sizeof(response), 0xDEADBEEFu,
+                                          &device, &slot));
+    TEST_ASSERT_FALSE(device);
+    TEST_ASSERT_TRUE(slot);
+
+    // An answer to another try, or anything malformed, confirms nothing and
+    // leaves the flags alone.
+    device = slot = false;
+    TEST_ASSERT_FALSE(parseCheckInResponse(response, sizeof(response), 0xDEADBEEEu,
+                                           &device, &slot));
+    TEST_ASSERT_FALSE(parseCheckInResponse(response, sizeof(response) - 1, 0xDEADBEEFu,
+                                           &device, &slot));
+    TEST_ASSERT_FALSE(slot);
+}
+
+// ---------------------------------------------------------------------------
+// Idle governor
+// ---------------------------------------------------------------------------
+
+#include "../../src/idle_governor.h"
+
+void test_idle_governor_rests_after_a_quiet_spell(void) {
+    IdleGovernor governor;
+    governor.noteActivity(1000);
+    TEST_ASSERT_EQUAL_UINT32(0, governor.waitMs(1000 + IDLE_ENTER_MS - 1, 20));
+    TEST_ASSERT_EQUAL_UINT32(20, governor.waitMs(1000 + IDLE_ENTER_MS, 20));
+    TEST_ASSERT_FALSE(governor.radioMayDoze(1000 + IDLE_RADIO_ENTER_MS - 1));
+    TEST_ASSERT_TRUE(governor.radioMayDoze(1000 + IDLE_RADIO_ENTER_MS));
+
+    // Any activity starts the quiet spell over.
+    governor.noteActivity(1000 + IDLE_RADIO_ENTER_MS);
+    TEST_ASSERT_EQUAL_UINT32(0, governor.waitMs(1000 + IDLE_RADIO_ENTER_MS + 1, 20));
+    TEST_ASSERT_FALSE(governor.radioMayDoze(1000 + IDLE_RADIO_ENTER_MS + 1));
+}
+
+void test_idle_governor_keeps_the_radio_up_during_a_game(void) {
+    IdleGovernor governor;
+    governor.noteGameActivity(1000);
+    // A long think over a move is not the end of the game.
+    TEST_ASSERT_EQUAL_UINT32(20, governor.waitMs(1000 + IDLE_ENTER_MS, 20));
+    TEST_ASSERT_FALSE(governor.radioMayDoze(1000 + IDLE_RADIO_ENTER_MS));
+    TEST_ASSERT_FALSE(governor.radioMayDoze(1000 + IDLE_GAME_OVER_MS - 1));
+    TEST_ASSERT_TRUE(governor.radioMayDoze(1000 + IDLE_GAME_OVER_MS));
+
+    // Housekeeping between games only holds it off for the usual quiet spell.
+    const unsigned long later = 1000 + IDLE_GAME_OVER_MS + 5000;
+    governor.noteActivity(later);
+    TEST_ASSERT_FALSE(governor.radioMayDoze(later + IDLE_RADIO_ENTER_MS - 1));
+    TEST_ASSERT_TRUE(governor.radioMayDoze(later + IDLE_RADIO_ENTER_MS));
+}
+
+void test_idle_governor_counts_only_woken_waits(void) {
+    IdleGovernor governor;
+    governor.recordWait(50000, false, 0);
+    governor.recordWait(3000, true, 100);
+    governor.recordWait(7000, true, 300);
+    TEST_ASSERT_EQUAL_UINT32(60000, (uint32_t)governor.restedUs());
+    TEST_ASSERT_EQUAL_UINT32(2, governor.wakes());
+    TEST_ASSERT_EQUAL_UINT32(200, governor.wakeLatencyAvgUs());
+    TEST_ASSERT_EQUAL_UINT32(300, governor.wakeLatencyMaxUs());
+
+    governor.resetStats();
+    TEST_ASSERT_EQUAL_UINT32(0, (uint32_t)governor.restedUs());
+    TEST_ASSERT_EQUAL_UINT32(0, governor.wakes());
+    TEST_ASSERT_EQUAL_UINT32(0, governor.wakeLatencyAvgUs());
+    TEST_ASSERT_EQUAL_UINT32(0, governor.wakeLatencyMaxUs());
+}
+
+// ---------------------------------------------------------------------------
+// Wake timeline
+// ---------------------------------------------------------------------------
+
+#include "../../src/wake_timeline.h"
+
+void test_wake_timeline_records_phases_in_a_ring(void) {
+    static WakeTimeline timeline;
+    memset(&timeline, 0, sizeof(timeline));
+    for (uint32_t wake = 0; wake < WAKE_TIMELINE_RECORDS + 2; wake++) {
+        WakeRecord* record = beginWakeRecord(&timeline, WAKE_REASON_TIMER);
+        TEST_ASSERT_EQUAL_UINT32(wake, record->seq);
+        markWakePhase(record, WAKE_PHASE_BOOT, 0);
+        markWakePhase(record, WAKE_PHASE_WIFI, 400 + wake);
+        markWakePhase(record, WAKE_PHASE_SLEEP, 70000);
+        record->flags |= WAKE_FLAG_CACHED_WIFI;
+    }
+    // 0 is kept for a phase never reached, and the long end saturates.
+    const WakeRecord& newest = timeline.records[(WAKE_TIMELINE_RECORDS + 1) % WAKE_TIMELINE_RECORDS];
+    TEST_ASSERT_EQUAL_UINT16(1, newest.phase_ms[WAKE_PHASE_BOOT]);
+    TEST_ASSERT_EQUAL_UINT16(0, newest.phase_ms[WAKE_PHASE_MQTT]);
+    TEST_ASSERT_EQUAL_UINT16(0xFFFF, newest.phase_ms[WAKE_PHASE_SLEEP]);
+
+    char out[128];
+    TEST_ASSERT_TRUE(formatWakeTimelineRecords(out, sizeof(out), timeline, 2) > 0);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"protocol\":1,\"last\":17,\"wakes\":"
+        "[[0,1,1,416,0,0,65535],[0,1,1,417,0,0,65535]]}",
+        out);
+}
+
+void test_wake_timeline_keeps_the_newest_that_fit(void) {
+    static WakeTimeline timeline;
+    memset(&timeline, 0, sizeof(timeline));
+    char out[96];
+    TEST_ASSERT_TRUE(formatWakeTimeline(out, sizeof(out), timeline) > 0);
+    TEST_ASSERT_EQUAL_STRING("{\"protocol\":1,\"last\":-1,\"wakes\":[]}", out);
+
+    for (int wake = 0; wake < 5; wake++) {
+        WakeRecord* record = beginWakeRecord(&timeline, WAKE_REASON_BUTTON);
+        markWakePhase(record, WAKE_PHASE_BOOT, 30 + wake);
+    }
+    // Each record is 17 bytes here; a 96-byte buffer takes the newest three.
+    TEST_ASSERT_TRUE(formatWakeTimeline(out, sizeof(out), timeline) > 0);
+    TEST_ASSERT_EQUAL_STRING(
+        "{\"protocol\":1,\"last\":4,\"wakes\":"
+        "[[1,0,32,0,0,0,0],[1,0,33,0,0,0,0],[1,0,34,0,0,0,0]]}",
+        out);
+    TEST_ASSERT_EQUAL(-1, formatWakeTimeline(out, 8, timeline));
+}
+
 void setUp(void) {}
 void tearDown(void) {}
 
@@ -869,6 +2309,13 @@ void test_runWakeCheckIn_button_wake_ignores_network() {
     TEST_ASSERT_EQUAL_STRING("stayAwake,", ports.calls);
 }
 
+void test_runWakeCheckIn_dock_wake_ignores_network() {
+    FakeWakeCheckInPorts ports;
+    ports.wifi_result = false;
+    runWakeCheckIn(WAKE_REASON_DOCK, ports);
+    TEST_ASSERT_EQUAL_STRING("stayAwake,", ports.calls);
+}
+
 // A reset -- brownout, watchdog, crash, a jostled battery contact -- is not
 // someone deciding to use the cube. Until now any of them came up fully awake
 // and ignored the sleep flag entirely, so a stored cube woke for 10 minutes
@@ -1066,6 +2513,7 @@ int main(void) {
     RUN_TEST(test_runWakeCheckIn_flag_clear_clears_then_stays_awake);
     RUN_TEST(test_runWakeCheckIn_assigned_cube_wakes_on_stale_device_flag);
     RUN_TEST(test_runWakeCheckIn_button_wake_ignores_network);
+    RUN_TEST(test_runWakeCheckIn_dock_wake_ignores_network);
     RUN_TEST(test_runWakeCheckIn_unconfirmed_flag_read_does_not_clear_or_wake);
     RUN_TEST(test_runWakeCheckIn_reset_with_unconfirmed_flag_read_stays_awake);
     RUN_TEST(test_runWakeCheckIn_reset_obeys_a_set_sleep_flag);
@@ -1104,6 +2552,8 @@ int main(void) {
     RUN_TEST(test_closeness_spans_nothing_to_docked);
     RUN_TEST(test_closeness_rises_smoothly_between_the_endpoints);
     RUN_TEST(test_presence_delta_is_monotonic_with_approach);
+    RUN_TEST(test_dock_watch_bounds_are_the_tracker_thresholds);
+    RUN_TEST(test_dock_watch_follows_direction_and_stays_in_adc_range);
 
     // Sensor-mode discriminator
     RUN_TEST(test_hall_board_is_seen_under_every_2_of_6_mask);
@@ -1119,5 +2569,126 @@ int main(void) {
     RUN_TEST(test_the_active_probe_is_unreachable_when_a_hall_board_is_present);
     RUN_TEST(test_the_active_probe_runs_when_every_line_floats);
 
+
+    // Display dirty regions
+    RUN_TEST(test_region_merges_overlapping_rects);
+    RUN_TEST(test_region_keeps_opposite_borders_apart);
+    RUN_TEST(test_region_ignores_empty_rects);
+    RUN_TEST(test_region_chains_merges_through_a_bridging_rect);
+    RUN_TEST(test_region_folds_into_the_least_growth_when_full);
+    RUN_TEST(test_clip_trims_a_glyph_rising_from_below);
+    RUN_TEST(test_closure_pulls_in_every_layer_it_touches);
+    RUN_TEST(test_closure_leaves_untouched_layers_alone);
+
+
+    // Glyph span cache
+    RUN_TEST(test_spans_cover_a_row_in_runs);
+    RUN_TEST(test_spans_refuse_a_glyph_that_does_not_fit);
+    RUN_TEST(test_spans_reproduce_every_letter_font_glyph_exactly);
+    RUN_TEST(test_cache_keeps_the_glyph_still_on_screen);
+    RUN_TEST(test_cache_hit_does_not_rasterize_again);
+
+
+    // Landing curve
+    RUN_TEST(test_fixed_curve_matches_the_float_reference_for_every_rise);
+    RUN_TEST(test_fixed_curve_is_continuous_at_the_seam);
+    RUN_TEST(test_fixed_curve_travels_monotonically_until_rise);
+    RUN_TEST(test_fixed_curve_clamps_an_out_of_range_rise);
+    RUN_TEST(test_baked_curve_is_the_fixed_curve);
+    RUN_TEST(test_rebaking_reshapes_the_curve);
+
+    // SPSC ring
+    RUN_TEST(test_ring_pops_in_push_order);
+    RUN_TEST(test_ring_uses_every_slot_and_refuses_when_full);
+    RUN_TEST(test_ring_pop_from_empty_leaves_output_alone);
+    RUN_TEST(test_ring_wraps_many_times_without_losing_order);
+    RUN_TEST(test_ring_moves_items_through);
+
+    // Compressed images
+    RUN_TEST(test_rle_image_fills_the_frame);
+    RUN_TEST(test_rle_image_must_cover_the_frame_exactly);
+    RUN_TEST(test_palette_image_packs_indices_at_the_narrowest_width);
+    RUN_TEST(test_palette_image_at_eight_bits);
+    RUN_TEST(test_palette_rle_image_is_an_order_of_magnitude_smaller);
+    RUN_TEST(test_unknown_or_empty_image_format_is_rejected);
+
+    // Image row blitting
+    RUN_TEST(test_row_runs_reproduce_the_bitmap_at_every_slide_offset);
+    RUN_TEST(test_flat_rows_are_one_run_each);
+    RUN_TEST(test_row_runs_clip_horizontally);
+
+    // Sprite store
+    RUN_TEST(test_sprite_store_returns_what_was_put);
+    RUN_TEST(test_sprite_store_compacts_on_replace_and_remove);
+    RUN_TEST(test_sprite_that_does_not_fit_drops_the_old_one);
+    RUN_TEST(test_sprite_id_parses_only_digits_in_range);
+
+    // Status overlay
+    RUN_TEST(test_status_overlay_lays_lines_out_by_row);
+    RUN_TEST(test_status_overlay_evicts_oldest_when_full);
+    RUN_TEST(test_status_overlay_evicts_for_a_wrapped_line_on_the_last_row);
+    RUN_TEST(test_status_overlay_expires_timed_lines);
+
+    // Display profiles
+    RUN_TEST(test_display_profiles_are_found_by_name);
+
+    // Command frames
+    RUN_TEST(test_command_frame_splits_into_records);
+    RUN_TEST(test_command_frame_is_refused_whole);
+
+    // Topic dispatch
+    RUN_TEST(test_topic_routes_find_exact_suffixes_only);
+    RUN_TEST(test_topic_last_level_is_the_wildcard_suffix);
+    RUN_TEST(test_topic_routes_out_of_order_are_caught);
+
+    // Topic registry
+    RUN_TEST(test_topic_registry_builds_device_and_slot_topics);
+    RUN_TEST(test_topic_registry_rebinds_slots_in_place);
+
+    // Publish queue
+    RUN_TEST(test_publish_queue_coalesces_in_place);
+    RUN_TEST(test_publish_queue_retries_and_rejects);
+
+    // UDP commands
+    RUN_TEST(test_udp_command_header_parses);
+    RUN_TEST(test_udp_sequence_filter_drops_stale);
+    RUN_TEST(test_udp_sequence_filter_drops_old_epoch_straggler);
+
+    // Fleet commands
+    RUN_TEST(test_siphash_reference_vectors);
+    RUN_TEST(test_fleet_command_checks_tag);
+    RUN_TEST(test_fleet_nonce_floor_survives_a_restart);
+
+    // State snapshot
+    RUN_TEST(test_state_snapshot_formats_one_record);
+    RUN_TEST(test_state_snapshot_refuses_what_does_not_fit);
+
+    // MQTT session
+    RUN_TEST(test_mqtt_session_probes_after_a_walk);
+    RUN_TEST(test_mqtt_session_walks_when_not_kept);
+    RUN_TEST(test_mqtt_session_ends_before_sleep);
+
+    // WiFi association cache
+    RUN_TEST(test_wifi_association_remembers_changes_only);
+    RUN_TEST(test_wifi_association_ignores_unknown_and_forgets);
+
+    // Keep-alive interval
+    RUN_TEST(test_keepalive_interval_backs_off_to_ceiling);
+    RUN_TEST(test_keepalive_interval_respects_power_bank_and_ceiling);
+    RUN_TEST(test_keepalive_interval_base_wins_over_caps);
+
+    // Check-in datagram
+    RUN_TEST(test_checkin_request_layout);
+    RUN_TEST(test_checkin_response_needs_the_nonce);
+
+    // Idle governor
+    RUN_TEST(test_idle_governor_rests_after_a_quiet_spell);
+    RUN_TEST(test_idle_governor_keeps_the_radio_up_during_a_game);
+    RUN_TEST(test_idle_governor_counts_only_woken_waits);
+
+    // Wake timeline
+    RUN_TEST(test_wake_timeline_records_phases_in_a_ring);
+    RUN_TEST(test_wake_timeline_keeps_the_newest_that_fit);
+
     return UNITY_END();
 }
@@ -0,0 +1,98 @@
+#!/usr/bin/env python3
+"""Answer sleeping cubes' keep-alive check-ins over UDP.
+
+Usage: checkin_responder.py [broker]
+
+Runs beside the broker. Mirrors the retained auto_sleep flags
+(cube/device/<id>/auto_sleep and cube/<slot>/auto_sleep) and answers each
+check-in datagram with them, in the format src/checkin_datagram.h describes.
+Until the broker has delivered its retained flags it answers nothing, and the
+cubes fall back to checking in over MQTT.
+"""
+import socket
+import struct
+import sys
+import threading
+import uuid
+
+import paho.mqtt.client as mqtt
+
+CHECKIN_PORT = 54324
+MAGIC = 0xCD
+VERSION = 1
+DEVICE_ID_BYTES = 12
+REQUEST_BYTES = 7 + DEVICE_ID_BYTES
+FLAG_DEVICE_SLEEP = 0x01
+FLAG_SLOT_SLEEP = 0x02
+
+
+class FlagMirror:
+    """The retained auto_sleep flags, keyed by topic."""
+
+    def __init__(self):
+        self.lock = threading.Lock()
+        self.flags = {}
+        self.ready = threading.Event()
+        # Published after the flag subscriptions; its return means every
+        # retained flag before it has been delivered.
+        self.marker_topic = f"cube/checkin_responder/{uuid.uuid4().hex}"
+
+    def on_connect(self, client, userdata, flags, reason_code, properties):
+        self.ready.clear()
+        client.subscribe("cube/device/+/auto_sleep")
+        client.subscribe("cube/+/auto_sleep")
+        client.subscribe(self.marker_topic)
+        client.publish(self.marker_topic, "ready")
+
+    def on_disconnect(self, client, userdata, flags, reason_code, properties):
+        self.ready.clear()
+
+    def on_message(self, client, userdata, message):
+        if message.topic == self.marker_topic:
+            self.ready.set()
+            return
+        with self.lock:
+            self.flags[message.topic] = message.payload == b"1"
+
+    def requested(self, topic):
+        with self.lock:
+            return self.flags.get(topic, False)
+
+
+def build_response(request, mirror):
+    """The response to one request, or None if it is not one to answer."""
+    if len(request) != REQUEST_BYTES or request[0] != MAGIC or request[1] != VERSION:
+        return None
+    nonce = request[2:6]
+    slot = request[6]
+    device_id = request[7:].decode("ascii", errors="replace")
+    flags = 0
+    if mirror.requested(f"cube/device/{device_id}/auto_sleep"):
+        flags |= FLAG_DEVICE_SLEEP
+    if slot and mirror.requested(f"cube/{slot}/auto_sleep"):
+        flags |= FLAG_SLOT_SLEEP
+    return struct.pack(">BB", MAGIC, VERSION) + nonce + bytes([flags])
+
+
+if __name__ == "__main__":
+    broker = sys.argv[1] if len(sys.argv) > 1 else "192.168.8.247"
+    mirror = FlagMirror()
+    client = mqtt.Client(mqtt.CallbackAPIVersion.VERSION2)
+    client.on_connect = mirror.on_connect
+    client.on_disconnect = mirror.on_disconnect
+    client.on_message = mirror.on_message
+    client.connect(broker, 1883, 60)
+    client.loop_start()
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.bind(("", CHECKIN_PORT))
+    print(f"check-in responder on UDP {CHECKIN_PORT}, flags from {broker}")
+    while True:
+        request, sender = sock.recvfrom(64)
+        # Silence is "unconfirmed" to the cube, which is the truth until the
+        # retained flags are in.
+        if not mirror.ready.is_set():
+            continue
+        response = build_response(request, mirror)
+        if response is not None:
+            sock.sendto(response, sender)
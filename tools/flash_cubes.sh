@@ -8,10 +8,12 @@ PIO="${PIO:-$HOME/.platformio/penv/bin/pio}"
 PYTHON="${PYTHON:-python3}"
 
 # One settling window for the whole fleet before the "all" sweep probes it. A
-# sleeping cube answers on its next check-in -- sleep_interval_s, 20 by default
-# -- and then needs a full boot, so this covers both, once, rather than per
-# cube.
-FLEET_SETTLE_S="${FLEET_SETTLE_S:-45}"
+# sleeping cube answers on its next check-in -- 20 s after it went to sleep,
+# doubling each time it finds the flag still set -- and then needs a full
+# boot, so this covers both, once, rather than per cube, for a cube put to
+# sleep in the last minute or so. One left asleep longer checks in up to
+# sleep_interval_max (300 s) apart; raise FLEET_SETTLE_S to catch those.
+FLEET_SETTLE_S="${FLEET_SETTLE_S:-60}"
 
 if ! python3 "$(dirname "$0")/validate_mac_table.py"; then
     echo "MAC table validation failed; aborting." >&2
@@ -163,8 +165,10 @@ keep_awake() {
 }
 
 # A sleeping cube learns the flag was cleared only at its next check-in --
-# sleep_interval_s, 20 by default -- and then needs a full boot, so the window
-# has to cover both comfortably.
+# 20 s apart at first, backing off to sleep_interval_max (300 s) the longer it
+# sleeps -- and then needs a full boot, so the window has to cover both. The
+# loop returns as soon as the cube answers, so the long default costs nothing
+# when it comes up early.
 #
 # Measured against the clock, not counted in attempts: each failed
 # is_cube_online blocks for its own timeout before this loop's sleep, so an
@@ -172,7 +176,7 @@ keep_awake() {
 # the reported figure would be wrong.
 wait_for_cube_online() {
     local cube_id=$1
-    local timeout_s=${2:-60}
+    local timeout_s=${2:-330}
     local deadline=$((SECONDS + timeout_s))
 
     echo "Waiting up to ${timeout_s}s for cube $cube_id to come online..."
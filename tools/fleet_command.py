@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Send a signed command to every cube through the fleet multicast group.
+
+Usage: fleet_command.py <key> <command> [payload]
+  e.g. fleet_command.py change-me-16char brightness 40
+       fleet_command.py change-me-16char sleep_now 1
+
+<key> is FLEET_COMMAND_KEY from src/secrets.h. The nonce is the clock in
+milliseconds, as src/fleet_command.h expects.
+"""
+import socket
+import struct
+import sys
+import time
+
+FLEET_GROUP = "239.255.54.32"
+FLEET_PORT = 54323
+MAGIC = 0xCF
+VERSION = 1
+
+# fleet_command.h
+COMMANDS = {
+    "brightness": 0x01,
+    "string": 0x02,
+    "border_top_banner": 0x03,
+    "border_bottom_banner": 0x04,
+    "flash": 0x05,
+    "sleep_now": 0x06,
+    "reboot": 0x07,
+}
+
+MASK = (1 << 64) - 1
+
+
+def _rotl(x, b):
+    return ((x << b) | (x >> (64 - b))) & MASK
+
+
+def _sipround(v0, v1, v2, v3):
+    v0 = (v0 + v1) & MASK; v1 = _rotl(v1, 13) ^ v0; v0 = _rotl(v0, 32)
+    v2 = (v2 + v3) & MASK; v3 = _rotl(v3, 16) ^ v2
+    v0 = (v0 + v3) & MASK; v3 = _rotl(v3, 21) ^ v0
+    v2 = (v2 + v1) & MASK; v1 = _rotl(v1, 17) ^ v2; v2 = _rotl(v2, 32)
+    return v0, v1, v2, v3
+
+
+def siphash24(key, data):
+    k0, k1 = struct.unpack("<QQ", key)
+    v0 = 0x736f6d6570736575 ^ k0
+    v1 = 0x646f72616e646f6d ^ k1
+    v2 = 0x6c7967656e657261 ^ k0
+    v3 = 0x7465646279746573 ^ k1
+    whole = len(data) - len(data) % 8
+    for i in range(0, whole, 8):
+        m, = struct.unpack_from("<Q", data, i)
+        v3 ^= m
+        v0, v1, v2, v3 = _sipround(v0, v1, v2, v3)
+        v0, v1, v2, v3 = _sipround(v0, v1, v2, v3)
+        v0 ^= m
+    last = (len(data) & 0xFF) << 56
+    for i, byte in enumerate(data[whole:]):
+        last |= byte << (8 * i)
+    v3 ^= last
+    v0, v1, v2, v3 = _sipround(v0, v1, v2, v3)
+    v0, v1, v2, v3 = _sipround(v0, v1, v2, v3)
+    v0 ^= last
+    v2 ^= 0xFF
+    for _ in range(4):
+        v0, v1, v2, v3 = _sipround(v0, v1, v2, v3)
+    return v0 ^ v1 ^ v2 ^ v3
+
+
+def build_datagram(key, command, payload, nonce):
+    body = struct.pack(">BBBQ", MAGIC, VERSION, COMMANDS[command], nonce) + payload
+    return body + struct.pack("<Q", siphash24(key, body))
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 3:
+        print(__doc__, file=sys.stderr)
+        sys.exit(1)
+
+    key = sys.argv[1].encode()
+    if len(key) != 16:
+        print("key must be exactly 16 characters", file=sys.stderr)
+        sys.exit(1)
+    payload = sys.argv[3].encode() if len(sys.argv) > 3 else b""
+    datagram = build_datagram(key, sys.argv[2], payload, int(time.time() * 1000))
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM, socket.IPPROTO_UDP)
+    sock.setsockopt(socket.IPPROTO_IP, socket.IP_MULTICAST_TTL, 1)
+    sock.sendto(datagram, (FLEET_GROUP, FLEET_PORT))
+    sock.close()
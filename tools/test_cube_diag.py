@@ -39,9 +39,32 @@ try:
     rssi = int(parts.get('rssi', 0))
 
     print(f"  Loop time (avg):     {loop_us:>10} us")
-    print(f"  MQTT (avg):          {int(parts.get('mqtt', 0)):>10} us")
-    print(f"  Display (avg):       {int(parts.get('disp', 0)):>10} us")
-    print(f"  UDP (avg):           {int(parts.get('udp', 0)):>10} us")
+    print(f"  MQTT (net task avg): {int(parts.get('mqtt', 0)):>10} us")
+    print(f"  Frame (avg):         {int(parts.get('disp', 0)):>10} us")
+    print(f"  Frame (max):         {int(parts.get('disp_max', 0)):>10} us")
+    print(f"  Frames:              {int(parts.get('frames', 0)):>10}")
+    print(f"  Display cmds dropped:{int(parts.get('disp_drop', 0)):>10}")
+    print(f"  Publishes queued:    {int(parts.get('pubq', 0)):>10}")
+    print(f"  Publishes dropped:   {int(parts.get('pub_drop', 0)):>10}")
+    print(f"  Net handoffs dropped:{int(parts.get('net_drop', 0)):>10}")
+    print(f"  MQTT connects:       {int(parts.get('connects', 0)):>10}")
+    print(f"  Last outage:         {int(parts.get('outage_ms', 0)):>10} ms")
+    print(f"  Connect to ready:    {int(parts.get('ready_ms', 0)):>10} ms")
+    print(f"  Subscription walks:  {int(parts.get('walks', 0)):>10}")
+    print(f"  Sessions resumed:    {int(parts.get('resumes', 0)):>10}")
+    print(f"  Loop idle:           {int(parts.get('idle_pct', 0)):>10} %")
+    print(f"  Idle wake (avg):     {int(parts.get('wake_avg_us', 0)):>10} us")
+    print(f"  Idle wake (max):     {int(parts.get('wake_max_us', 0)):>10} us")
+    print(f"  Idle wakes:          {int(parts.get('wakes', 0)):>10}")
+    print(f"  Radio dozing:        {'yes' if parts.get('doze') == '1' else 'no':>10}")
+    print(f"  UDP commands:        {int(parts.get('udp_cmd', 0)):>10}")
+    print(f"  UDP commands dropped:{int(parts.get('udp_cmd_drop', 0)):>10}")
+    print(f"  Fleet commands:      {int(parts.get('fleet_cmd', 0)):>10}")
+    print(f"  Fleet cmds dropped:  {int(parts.get('fleet_cmd_drop', 0)):>10}")
+    print(f"  Panel refresh:       {int(parts.get('refresh_hz', 0)):>10} Hz")
+    print(f"  Panel DMA memory:    {int(parts.get('dma', 0)):>10} bytes")
+    print(f"  Display profile:     {parts.get('profile', '?'):>10}")
+    print(f"  UDP (net task avg):  {int(parts.get('udp', 0)):>10} us")
     print(f"  NFC (avg):           {nfc_us:>10} us")
     print(f"  NFC (max):           {nfc_max:>10} us")
     print(f"  Letter interval avg: {letter_avg:>10} ms")
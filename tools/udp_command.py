@@ -0,0 +1,62 @@
+#!/usr/bin/env python3
+"""Send display commands to a cube over its UDP command path.
+
+Usage: udp_command.py <host> <slot> <type>=<value> [<type>=<value> ...]
+  e.g. udp_command.py 192.168.8.23 3 letter=A border=NS:0xF800
+
+Each invocation uses a fresh epoch from the clock, so its sequence numbers
+are never taken as stale against an earlier run: the cube only lets a newer
+epoch restart the sequence (udp_command.h). The clock is read in 100 ms
+ticks, not seconds, so that two runs in the same second -- a script sending
+one command after another -- still get different epochs. Half the 16-bit
+space is then about 109 minutes, far longer than the cube remembers a sender.
+"""
+import socket
+import struct
+import sys
+import time
+
+UDP_PORT = 54321
+MAGIC = 0xCB
+VERSION = 1
+
+# command_frame.h
+TYPES = {
+    "letter": 0x01,
+    "border": 0x02,
+    "lock": 0x03,
+    "flash": 0x04,
+    "rise_ms": 0x05,
+    "string": 0x06,
+    "font_size": 0x07,
+    "border_frame": 0x08,
+    "border_hline_top": 0x09,
+    "border_hline_bottom": 0x0A,
+    "border_vline_left": 0x0B,
+    "border_vline_right": 0x0C,
+    "border_vline_height": 0x0D,
+    "brightness": 0x0E,
+}
+
+
+def build_datagram(slot, epoch, sequence, commands):
+    frame = b""
+    for name, value in commands:
+        data = value.encode()
+        frame += bytes([TYPES[name], len(data)]) + data
+    return struct.pack(">BBBHI", MAGIC, VERSION, slot, epoch, sequence) + frame
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 4:
+        print(__doc__, file=sys.stderr)
+        sys.exit(1)
+
+    host = sys.argv[1]
+    slot = int(sys.argv[2])
+    commands = [arg.split("=", 1) for arg in sys.argv[3:]]
+    epoch = int(time.time() * 10) & 0xFFFF
+
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.sendto(build_datagram(slot, epoch, 1, commands), (host, UDP_PORT))
+    sock.close()
@@ -0,0 +1,77 @@
+#!/usr/bin/env python3
+"""Show where each cube's recent wakes spent their time.
+
+Usage: wake_timeline.py <cube_ip> [<cube_ip> ...]
+
+Asks each cube for its wake timeline over UDP ("wakes"; see
+src/wake_timeline.h) and prints one line per recorded wake, with the radio-on
+time of each keep-alive pulse -- from setup() to deep sleep -- and the
+average across the pulses that went back to sleep.
+"""
+import json
+import socket
+import sys
+
+UDP_PORT = 54321
+REASONS = ["timer", "button", "dock", "other"]
+PHASES = ["boot", "wifi", "mqtt", "flags", "sleep"]
+FLAG_CACHED_WIFI = 0x01
+FLAG_DATAGRAM = 0x02
+FLAG_CONFIRMED = 0x04
+FLAG_WOKE = 0x08
+SATURATED = 0xFFFF
+
+
+def query(cube_ip):
+    sock = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+    sock.settimeout(2)
+    try:
+        sock.sendto(b"wakes", (cube_ip, UDP_PORT))
+        return json.loads(sock.recv(1024).decode())
+    except (socket.timeout, ValueError):
+        return None
+    finally:
+        sock.close()
+
+
+def describe(flags):
+    words = ["cached" if flags & FLAG_CACHED_WIFI else "scan"]
+    if flags & FLAG_DATAGRAM:
+        words.append("datagram")
+    if flags & FLAG_CONFIRMED:
+        words.append("confirmed")
+    if flags & FLAG_WOKE:
+        words.append("woke")
+    return ",".join(words)
+
+
+def show(cube_ip, timeline):
+    wakes = timeline["wakes"]
+    first_seq = timeline["last"] - len(wakes) + 1
+    print(f"{cube_ip}: {len(wakes)} wakes, last #{timeline['last']}")
+    pulses = []
+    for offset, (reason, flags, *phases) in enumerate(wakes):
+        marks = " ".join(
+            f"{name}={ms if ms != SATURATED else '-'}"
+            for name, ms in zip(PHASES, phases) if ms)
+        line = f"  #{first_seq + offset:<6} {REASONS[min(reason, 3)]:<6} {describe(flags):<28} {marks}"
+        boot, sleep = phases[0], phases[-1]
+        if sleep and sleep != SATURATED and not flags & FLAG_WOKE:
+            pulses.append(sleep - boot)
+            line += f"  radio-on {sleep - boot} ms"
+        print(line)
+    if pulses:
+        print(f"  pulses: {len(pulses)}, radio-on avg {sum(pulses) // len(pulses)} ms,"
+              f" max {max(pulses)} ms")
+
+
+if __name__ == "__main__":
+    if len(sys.argv) < 2:
+        print(__doc__.strip().splitlines()[2], file=sys.stderr)
+        sys.exit(1)
+    for ip in sys.argv[1:]:
+        timeline = query(ip)
+        if timeline is None:
+            print(f"{ip}: no answer")
+            continue
+        show(ip, timeline)